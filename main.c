@@ -9,51 +9,214 @@
 
 #include "moon/moon.h"
 
+#include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
+// Output buffer of the streaming mode. Input is read in chunks of the
+// same size, so lines must be shorter than that.
+#define STREAM_BUFFER_SIZE (1 << 16)
+
+// Upper bound on the length of one record.
+#define RECORD_MAX 1024
+
+// Range mode: records per chunk, and chunks buffered per thread.
+#define RANGE_CHUNK 1024
+#define RANGE_SLOTS_PER_THREAD 2
+
+typedef enum {
+    FORMAT_CSV,
+    FORMAT_JSONL,
+    FORMAT_BINARY,
+} RecordFormat;
+
+typedef struct {
+    char* data;
+    size_t size;
+    bool ready;
+} RangeSlot;
+
+// Chunks are formatted by worker threads in any order, and written by
+// the main thread in chronological order. A chunk only gets a slot
+// once the chunk that last used it has been written.
+typedef struct {
+    time_t from;
+    long step;
+    unsigned long count;
+    RecordFormat format;
+    unsigned long chunk_count;
+    unsigned long next_chunk;  // Next chunk to format.
+    unsigned long next_write;  // Next chunk to write.
+    RangeSlot* slots;
+    unsigned long slot_count;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;
+    pthread_cond_t slot_ready;
+} Range;
 
 void print_help(void);
 void for_now(void);
 void for_custom_timestamp(const long timestamp);
+int for_json(const time_t* timestamp);
+int for_stream(RecordFormat format);
+int for_range(time_t from, time_t to, long step, long threads, RecordFormat format);
+size_t format_range_chunk(const Range* range, unsigned long chunk, char* buf);
+void* range_worker(void* arg);
+void print_record_header(RecordFormat format);
+size_t format_record(char* buf, const MoonPhase* mphase, RecordFormat format);
 int is_arg_timestamp(const char* arg);
 time_t timestamp_str_to_timestamp(const char* timestamp);
 time_t datetime_str_to_timestamp(const char* datetime);
+time_t arg_to_timestamp(const char* arg);
+int parse_datetime(const char* datetime, time_t* timestamp);
+long parse_long_option(const char* name, const char* value, long min);
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        for_now();
-        return EXIT_SUCCESS;
+    bool stream = false;
+    bool json = false;
+    bool has_format = false;
+    RecordFormat format = FORMAT_CSV;
+    const char* datetime = NULL;
+    const char* from = NULL;
+    const char* to = NULL;
+    long step = 86400;
+    long threads = 0;
+    bool has_range_option = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            print_help();
+            return EXIT_SUCCESS;
+        } else if (strcmp(arg, "--json") == 0) {
+            json = true;
+        } else if (strcmp(arg, "--stream") == 0) {
+            stream = true;
+        } else if (strcmp(arg, "--csv") == 0) {
+            format = FORMAT_CSV;
+            has_format = true;
+        } else if (strcmp(arg, "--jsonl") == 0) {
+            format = FORMAT_JSONL;
+            has_format = true;
+        } else if (strcmp(arg, "--binary") == 0) {
+            format = FORMAT_BINARY;
+            has_format = true;
+        } else if (
+            strcmp(arg, "--from") == 0 || strcmp(arg, "--to") == 0
+            || strcmp(arg, "--step") == 0 || strcmp(arg, "--threads") == 0
+        ) {
+            if (value == NULL) {
+                fprintf(stderr, "%s requires a value.\n", arg);
+                return EXIT_FAILURE;
+            }
+            if (strcmp(arg, "--from") == 0) {
+                from = value;
+            } else if (strcmp(arg, "--to") == 0) {
+                to = value;
+            } else if (strcmp(arg, "--step") == 0) {
+                step = parse_long_option(arg, value, 1);
+                has_range_option = true;
+            } else {
+                threads = parse_long_option(arg, value, 1);
+                has_range_option = true;
+            }
+            ++i;
+        } else if (datetime == NULL && (arg[0] != '-' || is_arg_timestamp(arg))) {
+            datetime = arg;
+        } else {
+            fprintf(stderr, "Unexpected argument: '%s'.\n", arg);
+            return EXIT_FAILURE;
+        }
     }
 
-    const char* arg = argv[1];
+    if (json && (stream || from != NULL || to != NULL || has_format)) {
+        fprintf(stderr, "--json is for single reports; use --jsonl for records.\n");
+        return EXIT_FAILURE;
+    }
 
-    if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
-        print_help();
-        return EXIT_SUCCESS;
+    if (from != NULL || to != NULL) {
+        if (from == NULL || to == NULL) {
+            fprintf(stderr, "--from and --to go together.\n");
+            return EXIT_FAILURE;
+        }
+        if (stream || datetime != NULL) {
+            fprintf(stderr, "--from and --to replace other inputs.\n");
+            return EXIT_FAILURE;
+        }
+        if (threads == 0)
+            threads = sysconf(_SC_NPROCESSORS_ONLN);
+        return for_range(
+            arg_to_timestamp(from),
+            arg_to_timestamp(to),
+            step,
+            (threads > 0) ? threads : 1,
+            format
+        );
     }
 
-    time_t timestamp = 0;
-    if (is_arg_timestamp(arg)) {
-        timestamp = timestamp_str_to_timestamp(arg);
-    } else {
-        timestamp = datetime_str_to_timestamp(arg);
+    if (has_range_option) {
+        fprintf(stderr, "--step and --threads require --from and --to.\n");
+        return EXIT_FAILURE;
     }
-    for_custom_timestamp(timestamp);
+
+    if (stream) {
+        if (datetime != NULL) {
+            fprintf(stderr, "--stream reads its input from stdin.\n");
+            return EXIT_FAILURE;
+        }
+        return for_stream(format);
+    }
+
+    if (has_format) {
+        fprintf(stderr, "--csv, --jsonl and --binary require --stream or --from/--to.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (json) {
+        if (datetime == NULL)
+            return for_json(NULL);
+        time_t timestamp = arg_to_timestamp(datetime);
+        return for_json(&timestamp);
+    }
+
+    if (datetime == NULL) {
+        for_now();
+        return EXIT_SUCCESS;
+    }
+
+    for_custom_timestamp(arg_to_timestamp(datetime));
 
     return 0;
 }
 
 void print_help(void) {
-    printf("usage: moontool [-h] [] [DATETIME] [±TIMESTAMP]\n\n");
+    printf("usage: moontool [-h] [--json] [] [DATETIME] [±TIMESTAMP]\n");
+    printf("       moontool --stream [--csv | --jsonl | --binary]\n");
+    printf("       moontool --from FROM --to TO [--step SECONDS] [--threads N]\n");
+    printf("                [--csv | --jsonl | --binary]\n\n");
     printf("optional arguments:\n");
     printf("  -h, --help            show this help message and exit\n");
     printf("  []                    without arguments, defaults to now\n");
     printf("  [DATETIME]            universal datetime (e.g., 1994-12-22T13:53:34)\n");
     printf("  [±TIMESTAMP]          Unix timestamp (e.g., 788104414)\n");
+    printf("  --json                output as JSON\n");
+    printf("  --stream              read one DATETIME or TIMESTAMP per line from\n");
+    printf("                        stdin, write one record per line to stdout\n");
+    printf("  --from, --to          write one record per step, from FROM to TO\n");
+    printf("                        inclusive (DATETIME or TIMESTAMP)\n");
+    printf("  --step                seconds between records (default: 86400)\n");
+    printf("  --threads             threads to use (default: all cores)\n");
+    printf("  --csv                 records as CSV, with a header (default)\n");
+    printf("  --jsonl               records as JSON Lines\n");
+    printf("  --binary              records as fixed-width binary, with a header\n");
+    printf("                        (see moonphase_record_header() in moon.h)\n");
 }
 
 void for_now(void) {
@@ -78,6 +241,286 @@ void for_custom_timestamp(const long timestamp) {
     printf("\n");
 }
 
+int for_json(const time_t* timestamp) {
+    MoonPhase mphase;
+    MoonCalendar mcal;
+    if (!moonphase(&mphase, timestamp) || !mooncal(&mcal, timestamp)) {
+        fprintf(stderr, "Error computing info about the Moon.\n");
+        return EXIT_FAILURE;
+    }
+
+    char phase[1024];
+    char calendar[1024];
+    if (
+        moonphase_to_json(phase, sizeof(phase), &mphase) >= sizeof(phase)
+        || mooncal_to_json(calendar, sizeof(calendar), &mcal) >= sizeof(calendar)
+    ) {
+        fprintf(stderr, "Error formatting JSON.\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("{\"phase\":%s,\"calendar\":%s}\n", phase, calendar);
+    return EXIT_SUCCESS;
+}
+
+int for_stream(RecordFormat format) {
+    static char in[STREAM_BUFFER_SIZE];
+    size_t start = 0, end = 0;
+    unsigned long line_number = 0;
+    int status = EXIT_SUCCESS;
+    bool eof = false;
+
+    // Fully buffered, even if stdout is a terminal. Output is only
+    // flushed when full, or when about to wait for more input (so that
+    // a process feeding queries one by one gets its answers).
+    setvbuf(stdout, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+
+    print_record_header(format);
+
+    while (!eof || start < end) {
+        char* line = in + start;
+        char* newline = memchr(line, '\n', end - start);
+
+        if (newline == NULL && !eof) {
+            // Incomplete line; move it to the front and read more.
+            memmove(in, line, end - start);
+            end -= start;
+            start = 0;
+            if (end == sizeof(in)) {
+                fprintf(stderr, "line %lu: Line too long.\n", line_number + 1);
+                return EXIT_FAILURE;
+            }
+
+            struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+            if (poll(&pfd, 1, 0) == 0)
+                fflush(stdout);
+
+            ssize_t n = read(STDIN_FILENO, in + end, sizeof(in) - end);
+            if (n < 0) {
+                perror("read");
+                return EXIT_FAILURE;
+            }
+            if (n == 0)
+                eof = true;
+            end += (size_t) n;
+            continue;
+        }
+
+        // Last line may not end with a newline.
+        size_t len = (newline != NULL) ? (size_t) (newline - line) : end - start;
+        start += len + (newline != NULL);
+        ++line_number;
+
+        while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' '
+                           || line[len - 1] == '\t'))
+            --len;
+        while (len > 0 && (*line == ' ' || *line == '\t')) {
+            ++line;
+            --len;
+        }
+        if (len == 0)
+            continue;
+        line[len] = '\0';
+
+        time_t timestamp;
+        if (is_arg_timestamp(line)) {
+            timestamp = timestamp_str_to_timestamp(line);
+        } else if (!parse_datetime(line, &timestamp)) {
+            fprintf(stderr, "line %lu: Error reading date and time from input.\n", line_number);
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        MoonPhase mphase;
+        if (!moonphase(&mphase, &timestamp)) {
+            fprintf(stderr, "line %lu: Error computing info about the phase of the Moon.\n", line_number);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        char record[RECORD_MAX];
+        fwrite(record, 1, format_record(record, &mphase, format), stdout);
+    }
+
+    if (fflush(stdout) != 0) {
+        perror("write");
+        return EXIT_FAILURE;
+    }
+    return status;
+}
+
+int for_range(time_t from, time_t to, long step, long threads, RecordFormat format) {
+    if (from > to) {
+        fprintf(stderr, "--from must not be after --to.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Every timestamp in between is valid if both ends are.
+    MoonPhase mphase;
+    if (!moonphase(&mphase, &from) || !moonphase(&mphase, &to)) {
+        fprintf(stderr, "Error computing info about the phase of the Moon.\n");
+        return EXIT_FAILURE;
+    }
+
+    Range range = {0};
+    range.from = from;
+    range.step = step;
+    range.count = (unsigned long) ((to - from) / step) + 1;
+    range.format = format;
+    range.chunk_count = (range.count + RANGE_CHUNK - 1) / RANGE_CHUNK;
+    range.slot_count = (unsigned long) threads * RANGE_SLOTS_PER_THREAD;
+    if (range.slot_count > range.chunk_count)
+        range.slot_count = range.chunk_count;
+
+    range.slots = calloc(range.slot_count, sizeof(RangeSlot));
+    if (range.slots == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    for (unsigned long i = 0; i < range.slot_count; ++i) {
+        range.slots[i].data = malloc((size_t) RANGE_CHUNK * RECORD_MAX);
+        if (range.slots[i].data == NULL) {
+            perror("malloc");
+            return EXIT_FAILURE;
+        }
+    }
+
+    setvbuf(stdout, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+    print_record_header(format);
+
+    if (threads == 1) {
+        // No need for workers; same chunks, same output.
+        for (unsigned long c = 0; c < range.chunk_count; ++c) {
+            size_t size = format_range_chunk(&range, c, range.slots[0].data);
+            fwrite(range.slots[0].data, 1, size, stdout);
+        }
+    } else {
+        pthread_t* workers = malloc((size_t) threads * sizeof(pthread_t));
+        if (workers == NULL) {
+            perror("malloc");
+            return EXIT_FAILURE;
+        }
+        pthread_mutex_init(&range.lock, NULL);
+        pthread_cond_init(&range.slot_free, NULL);
+        pthread_cond_init(&range.slot_ready, NULL);
+
+        long started = 0;
+        for (; started < threads; ++started) {
+            if (pthread_create(&workers[started], NULL, range_worker, &range) != 0)
+                break;
+        }
+        if (started == 0) {
+            fprintf(stderr, "Error starting threads.\n");
+            return EXIT_FAILURE;
+        }
+
+        // Reorder buffer: write chunks as they become ready, in order.
+        for (unsigned long c = 0; c < range.chunk_count; ++c) {
+            RangeSlot* slot = &range.slots[c % range.slot_count];
+
+            pthread_mutex_lock(&range.lock);
+            while (!slot->ready)
+                pthread_cond_wait(&range.slot_ready, &range.lock);
+            pthread_mutex_unlock(&range.lock);
+
+            fwrite(slot->data, 1, slot->size, stdout);
+
+            pthread_mutex_lock(&range.lock);
+            slot->ready = false;
+            ++range.next_write;
+            pthread_cond_broadcast(&range.slot_free);
+            pthread_mutex_unlock(&range.lock);
+        }
+
+        for (long i = 0; i < started; ++i)
+            pthread_join(workers[i], NULL);
+
+        pthread_cond_destroy(&range.slot_ready);
+        pthread_cond_destroy(&range.slot_free);
+        pthread_mutex_destroy(&range.lock);
+        free(workers);
+    }
+
+    for (unsigned long i = 0; i < range.slot_count; ++i)
+        free(range.slots[i].data);
+    free(range.slots);
+
+    if (fflush(stdout) != 0) {
+        perror("write");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+size_t format_range_chunk(const Range* range, unsigned long chunk, char* buf) {
+    unsigned long first = chunk * RANGE_CHUNK;
+    unsigned long last = first + RANGE_CHUNK;
+    if (last > range->count)
+        last = range->count;
+
+    size_t size = 0;
+    for (unsigned long i = first; i < last; ++i) {
+        time_t timestamp = range->from + (time_t) i * range->step;
+        MoonPhase mphase;
+        moonphase(&mphase, &timestamp);
+        size += format_record(buf + size, &mphase, range->format);
+    }
+    return size;
+}
+
+void* range_worker(void* arg) {
+    Range* range = arg;
+
+    pthread_mutex_lock(&range->lock);
+    for (;;) {
+        while (
+            range->next_chunk < range->chunk_count
+            && range->next_chunk >= range->next_write + range->slot_count
+        )
+            pthread_cond_wait(&range->slot_free, &range->lock);
+        if (range->next_chunk >= range->chunk_count)
+            break;
+
+        unsigned long chunk = range->next_chunk++;
+        RangeSlot* slot = &range->slots[chunk % range->slot_count];
+        pthread_mutex_unlock(&range->lock);
+
+        size_t size = format_range_chunk(range, chunk, slot->data);
+
+        pthread_mutex_lock(&range->lock);
+        slot->size = size;
+        slot->ready = true;
+        pthread_cond_broadcast(&range->slot_ready);
+    }
+    pthread_mutex_unlock(&range->lock);
+
+    return NULL;
+}
+
+void print_record_header(RecordFormat format) {
+    if (format == FORMAT_BINARY) {
+        unsigned char header[MOON_RECORD_HEADER_SIZE];
+        fwrite(header, 1, moonphase_record_header(header), stdout);
+        return;
+    }
+    if (format != FORMAT_CSV)
+        return;
+    printf("%s\n", MOON_CSV_HEADER);
+}
+
+size_t format_record(char* buf, const MoonPhase* mphase, RecordFormat format) {
+    if (format == FORMAT_BINARY) {
+        moonphase_to_record((unsigned char*) buf, mphase);
+        return MOON_RECORD_SIZE;
+    }
+
+    // Leave room for the newline.
+    size_t len = (format == FORMAT_CSV)
+        ? moonphase_to_csv(buf, RECORD_MAX - 1, mphase)
+        : moonphase_to_json(buf, RECORD_MAX - 1, mphase);
+    buf[len] = '\n';
+    return len + 1;
+}
+
 int is_digit(const char character) {
     return character >= '0' && character <= '9';
 }
@@ -102,7 +545,22 @@ time_t timestamp_str_to_timestamp(const char* timestamp) {
     return (time_t) atol(timestamp);
 }
 
+time_t arg_to_timestamp(const char* arg) {
+    if (is_arg_timestamp(arg))
+        return timestamp_str_to_timestamp(arg);
+    return datetime_str_to_timestamp(arg);
+}
+
 time_t datetime_str_to_timestamp(const char* datetime) {
+    time_t timestamp;
+    if (!parse_datetime(datetime, &timestamp)) {
+        fprintf(stderr, "Error reading date and time from input.\n");
+        exit(EXIT_FAILURE);
+    }
+    return timestamp;
+}
+
+int parse_datetime(const char* datetime, time_t* timestamp) {
     struct tm gm = {0};
     gm.tm_isdst = 0;  // Explicitly UTC.
 
@@ -112,10 +570,19 @@ time_t datetime_str_to_timestamp(const char* datetime) {
     else
         conversion = strptime(datetime, "%Y-%m-%dT%H:%M:%S", &gm);
 
-    if (conversion == NULL || *conversion != '\0') {
-        fprintf(stderr, "Error reading date and time from input.\n");
+    if (conversion == NULL || *conversion != '\0')
+        return false;
+
+    *timestamp = timegm(&gm);
+    return true;
+}
+
+long parse_long_option(const char* name, const char* value, long min) {
+    char* end;
+    long number = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || number < min) {
+        fprintf(stderr, "Invalid value for %s: '%s'.\n", name, value);
         exit(EXIT_FAILURE);
     }
-
-    return timegm(&gm);
+    return number;
 }
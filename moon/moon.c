@@ -32,18 +32,40 @@
 
 // clang-format off
 
+/*  Needed for gmtime_r() and localtime_r() under strict ISO C.  */
+#define _POSIX_C_SOURCE 200809L
+
 #include "moon.h"
 
+#include <float.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 #define TRUE        1
 #define FALSE       0
 
+/*  Reentrant time conversions.  The library must not hold any mutable
+    global state (see moon.h), so the static buffers of gmtime() and
+    localtime() are never used.  */
+
+#ifdef _WIN32
+#define gmtime_r(t, tm)    (gmtime_s((tm), (t)) == 0 ? (tm) : NULL)
+#define localtime_r(t, tm) (localtime_s((tm), (t)) == 0 ? (tm) : NULL)
+#endif
+
 /*  Astronomical constants  */
 
 #define epoch       2444238.5      /* 1980 January 0.0 */
@@ -92,24 +114,39 @@
 #define dsin(x) (sin(torad((x))))                         /* Sin from deg */
 #define dcos(x) (cos(torad((x))))                         /* Cos from deg */
 
-static char *moname[] = {
+/*  Kernels compiled once per CPU variant  (see CPU Dispatch)  must be
+    inlined into each variant,  and must not contract multiplications
+    and additions into FMA:  clang does by default,  GCC in ISO C
+    doesn't.  */
+
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+#ifdef __GNUC__
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE inline
+#endif
+
+static char *const moname[] = {
     "January", "February", "March", "April", "May",
     "June", "July", "August", "September",
     "October", "November", "December"
 };
 
-static char *dayname[] = {
+static char *const dayname[] = {
     "Sunday", "Monday", "Tuesday", "Wednesday",
     "Thursday", "Friday", "Saturday"
 };
 
-static char *phaname[] = {
+static char *const phaname[] = {
     "New Moon", "Waxing Crescent", "First Quarter",
     "Waxing Gibbous", "Full Moon", "Waning Gibbous",
     "Last Quarter", "Waning Crescent"
 };
 
-static char *moonicn[] = {
+static char *const moonicn[] = {
     "\U0001f311", "\U0001f312", "\U0001f313",  // 🌑 🌒 🌓
     "\U0001f314", "\U0001f315", "\U0001f316",  // 🌔 🌕 🌖
     "\U0001f317", "\U0001f318"                 // 🌗 🌘
@@ -121,15 +158,52 @@ static void moonphase_to_strbuf(const MoonPhase *mphase, char *buf);
 static void mooncal_to_strbuf(const MoonCalendar *mcal, char *buf);
 static void fmt_phase_time(const struct tm *gm, char *buf);
 static double jtime(struct tm *t);
+static int unixtoj(long t, double *jd);
 static double ucttoj(long year, int mon, int mday, int hour, int min, int sec);
 static void jtouct(double utime, struct tm *gm);
-static void jyear(double td, long *yy, int *mm, int *dd);
-static void jhms(double j, int *h, int *m, int *s);
-static int jwday(double j);
+static void jcivil(int64_t z, long *yy, int *mm, int *dd);
+static double lunation_k(double sdate);
+static double truephase(double k, double phase);
+static void truephases(double k, double phases[5]);
 static void phasehunt(double sdate, double phases[5]);
+static long brown_lunation(double newmoon);
+static int lunation_table_lookup(double sdate, double phases[5],
+                                 long *lunation);
+static int lunation_table_phases(double k, double phases[4], long *lunation);
 static double phase(double pdate, double *pphase, double *mage, double *dist,
                     double *angdia, double *sudist, double *suangdia);
 
+/*  A PHASE function,  of one of the precision tiers.  */
+
+typedef double (*PhaseTier)(double pdate, double *pphase, double *mage,
+                            double *dist, double *angdia, double *sudist,
+                            double *suangdia);
+
+#define PHASE_LANES MOON_ITER_LANES
+
+static void phase_lanes(const double *restrict pdate, double *restrict pfrac,
+                        double *restrict pphase, double *restrict mage,
+                        double *restrict dist, double *restrict angdia,
+                        double *restrict sudist, double *restrict suangdia);
+
+static void phase_lanes_iter(const double *restrict pdate,
+                             const double *restrict sinm,
+                             const double *restrict cosm,
+                             const double *restrict sind,
+                             const double *restrict cosd,
+                             double *restrict pfrac, double *restrict pphase,
+                             double *restrict mage, double *restrict dist,
+                             double *restrict angdia, double *restrict sudist,
+                             double *restrict suangdia);
+
+#define PHASE_LANES_FLOAT 16
+
+static void phase_lanes_float(const double *restrict pdate,
+                              float *restrict pfrac, float *restrict pphase,
+                              float *restrict mage, float *restrict dist,
+                              float *restrict angdia, float *restrict sudist,
+                              float *restrict suangdia);
+
 /* Custom API */
 
 static int fraction_of_lunation_to_phase(double p)
@@ -163,37 +237,39 @@ static int fraction_of_lunation_to_phase(double p)
 
 void tmcpy(struct tm *destination, const struct tm *source)
 {
-    // gmtime() et al. return a pointer to statically allocated memory.
-    // This function's purpose is to _copy_ the values in static memory
-    // pointed to by `source` into an _owned_ container pointed to by
-    // `destination`. This is necessary because the static memory may
-    // change during the lifetime of `source` (e.g., if gmtime() is
-    // called again).
+    // Originally copied the result of gmtime(), which points to static
+    // memory, into a MoonPhase or MoonCalendar. gmtime_r() now writes
+    // to a struct tm on the caller's stack, so plain assignment does,
+    // and this is no longer used here. It is kept because it has always
+    // been exported.
     *destination = *source;
 }
 
-int moonphase(MoonPhase *mphase, const time_t *timestamp)
+/*  MOONPHASE_TIER  --  moonphase(),  computed by a given PHASE function.  */
+
+static int moonphase_tier(MoonPhase *mphase, const time_t *timestamp,
+                          PhaseTier phasef)
 {
     long t;  // Original implementation casts time()'s time_t to a long.
     double jd, p, aom, cphase, cdist, cangdia, csund, csuang;
-    struct tm *gm;
+    struct tm gm;
 
     if (timestamp != NULL)
         t = *timestamp;
     else
         t = time(NULL);
 
-    gm = gmtime(&t);
-    if (gm == NULL)
+    if (gmtime_r(&t, &gm) == NULL)
         return FALSE;
 
-    jd = jtime(gm);
+    if (!unixtoj(t, &jd))
+        return FALSE;
 
-    p = phase(jd, &cphase, &aom, &cdist, &cangdia, &csund, &csuang);
+    p = phasef(jd, &cphase, &aom, &cdist, &cangdia, &csund, &csuang);
 
     mphase->julian_date = jd;
     mphase->timestamp = (time_t) t;
-    tmcpy(&mphase->utc_datetime, gm);
+    mphase->utc_datetime = gm;
     mphase->age = aom;
     mphase->fraction_of_lunation = p;
     mphase->phase = fraction_of_lunation_to_phase(p);
@@ -210,6 +286,111 @@ int moonphase(MoonPhase *mphase, const time_t *timestamp)
     return TRUE;
 }
 
+int moonphase(MoonPhase *mphase, const time_t *timestamp)
+{
+    return moonphase_tier(mphase, timestamp, phase);
+}
+
+int moonphase_batch(const MoonPhaseColumns *columns, const time_t *timestamps,
+                    size_t count)
+{
+    long t;
+    double jd[PHASE_LANES], p[PHASE_LANES], aom[PHASE_LANES],
+           cphase[PHASE_LANES], cdist[PHASE_LANES], cangdia[PHASE_LANES],
+           csund[PHASE_LANES], csuang[PHASE_LANES];
+    size_t i, j, n;
+
+    for (i = 0; i < count; i += n) {
+        n = (count - i < PHASE_LANES) ? count - i : PHASE_LANES;
+
+        for (j = 0; j < n; j++) {
+            t = timestamps[i + j];
+
+            if (!unixtoj(t, &jd[j]))
+                return FALSE;
+        }
+        // Pad incomplete lane groups with the last date. Each lane is
+        // independent, so this doesn't affect the results.
+        for (; j < PHASE_LANES; j++)
+            jd[j] = jd[n - 1];
+
+        phase_lanes(jd, p, cphase, aom, cdist, cangdia, csund, csuang);
+
+        for (j = 0; j < n; j++) {
+            if (columns->julian_date != NULL)
+                columns->julian_date[i + j] = jd[j];
+            if (columns->age != NULL)
+                columns->age[i + j] = aom[j];
+            if (columns->fraction_of_lunation != NULL)
+                columns->fraction_of_lunation[i + j] = p[j];
+            if (columns->phase != NULL)
+                columns->phase[i + j] = fraction_of_lunation_to_phase(p[j]);
+            if (columns->fraction_illuminated != NULL)
+                columns->fraction_illuminated[i + j] = cphase[j];
+            if (columns->distance_to_earth_km != NULL)
+                columns->distance_to_earth_km[i + j] = cdist[j];
+            if (columns->subtends != NULL)
+                columns->subtends[i + j] = cangdia[j];
+            if (columns->sun_distance_to_earth_km != NULL)
+                columns->sun_distance_to_earth_km[i + j] = csund[j];
+            if (columns->sun_subtends != NULL)
+                columns->sun_subtends[i + j] = csuang[j];
+        }
+    }
+
+    return TRUE;
+}
+
+int moonphase_batch_float(const MoonPhaseColumnsFloat *columns,
+                          const time_t *timestamps, size_t count)
+{
+    long t;
+    double jd[PHASE_LANES_FLOAT];
+    float p[PHASE_LANES_FLOAT], aom[PHASE_LANES_FLOAT],
+          cphase[PHASE_LANES_FLOAT], cdist[PHASE_LANES_FLOAT],
+          cangdia[PHASE_LANES_FLOAT], csund[PHASE_LANES_FLOAT],
+          csuang[PHASE_LANES_FLOAT];
+    size_t i, j, n;
+
+    for (i = 0; i < count; i += n) {
+        n = (count - i < PHASE_LANES_FLOAT) ? count - i : PHASE_LANES_FLOAT;
+
+        for (j = 0; j < n; j++) {
+            t = timestamps[i + j];
+
+            if (!unixtoj(t, &jd[j]))
+                return FALSE;
+        }
+        for (; j < PHASE_LANES_FLOAT; j++)
+            jd[j] = jd[n - 1];
+
+        phase_lanes_float(jd, p, cphase, aom, cdist, cangdia, csund, csuang);
+
+        for (j = 0; j < n; j++) {
+            if (columns->julian_date != NULL)
+                columns->julian_date[i + j] = jd[j];
+            if (columns->age != NULL)
+                columns->age[i + j] = aom[j];
+            if (columns->fraction_of_lunation != NULL)
+                columns->fraction_of_lunation[i + j] = p[j];
+            if (columns->phase != NULL)
+                columns->phase[i + j] = fraction_of_lunation_to_phase(p[j]);
+            if (columns->fraction_illuminated != NULL)
+                columns->fraction_illuminated[i + j] = cphase[j];
+            if (columns->distance_to_earth_km != NULL)
+                columns->distance_to_earth_km[i + j] = cdist[j];
+            if (columns->subtends != NULL)
+                columns->subtends[i + j] = cangdia[j];
+            if (columns->sun_distance_to_earth_km != NULL)
+                columns->sun_distance_to_earth_km[i + j] = csund[j];
+            if (columns->sun_subtends != NULL)
+                columns->sun_subtends[i + j] = csuang[j];
+        }
+    }
+
+    return TRUE;
+}
+
 static int init_moonphase(MoonPhase *mphase)
 {
     return moonphase(mphase, NULL);
@@ -217,6 +398,307 @@ static int init_moonphase(MoonPhase *mphase)
 
 #define EPL(x) (x), (x) == 1 ? "" : "s"
 
+/*  Text formatting.  Reports are written piecewise into a caller-owned
+    buffer,  with writers for the few conversions they use, instead of
+    sprintf().  Writers never write past the end of the buffer,  but keep
+    counting, like snprintf(),  so the full length is always known.  */
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t pos;                       /* Length of the full output so far */
+} FmtBuf;
+
+static void fmt_char(FmtBuf *f, char c)
+{
+    if (f->pos + 1 < f->len)
+        f->buf[f->pos] = c;
+    f->pos++;
+}
+
+static void fmt_str(FmtBuf *f, const char *s)
+{
+    while (*s != '\0')
+        fmt_char(f, *s++);
+}
+
+/*  FMT_STR_LEFT  --  Same as "%-*s".  */
+
+static void fmt_str_left(FmtBuf *f, const char *s, int width)
+{
+    int n = (int) strlen(s);
+
+    fmt_str(f, s);
+    for (; n < width; n++)
+        fmt_char(f, ' ');
+}
+
+/*  FMT_LONG  --  Same as "%*ld" (pad ' ') or "%0*ld" (pad '0').  */
+
+static void fmt_long(FmtBuf *f, long v, int width, char pad)
+{
+    char digits[24];
+    unsigned long u = (v < 0) ? 0UL - (unsigned long) v : (unsigned long) v;
+    int n = 0, size;
+
+    do {
+        digits[n++] = (char) ('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+
+    size = n + (v < 0);
+    if (pad == ' ')
+        for (; size < width; size++)
+            fmt_char(f, ' ');
+    if (v < 0)
+        fmt_char(f, '-');
+    for (; size < width; size++)
+        fmt_char(f, '0');
+    while (n > 0)
+        fmt_char(f, digits[--n]);
+}
+
+/*  FMT_FIXED  --  Same as "%.*f", for 0 to 9 decimals.
+
+    x * 10^prec is computed exactly,  as the sum of its rounded value and
+    the rounding error (Dekker's product;  all partial products are exact,
+    so FMA contraction doesn't change anything).  The exact value is then
+    rounded to the nearest integer,  ties to even,  like printf() does.
+    Values too large for this, and non-finite values,  go to snprintf().  */
+
+static void fmt_fixed(FmtBuf *f, double x, int prec)
+{
+    static const unsigned long scales[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+        1000000000
+    };
+    double a = abs(x), scale = (double) scales[prec], p, c, ah, al, e, d;
+    uint64_t r, ip;
+    char digits[24];
+    int n;
+
+    p = a * scale;
+    if (!(p < 4503599627370496.0)) {  /* 2^52, and not NaN */
+        char tmp[352];
+        snprintf(tmp, sizeof tmp, "%.*f", prec, x);
+        fmt_str(f, tmp);
+        return;
+    }
+
+    c = 134217729.0 * a;              /* Split a into 26-bit halves */
+    ah = c - (c - a);
+    al = a - ah;
+    e = (ah * scale - p) + al * scale;
+
+    r = (uint64_t) p;
+    d = p - (double) r;               /* Exact */
+    if (d > 0.5 || (d == 0.5 && (e > 0 || (e == 0 && (r & 1)))))
+        r++;
+
+    if (signbit(x))
+        fmt_char(f, '-');
+
+    ip = r / scales[prec];
+    n = 0;
+    do {
+        digits[n++] = (char) ('0' + ip % 10);
+        ip /= 10;
+    } while (ip != 0);
+    while (n > 0)
+        fmt_char(f, digits[--n]);
+
+    if (prec == 0)
+        return;
+    fmt_char(f, '.');
+    r %= scales[prec];
+    for (n = prec; n > 0; n--) {
+        digits[n - 1] = (char) ('0' + r % 10);
+        r /= 10;
+    }
+    for (n = 0; n < prec; n++)
+        fmt_char(f, digits[n]);
+}
+
+/*  FMT_DOUBLE  --  Same as "%.17g", which is enough digits for any double
+                   to read back as itself.
+
+    Like FMT_FIXED,  but the scale is chosen to get 17 significant digits,
+    and the value being too large for an integer, it is split with Dekker
+    too.  Values outside [1e-4, 1e16),  where "%g" may switch to exponent
+    notation,  go to snprintf().  */
+
+static void fmt_double(FmtBuf *f, double x)
+{
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    double a = abs(x), scale, p, e, c, ah, al, sh, sl, rest;
+    uint64_t r;
+    long i;
+    int exp10, k, n, last;
+    char digits[24];
+
+    if (x == 0) {
+        fmt_str(f, signbit(x) ? "-0" : "0");
+        return;
+    }
+    if (!(a >= 1e-4 && a < 1e16)) {   /* Also NaN and infinities */
+        char tmp[32];
+        snprintf(tmp, sizeof tmp, "%.17g", x);
+        fmt_str(f, tmp);
+        return;
+    }
+
+    /* Estimate the decimal exponent,  then fix it so that the exact
+       a * 10^k is in [1e16, 1e17). */
+
+    exp10 = (int) floor(log10(a));
+    for (;;) {
+        k = 16 - exp10;
+        scale = pow10[k];
+        p = a * scale;
+        c = 134217729.0 * a;
+        ah = c - (c - a);
+        al = a - ah;
+        c = 134217729.0 * scale;
+        sh = c - (c - scale);
+        sl = scale - sh;
+        e = ((ah * sh - p) + ah * sl + al * sh) + al * sl;
+        if (p < 1e16 || (p == 1e16 && e < 0))
+            exp10--;
+        else if (p > 1e17 || (p == 1e17 && e >= 0))
+            exp10++;
+        else
+            break;
+    }
+
+    /* p is an integer (>= 2^53),  and |e| <= 8: round p + e to the
+       nearest integer,  ties to even.  Truncating e,  and subtracting,
+       are both exact here. */
+
+    i = (long) e;
+    rest = e - (double) i;
+    r = (uint64_t) ((int64_t) p + i);
+    if (rest > 0.5 || (rest == 0.5 && (r & 1)))
+        r++;
+    else if (rest < -0.5 || (rest == -0.5 && (r & 1)))
+        r--;
+    if (r == 100000000000000000ULL) {
+        r /= 10;
+        exp10++;
+    }
+
+    for (n = 16; n >= 0; n--) {
+        digits[n] = (char) ('0' + r % 10);
+        r /= 10;
+    }
+    for (last = 16; last > 0 && last > exp10 && digits[last] == '0'; last--)
+        ;
+
+    if (signbit(x))
+        fmt_char(f, '-');
+    if (exp10 < 0) {
+        fmt_str(f, "0.");
+        for (n = -1; n > exp10; n--)
+            fmt_char(f, '0');
+        for (n = 0; n <= last; n++)
+            fmt_char(f, digits[n]);
+    } else {
+        for (n = 0; n <= last; n++) {
+            fmt_char(f, digits[n]);
+            if (n == exp10 && n < last)
+                fmt_char(f, '.');
+        }
+    }
+}
+
+/*  FMT_END  --  Terminate the output, and return its full length.  */
+
+static size_t fmt_end(FmtBuf *f)
+{
+    if (f->len > 0)
+        f->buf[(f->pos < f->len) ? f->pos : f->len - 1] = '\0';
+    return f->pos;
+}
+
+/*  FMT_TM  --  Same as "%-9s %2d:%02d:%02d %2d %-5s %d".  */
+
+static void fmt_tm(FmtBuf *f, const struct tm *gm)
+{
+    fmt_str_left(f, dayname[gm->tm_wday], 9);
+    fmt_char(f, ' ');
+    fmt_long(f, gm->tm_hour, 2, ' ');
+    fmt_char(f, ':');
+    fmt_long(f, gm->tm_min, 2, '0');
+    fmt_char(f, ':');
+    fmt_long(f, gm->tm_sec, 2, '0');
+    fmt_char(f, ' ');
+    fmt_long(f, gm->tm_mday, 2, ' ');
+    fmt_char(f, ' ');
+    fmt_str_left(f, moname[gm->tm_mon], 5);
+    fmt_char(f, ' ');
+    fmt_long(f, gm->tm_year + 1900L, 0, ' ');
+}
+
+/*  FMT_PHASE_TM  --  Same as "%-9s %2d:%02d UTC %2d %-5s %d".  */
+
+static void fmt_phase_tm(FmtBuf *f, const struct tm *gm)
+{
+    fmt_str_left(f, dayname[gm->tm_wday], 9);
+    fmt_char(f, ' ');
+    fmt_long(f, gm->tm_hour, 2, ' ');
+    fmt_char(f, ':');
+    fmt_long(f, gm->tm_min, 2, '0');
+    fmt_str(f, " UTC ");
+    fmt_long(f, gm->tm_mday, 2, ' ');
+    fmt_char(f, ' ');
+    fmt_str_left(f, moname[gm->tm_mon], 5);
+    fmt_char(f, ' ');
+    fmt_long(f, gm->tm_year + 1900L, 0, ' ');
+}
+
+/*  FMT_ISO_TM  --  Same as "%04d-%02d-%02dT%02d:%02d:%02dZ".  */
+
+static void fmt_iso_tm(FmtBuf *f, const struct tm *gm)
+{
+    fmt_long(f, gm->tm_year + 1900L, 4, '0');
+    fmt_char(f, '-');
+    fmt_long(f, gm->tm_mon + 1, 2, '0');
+    fmt_char(f, '-');
+    fmt_long(f, gm->tm_mday, 2, '0');
+    fmt_char(f, 'T');
+    fmt_long(f, gm->tm_hour, 2, '0');
+    fmt_char(f, ':');
+    fmt_long(f, gm->tm_min, 2, '0');
+    fmt_char(f, ':');
+    fmt_long(f, gm->tm_sec, 2, '0');
+    fmt_char(f, 'Z');
+}
+
+/*  FMT_JSON_KEY  --  Write "key": (after a comma, unless first).  */
+
+static void fmt_json_key(FmtBuf *f, const char *key, int first)
+{
+    fmt_str(f, first ? "\"" : ",\"");
+    fmt_str(f, key);
+    fmt_str(f, "\":");
+}
+
+static void fmt_json_double(FmtBuf *f, const char *key, double x)
+{
+    fmt_json_key(f, key, FALSE);
+    fmt_double(f, x);
+}
+
+static void fmt_json_tm(FmtBuf *f, const char *key, const struct tm *gm)
+{
+    fmt_json_key(f, key, FALSE);
+    fmt_char(f, '"');
+    fmt_iso_tm(f, gm);
+    fmt_char(f, '"');
+}
+
 void print_moonphase(const MoonPhase *mphase)
 {
     char buf[1000];
@@ -234,9 +716,14 @@ static void moonphase_to_strbuf(const MoonPhase *mphase, char *buf)
         }
     }
 
+    moonphase_format(buf, 1000, mphase);
+}
+
+size_t moonphase_format(char *buf, size_t len, const MoonPhase *mphase)
+{
+    FmtBuf f = {buf, len, 0};
     double aom;
     int aom_d, aom_h, aom_m;
-    unsigned int offset = 0;
 
     aom = mphase->age;
     aom_d = (int) aom;
@@ -244,81 +731,131 @@ static void moonphase_to_strbuf(const MoonPhase *mphase, char *buf)
     aom_m = (int) (1440 * (aom - floor(aom))) % 60;
 
     const struct tm *gm = &mphase->utc_datetime;
+    struct tm local;
 
-    offset += sprintf(buf + offset, "Phase\n=====\n\n");
-    offset += sprintf(
-        buf + offset,
-        "Julian date:\t\t%.5f   (0h variant: %.5f)\n",
-        mphase->julian_date,
-        mphase->julian_date + 0.5
-    );
-    offset += sprintf(
-        buf + offset,
-        "Universal time:\t\t%-9s %2d:%02d:%02d %2d %-5s %d\n",
-        dayname[gm->tm_wday],
-        gm->tm_hour,
-        gm->tm_min,
-        gm->tm_sec,
-        gm->tm_mday,
-        moname[gm->tm_mon],
-        gm->tm_year + 1900
-    );
-    gm = localtime(&mphase->timestamp);
-    offset += sprintf(
-        buf + offset,
-        "Local time:\t\t%-9s %2d:%02d:%02d %2d %-5s %d\n\n",
-        dayname[gm->tm_wday],
-        gm->tm_hour,
-        gm->tm_min,
-        gm->tm_sec,
-        gm->tm_mday,
-        moname[gm->tm_mon],
-        gm->tm_year + 1900
-    );
+    fmt_str(&f, "Phase\n=====\n\n");
 
-    offset += sprintf(
-        buf + offset,
-        "Age of moon:\t\t%d day%s, %d hour%s, %d minute%s.\n",
-        EPL(aom_d),
-        EPL(aom_h),
-        EPL(aom_m)
-    );
-    offset += sprintf(
-        buf + offset,
-        "Lunation:\t\t%.2f%%   (%s %s)\n",
-        mphase->fraction_of_lunation * 100,
-        mphase->phase_icon,
-        mphase->phase_name
-    );
-    offset += sprintf(
-        buf + offset,
-        "Moon phase:\t\t%.2f%%   (0%% = New, 100%% = Full)\n\n",
-        mphase->fraction_illuminated * 100
-    );
+    fmt_str(&f, "Julian date:\t\t");
+    fmt_fixed(&f, mphase->julian_date, 5);
+    fmt_str(&f, "   (0h variant: ");
+    fmt_fixed(&f, mphase->julian_date + 0.5, 5);
+    fmt_str(&f, ")\n");
 
-    offset += sprintf(
-        buf + offset,
-        "Moon's distance:\t%ld kilometres, %.1f Earth radii.\n",
-        (long) mphase->distance_to_earth_km,
-        mphase->distance_to_earth_earth_radii
-    );
-    offset += sprintf(
-        buf + offset,
-        "Moon subtends:\t\t%.4f degrees.\n\n",
-        mphase->subtends
-    );
+    fmt_str(&f, "Universal time:\t\t");
+    fmt_tm(&f, gm);
+    fmt_str(&f, "\n");
 
-    offset += sprintf(
-        buf + offset,
-        "Sun's distance:\t\t%ld kilometres, %.3f astronomical units.\n",
-        (long) mphase->sun_distance_to_earth_km,
-        mphase->sun_distance_to_earth_astronomical_units
-    );
-    offset += sprintf(
-        buf + offset,
-        "Sun subtends:\t\t%.4f degrees.",
-        mphase->sun_subtends
-    );
+    gm = localtime_r(&mphase->timestamp, &local);
+    fmt_str(&f, "Local time:\t\t");
+    if (gm != NULL)
+        fmt_tm(&f, gm);
+    else
+        fmt_str(&f, "unknown");     /* Year out of range of struct tm */
+    fmt_str(&f, "\n\n");
+
+    fmt_str(&f, "Age of moon:\t\t");
+    fmt_long(&f, aom_d, 0, ' ');
+    fmt_str(&f, aom_d == 1 ? " day, " : " days, ");
+    fmt_long(&f, aom_h, 0, ' ');
+    fmt_str(&f, aom_h == 1 ? " hour, " : " hours, ");
+    fmt_long(&f, aom_m, 0, ' ');
+    fmt_str(&f, aom_m == 1 ? " minute.\n" : " minutes.\n");
+
+    fmt_str(&f, "Lunation:\t\t");
+    fmt_fixed(&f, mphase->fraction_of_lunation * 100, 2);
+    fmt_str(&f, "%   (");
+    fmt_str(&f, mphase->phase_icon);
+    fmt_str(&f, " ");
+    fmt_str(&f, mphase->phase_name);
+    fmt_str(&f, ")\n");
+
+    fmt_str(&f, "Moon phase:\t\t");
+    fmt_fixed(&f, mphase->fraction_illuminated * 100, 2);
+    fmt_str(&f, "%   (0% = New, 100% = Full)\n\n");
+
+    fmt_str(&f, "Moon's distance:\t");
+    fmt_long(&f, (long) mphase->distance_to_earth_km, 0, ' ');
+    fmt_str(&f, " kilometres, ");
+    fmt_fixed(&f, mphase->distance_to_earth_earth_radii, 1);
+    fmt_str(&f, " Earth radii.\n");
+
+    fmt_str(&f, "Moon subtends:\t\t");
+    fmt_fixed(&f, mphase->subtends, 4);
+    fmt_str(&f, " degrees.\n\n");
+
+    fmt_str(&f, "Sun's distance:\t\t");
+    fmt_long(&f, (long) mphase->sun_distance_to_earth_km, 0, ' ');
+    fmt_str(&f, " kilometres, ");
+    fmt_fixed(&f, mphase->sun_distance_to_earth_astronomical_units, 3);
+    fmt_str(&f, " astronomical units.\n");
+
+    fmt_str(&f, "Sun subtends:\t\t");
+    fmt_fixed(&f, mphase->sun_subtends, 4);
+    fmt_str(&f, " degrees.");
+
+    return fmt_end(&f);
+}
+
+size_t moonphase_to_json(char *buf, size_t len, const MoonPhase *mphase)
+{
+    FmtBuf f = {buf, len, 0};
+
+    fmt_char(&f, '{');
+    fmt_json_key(&f, "julian_date", TRUE);
+    fmt_double(&f, mphase->julian_date);
+    fmt_json_key(&f, "timestamp", FALSE);
+    fmt_long(&f, (long) mphase->timestamp, 0, ' ');
+    fmt_json_tm(&f, "utc_datetime", &mphase->utc_datetime);
+    fmt_json_double(&f, "age", mphase->age);
+    fmt_json_double(&f, "fraction_of_lunation", mphase->fraction_of_lunation);
+    fmt_json_key(&f, "phase", FALSE);
+    fmt_str(&f, "{\"index\":");
+    fmt_long(&f, mphase->phase, 0, ' ');
+    fmt_str(&f, ",\"name\":\"");
+    fmt_str(&f, mphase->phase_name);
+    fmt_str(&f, "\",\"icon\":\"");
+    fmt_str(&f, mphase->phase_icon);
+    fmt_str(&f, "\"}");
+    fmt_json_double(&f, "fraction_illuminated", mphase->fraction_illuminated);
+    fmt_json_double(&f, "distance_to_earth_km", mphase->distance_to_earth_km);
+    fmt_json_double(&f, "distance_to_earth_earth_radii",
+                    mphase->distance_to_earth_earth_radii);
+    fmt_json_double(&f, "subtends", mphase->subtends);
+    fmt_json_double(&f, "sun_distance_to_earth_km",
+                    mphase->sun_distance_to_earth_km);
+    fmt_json_double(&f, "sun_distance_to_earth_astronomical_units",
+                    mphase->sun_distance_to_earth_astronomical_units);
+    fmt_json_double(&f, "sun_subtends", mphase->sun_subtends);
+    fmt_char(&f, '}');
+
+    return fmt_end(&f);
+}
+
+size_t moonphase_to_csv(char *buf, size_t len, const MoonPhase *mphase)
+{
+    FmtBuf f = {buf, len, 0};
+
+    fmt_long(&f, (long) mphase->timestamp, 0, ' ');
+    fmt_char(&f, ',');
+    fmt_double(&f, mphase->julian_date);
+    fmt_char(&f, ',');
+    fmt_double(&f, mphase->age);
+    fmt_char(&f, ',');
+    fmt_double(&f, mphase->fraction_of_lunation);
+    fmt_char(&f, ',');
+    fmt_long(&f, mphase->phase, 0, ' ');
+    fmt_char(&f, ',');
+    fmt_double(&f, mphase->fraction_illuminated);
+    fmt_char(&f, ',');
+    fmt_double(&f, mphase->distance_to_earth_km);
+    fmt_char(&f, ',');
+    fmt_double(&f, mphase->subtends);
+    fmt_char(&f, ',');
+    fmt_double(&f, mphase->sun_distance_to_earth_km);
+    fmt_char(&f, ',');
+    fmt_double(&f, mphase->sun_subtends);
+
+    return fmt_end(&f);
 }
 
 void print_moonphase_debug(const MoonPhase* mphase)
@@ -365,25 +902,27 @@ int mooncal(MoonCalendar *mcal, const time_t *timestamp)
     long t;
     double jd;
     double phasar[5];
-    struct tm *gm;
+    struct tm gm;
 
     if (timestamp != NULL)
         t = *timestamp;
     else
         t = time(NULL);
 
-    gm = gmtime(&t);
-    if (gm == NULL)
+    if (gmtime_r(&t, &gm) == NULL)
         return FALSE;
 
-    jd = jtime(gm);
+    if (!unixtoj(t, &jd))
+        return FALSE;
 
-    phasehunt(jd + 0.5, phasar);
-    lunation = (long) floor(((phasar[0] + 7) - lunatbase) / synmonth) + 1;
+    if (!lunation_table_lookup(jd + 0.5, phasar, &lunation)) {
+        phasehunt(jd + 0.5, phasar);
+        lunation = brown_lunation(phasar[0]);
+    }
 
     mcal->julian_date = jd;
     mcal->timestamp = (time_t) t;
-    tmcpy(&mcal->utc_datetime, gm);
+    mcal->utc_datetime = gm;
 
     mcal->lunation = lunation;
 
@@ -405,6 +944,52 @@ int mooncal(MoonCalendar *mcal, const time_t *timestamp)
     return TRUE;
 }
 
+/*  MOONCAL_YEAR  --  Phases of the Moon in a calendar year.  Lunations
+                      are enumerated by their index k directly,  from the
+                      one in progress at the start of the year,  instead
+                      of being searched for from dates.  */
+
+int mooncal_year(MoonPhaseEvent *events, size_t capacity, long year,
+                 size_t *count)
+{
+    MoonPhaseEvent found[MOON_YEAR_MAX_EVENTS];
+    double start, end, k, phases[5];
+    long lunation;
+    size_t n = 0;
+    int i;
+
+    start = ucttoj(year, 0, 1, 0, 0, 0);
+    end = ucttoj(year + 1, 0, 1, 0, 0, 0);
+
+    /* lunation_k() goes by mean new moons;  the true one may be up to a
+       day later,  so start one lunation earlier. */
+
+    for (k = lunation_k(start) - 1; ; k++) {
+        if (!lunation_table_phases(k, phases, &lunation)) {
+            truephases(k, phases);
+            lunation = brown_lunation(phases[0]);
+        }
+        if (phases[0] >= end)
+            break;
+
+        for (i = 0; i < 4; i++) {
+            if (phases[i] < start || phases[i] >= end)
+                continue;
+            found[n].date = phases[i];
+            jtouct(phases[i], &found[n].date_utc);
+            found[n].phase = i;
+            found[n].lunation = lunation;
+            n++;
+        }
+    }
+
+    *count = n;
+    if (n > capacity)
+        return FALSE;
+    memcpy(events, found, n * sizeof found[0]);
+    return TRUE;
+}
+
 static int init_mooncal(MoonCalendar *mcal)
 {
     return mooncal(mcal, NULL);
@@ -426,30 +1011,66 @@ static void mooncal_to_strbuf(const MoonCalendar *mcal, char *buf)
         }
     }
 
-    char tbuf[80];
-    unsigned int offset = 0;
+    mooncal_format(buf, 500, mcal);
+}
+
+size_t mooncal_format(char *buf, size_t len, const MoonCalendar *mcal)
+{
+    FmtBuf f = {buf, len, 0};
 
-    offset += sprintf(buf + offset, "Moon Calendar\n=============\n\n");
-    fmt_phase_time(&mcal->last_new_moon_utc, tbuf);
-    offset += sprintf(
-        buf + offset,
-        "Last new moon:\t\t%s\tLunation: %ld\n",
-        tbuf,
-        mcal->lunation
-    );
-    fmt_phase_time(&mcal->first_quarter_utc, tbuf);
-    offset += sprintf(buf + offset, "First quarter:\t\t%s\n", tbuf);
-    fmt_phase_time(&mcal->full_moon_utc, tbuf);
-    offset += sprintf(buf + offset, "Full moon:\t\t%s\n", tbuf);
-    fmt_phase_time(&mcal->last_quarter_utc, tbuf);
-    offset += sprintf(buf + offset, "Last quarter:\t\t%s\n", tbuf);
-    fmt_phase_time(&mcal->next_new_moon_utc, tbuf);
-    offset += sprintf(
-        buf + offset,
-        "Next new moon:\t\t%s\tLunation: %ld",
-        tbuf,
-        mcal->lunation + 1
-    );
+    fmt_str(&f, "Moon Calendar\n=============\n\n");
+
+    fmt_str(&f, "Last new moon:\t\t");
+    fmt_phase_tm(&f, &mcal->last_new_moon_utc);
+    fmt_str(&f, "\tLunation: ");
+    fmt_long(&f, mcal->lunation, 0, ' ');
+    fmt_str(&f, "\n");
+
+    fmt_str(&f, "First quarter:\t\t");
+    fmt_phase_tm(&f, &mcal->first_quarter_utc);
+    fmt_str(&f, "\n");
+
+    fmt_str(&f, "Full moon:\t\t");
+    fmt_phase_tm(&f, &mcal->full_moon_utc);
+    fmt_str(&f, "\n");
+
+    fmt_str(&f, "Last quarter:\t\t");
+    fmt_phase_tm(&f, &mcal->last_quarter_utc);
+    fmt_str(&f, "\n");
+
+    fmt_str(&f, "Next new moon:\t\t");
+    fmt_phase_tm(&f, &mcal->next_new_moon_utc);
+    fmt_str(&f, "\tLunation: ");
+    fmt_long(&f, mcal->lunation + 1, 0, ' ');
+
+    return fmt_end(&f);
+}
+
+size_t mooncal_to_json(char *buf, size_t len, const MoonCalendar *mcal)
+{
+    FmtBuf f = {buf, len, 0};
+
+    fmt_char(&f, '{');
+    fmt_json_key(&f, "julian_date", TRUE);
+    fmt_double(&f, mcal->julian_date);
+    fmt_json_key(&f, "timestamp", FALSE);
+    fmt_long(&f, (long) mcal->timestamp, 0, ' ');
+    fmt_json_tm(&f, "utc_datetime", &mcal->utc_datetime);
+    fmt_json_key(&f, "lunation", FALSE);
+    fmt_long(&f, mcal->lunation, 0, ' ');
+    fmt_json_double(&f, "last_new_moon", mcal->last_new_moon);
+    fmt_json_tm(&f, "last_new_moon_utc", &mcal->last_new_moon_utc);
+    fmt_json_double(&f, "first_quarter", mcal->first_quarter);
+    fmt_json_tm(&f, "first_quarter_utc", &mcal->first_quarter_utc);
+    fmt_json_double(&f, "full_moon", mcal->full_moon);
+    fmt_json_tm(&f, "full_moon_utc", &mcal->full_moon_utc);
+    fmt_json_double(&f, "last_quarter", mcal->last_quarter);
+    fmt_json_tm(&f, "last_quarter_utc", &mcal->last_quarter_utc);
+    fmt_json_double(&f, "next_new_moon", mcal->next_new_moon);
+    fmt_json_tm(&f, "next_new_moon_utc", &mcal->next_new_moon_utc);
+    fmt_char(&f, '}');
+
+    return fmt_end(&f);
 }
 
 void print_mooncal_debug(const MoonCalendar* mcal)
@@ -506,9 +1127,10 @@ void print_mooncal_debug(const MoonCalendar* mcal)
 
 static void fmt_phase_time(const struct tm *gm, char *buf)
 {
-    sprintf(buf, "%-9s %2d:%02d UTC %2d %-5s %d",
-    dayname [gm->tm_wday], gm->tm_hour, gm->tm_min,
-    gm->tm_mday, moname [gm->tm_mon], gm->tm_year + 1900);
+    FmtBuf f = {buf, 80, 0};
+
+    fmt_phase_tm(&f, gm);
+    fmt_end(&f);
 }
 
 /*  JTIME  --  Convert a Unix date and time (tm) structure to astronomical
@@ -520,6 +1142,46 @@ static double jtime(struct tm *t)
     return ucttoj(t->tm_year + 1900, t->tm_mon, t->tm_mday, t->tm_hour, t->tm_min, t->tm_sec);
 }
 
+/*  UNIXTOJ  --  Convert a Unix time (seconds since 1970 January 1.0
+                 UTC) to astronomical Julian time, without going through
+                 a tm structure.
+
+                 Unix time is a linear count of days and seconds, so for
+                 Gregorian dates this is exactly what jtime() computes,
+                 down to the last bit: both add the same day fraction to
+                 the same half-integer day.  ucttoj() reads dates before
+                 the calendar reform as Julian calendar dates, whereas
+                 gmtime() returns proleptic Gregorian dates, so these
+                 (and dates past year 9999) still take the long way to
+                 remain identical.  */
+
+#define UNIX_EPOCH_JD       2440588L         /* JDN of 1970 January 1 */
+#define UNIX_GREGORIAN_MIN  (-12219292800LL) /* 1582 October 15 0h UTC */
+#define UNIX_GREGORIAN_MAX  253402300800LL   /* 10000 January 1 0h UTC */
+
+static int unixtoj(long t, double *jd)
+{
+    long days, sod;
+    struct tm gm;
+
+    if (t < UNIX_GREGORIAN_MIN || t >= UNIX_GREGORIAN_MAX) {
+        if (gmtime_r(&t, &gm) == NULL)
+            return FALSE;
+        *jd = jtime(&gm);
+        return TRUE;
+    }
+
+    days = t / 86400;
+    sod = t % 86400;
+    if (sod < 0) {                    /* Round towards minus infinity */
+        sod += 86400;
+        days--;
+    }
+
+    *jd = ((days + UNIX_EPOCH_JD) - 0.5) + (sod / 86400.0);
+    return TRUE;
+}
+
 /*  UCTTOJ  --  Convert GMT date and time to astronomical
                 Julian time (i.e. Julian date plus day fraction,
                 expressed as a double).  */
@@ -564,77 +1226,82 @@ static double ucttoj(long year, int mon, int mday,
             ((sec + 60L * (min + 60L * hour)) / 86400.0);
 }
 
-/*  JTOUCT  --  Convert astronomical Julian time (i.e. Julian date
-                plus day fraction, expressed as a double) to GMT
-                date and time.  */
+/*  FLOORDIV  --  Integer division of a by b > 0,  rounding towards minus
+                  infinity,  and the matching (positive) remainder.  */
 
-static void jtouct(double utime, struct tm *gm)
+static inline int64_t floordiv(int64_t a, int64_t b)
 {
-    long yy;
-    int mm, dd, wday, hh, mmm, ss;
-
-    jyear(utime, &yy, &mm, &dd);
-    jhms(utime, &hh, &mmm, &ss);
-    wday = jwday(utime);
-
-    memset(gm, 0, sizeof(struct tm));
-    gm->tm_isdst = 0;  // Explicitly UTC.
+    return (a - ((a < 0) ? b - 1 : 0)) / b;
+}
 
-    gm->tm_year = yy - 1900;
-    gm->tm_mon = mm - 1;
-    gm->tm_mday = dd;
-    gm->tm_wday = wday;
-    gm->tm_hour = hh;
-    gm->tm_min = mmm;
-    gm->tm_sec = ss;
+static inline int64_t floordiv_mod(int64_t a, int64_t b)
+{
+    return a - floordiv(a, b) * b;
 }
 
-/*  JYEAR  --  Convert    Julian    date  to  year,  month, day, which are
-               returned via integer pointers to integers (note that year is a long).  */
+/*  JCIVIL  --  Convert a civil day number (floor of the Julian date plus
+                one half) to year, month, day.  Dates before October 15,
+                1582 are in the Julian calendar.
 
-static void jyear(double td, long *yy, int *mm, int *dd)
-{
-    double z, f, a, alpha, b, c, d, e;
+                Same algorithm as the original JYEAR (Meeus,  chapter 7),
+                with its decimal constants turned into fractions:  the
+                quotients are never close enough to an integer without
+                being one for the floating-point floors to differ.  */
 
-    td += 0.5;
-    z = floor(td);
-    f = td - z;
+static KERNEL_INLINE void jcivil(int64_t z, long *yy, int *mm, int *dd)
+{
+    int64_t alpha, a, b, c, d, e;
 
-    if (z < 2299161.0) {
-        a = z;
-    } else {
-        alpha = floor((z - 1867216.25) / 36524.25);
-        a = z + 1 + alpha - floor(alpha / 4);
-    }
+    /* (z - 1867216.25) / 36524.25 */
+    alpha = floordiv(4 * z - 7468865, 146097);
+    a = (z < 2299161) ? z : z + 1 + alpha - floordiv(alpha, 4);
 
     b = a + 1524;
-    c = floor((b - 122.1) / 365.25);
-    d = floor(365.25 * c);
-    e = floor((b - d) / 30.6001);
+    c = floordiv(20 * b - 2442, 7305);          /* (b - 122.1) / 365.25 */
+    d = floordiv(1461 * c, 4);                  /* 365.25 c */
+    e = floordiv(10000 * (b - d), 306001);      /* (b - d) / 30.6001 */
 
-    *dd = (int) (b - d - floor(30.6001 * e) + f);
+    *dd = (int) (b - d - floordiv(306001 * e, 10000));
     *mm = (int) ((e < 14) ? (e - 1) : (e - 13));
     *yy = (long) ((*mm > 2) ? (c - 4716) : (c - 4715));
 }
 
-/*  JHMS  --  Convert Julian time to hour, minutes, and seconds.  */
+/*  JTOUCT_IMPL  --  Convert astronomical Julian time (i.e. Julian date
+                     plus day fraction, expressed as a double) to GMT
+                     date and time.  Called through jtouct().
+
+                     The date is split into a day number and a second
+                     of the day once,  then all fields are computed in
+                     integer arithmetic.  The results are the same as
+                     those of the original JYEAR,  JHMS and JWDAY
+                     (including an hour of 24 when the time rounds up to
+                     midnight),  except that the day of the week stays
+                     positive before -4712.  */
 
-static void jhms(double j, int *h, int *m, int *s)
+static KERNEL_INLINE void jtouct_impl(double utime, struct tm *gm)
 {
-    long ij;
+    double j, z;
+    int64_t day;
+    long yy, sec;
+    int mm, dd;
 
-    j += 0.5;                 /* Astronomical to civil */
-    ij = (long) (((j - floor(j)) * 86400.0) + 0.5);  // Round to nearest second
-    *h = (int) (ij / 3600L);
-    *m = (int) ((ij / 60L) % 60L);
-    *s = (int) (ij % 60L);
-}
+    j = utime + 0.5;                  /* Astronomical to civil */
+    z = floor(j);
+    day = (int64_t) z;
+    sec = (long) (((j - z) * 86400.0) + 0.5);  /* Round to nearest second */
 
-/*  JWDAY  --  Determine day of the week for a given Julian day.  */
+    jcivil(day, &yy, &mm, &dd);
 
-static int jwday(double j)
-{
-    return ((int) (j + 1.5)) % 7;
+    memset(gm, 0, sizeof(struct tm));
+    gm->tm_isdst = 0;  // Explicitly UTC.
+
+    gm->tm_year = yy - 1900;
+    gm->tm_mon = mm - 1;
+    gm->tm_mday = dd;
+    gm->tm_wday = (int) floordiv_mod(day + 1, 7);
+    gm->tm_hour = (int) (sec / 3600L);
+    gm->tm_min = (int) ((sec / 60L) % 60L);
+    gm->tm_sec = (int) (sec % 60L);
 }
 
 /*  MEANPHASE  --  Calculates  time  of  the mean new Moon for a given
@@ -662,16 +1329,37 @@ static double meanphase(double sdate, double k)
     return nt1;
 }
 
-/*  TRUEPHASE  --  Given a K value used to determine the mean phase of
-                   the new moon, and a phase selector (0.0, 0.25, 0.5,
-                   0.75), obtain the true, corrected phase time.  */
+/*  Correction series of TRUEPHASE,  for new and full moons (row 0),
+    and for quarters (row 1).  Terms are,  in order:  sin M,  sin 2M,
+    sin M',  sin 2M',  sin 3M',  sin 2F,  sin(M + M'),  sin(M - M'),
+    sin(2F + M),  sin(2F - M),  sin(2F + M'),  sin(2F - M'),
+    sin(M + 2M'),  sin(M - 2M'),  and sin(2M + M'),  where M is the
+    Sun's mean anomaly,  M' the Moon's,  and F the Moon's argument of
+    latitude.  The first one is also multiplied by T.  */
+
+static const double truephase_coef[2][15] = {
+    { 0.1734, 0.0021, -0.4068, 0.0161, -0.0004, 0.0104, -0.0051, -0.0074,
+      0.0004, -0.0004, -0.0006, 0.0010, 0.0005, 0.0, 0.0 },
+    { 0.1721, 0.0021, -0.6280, 0.0089, -0.0004, 0.0079, -0.0119, -0.0047,
+      0.0003, -0.0004, -0.0006, 0.0021, 0.0003, 0.0004, -0.0003 }
+};
 
-static double truephase(double k, double phase)
+static const double truephase_tcoef[2] = { -0.000393, -0.0004 };
+
+/*  TRUEPHASE_KERNEL  --  True time of phase quarter (0 to 3) of the
+                          lunation,  given K plus the phase.  Rather than
+                          a sine per term,  only M,  M' and 2F get one
+                          (and a cosine):  the others follow from angle
+                          addition.  The quarter only selects
+                          coefficients,  without branching,  so calls
+                          with a constant one get a specialized series.  */
+
+static KERNEL_INLINE double truephase_kernel(double k, int quarter)
 {
-    double t, t2, t3, pt, m, mprime, f;
-    int apcor = FALSE;
+    const double *c = truephase_coef[quarter & 1];
+    double t, t2, t3, pt, m, mprime, f, sm, cm, smp, cmp, s2f, c2f,
+           s2m, c2m, s2mp, c2mp, qsign;
 
-    k += phase;                       /* Add phase to new moon time */
     t = k / 1236.85;                  /* Time in Julian centuries from
                                          1900 January 0.5 */
     t2 = t * t;                       /* Square for frequent use */
@@ -694,56 +1382,94 @@ static double truephase(double k, double phase)
         + 390.67050646 * k
         - 0.0016528 * t2
         - 0.00000239 * t3;
-    if ((phase < 0.01) || (abs(phase - 0.5) < 0.01)) {
-
-       /* Corrections for New and Full Moon */
-
-       pt +=     (0.1734 - 0.000393 * t) * dsin(m)
-                + 0.0021 * dsin(2 * m)
-                - 0.4068 * dsin(mprime)
-                + 0.0161 * dsin(2 * mprime)
-                - 0.0004 * dsin(3 * mprime)
-                + 0.0104 * dsin(2 * f)
-                - 0.0051 * dsin(m + mprime)
-                - 0.0074 * dsin(m - mprime)
-                + 0.0004 * dsin(2 * f + m)
-                - 0.0004 * dsin(2 * f - m)
-                - 0.0006 * dsin(2 * f + mprime)
-                + 0.0010 * dsin(2 * f - mprime)
-                + 0.0005 * dsin(m + 2 * mprime);
-       apcor = TRUE;
-    } else if ((abs(phase - 0.25) < 0.01 || (abs(phase - 0.75) < 0.01))) {
-       pt +=     (0.1721 - 0.0004 * t) * dsin(m)
-                + 0.0021 * dsin(2 * m)
-                - 0.6280 * dsin(mprime)
-                + 0.0089 * dsin(2 * mprime)
-                - 0.0004 * dsin(3 * mprime)
-                + 0.0079 * dsin(2 * f)
-                - 0.0119 * dsin(m + mprime)
-                - 0.0047 * dsin(m - mprime)
-                + 0.0003 * dsin(2 * f + m)
-                - 0.0004 * dsin(2 * f - m)
-                - 0.0006 * dsin(2 * f + mprime)
-                + 0.0021 * dsin(2 * f - mprime)
-                + 0.0003 * dsin(m + 2 * mprime)
-                + 0.0004 * dsin(m - 2 * mprime)
-                - 0.0003 * dsin(2 * m + mprime);
-       if (phase < 0.5)
-          /* First quarter correction */
-          pt += 0.0028 - 0.0004 * dcos(m) + 0.0003 * dcos(mprime);
-       else
-          /* Last quarter correction */
-          pt += -0.0028 + 0.0004 * dcos(m) - 0.0003 * dcos(mprime);
-       apcor = TRUE;
-    }
-    if (!apcor) {
-        fprintf(stderr,
-                "TRUEPHASE called with invalid phase selector.\n");
-        exit(EXIT_FAILURE);
-    }
+
+    /* Reduced in degrees first,  where it is exact. */
+
+    m = torad(fixangle(m));
+    mprime = torad(fixangle(mprime));
+    f = torad(fixangle(2 * f));
+    sm = sin(m);
+    cm = cos(m);
+    smp = sin(mprime);
+    cmp = cos(mprime);
+    s2f = sin(f);
+    c2f = cos(f);
+    s2m = 2 * sm * cm;
+    c2m = cm * cm - sm * sm;
+    s2mp = 2 * smp * cmp;
+    c2mp = cmp * cmp - smp * smp;
+
+    pt +=     (c[0] + truephase_tcoef[quarter & 1] * t) * sm
+            + c[1] * s2m
+            + c[2] * smp
+            + c[3] * s2mp
+            + c[4] * (s2mp * cmp + c2mp * smp)
+            + c[5] * s2f
+            + c[6] * (sm * cmp + cm * smp)
+            + c[7] * (sm * cmp - cm * smp)
+            + c[8] * (s2f * cm + c2f * sm)
+            + c[9] * (s2f * cm - c2f * sm)
+            + c[10] * (s2f * cmp + c2f * smp)
+            + c[11] * (s2f * cmp - c2f * smp)
+            + c[12] * (sm * c2mp + cm * s2mp)
+            + c[13] * (sm * c2mp - cm * s2mp)
+            + c[14] * (s2m * cmp + c2m * smp);
+
+    /* First (+) and last (-) quarter correction */
+    qsign = (double) (quarter == 1) - (double) (quarter == 3);
+    pt += qsign * (0.0028 - 0.0004 * cm + 0.0003 * cmp);
+
     return pt;
 }
 
+/*  TRUEPHASE  --  Given a K value used to determine the mean phase of
+                   the new moon, and a phase selector (0.0, 0.25, 0.5,
+                   0.75), obtain the true, corrected phase time.  The
+                   selector is rounded to the nearest quarter.  */
+
+static double truephase(double k, double phase)
+{
+    return truephase_kernel(k + phase, (int) floor(phase * 4 + 0.5) & 3);
+}
+
+/*  TRUEPHASES_IMPL  --  The five phases of lunation K,  as returned by
+                         phasehunt():  its new moon,  first quarter,
+                         full moon,  last quarter,  and the next new
+                         moon.  Called through truephases().  */
+
+static KERNEL_INLINE void truephases_impl(double k, double phases[5])
+{
+    phases[0] = truephase_kernel(k, 0);
+    phases[1] = truephase_kernel(k + 0.25, 1);
+    phases[2] = truephase_kernel(k + 0.5, 2);
+    phases[3] = truephase_kernel(k + 0.75, 3);
+    phases[4] = truephase_kernel(k + 1.0, 0);
+}
+
+/*  LUNATION_K  --  Find the K value (as used by meanphase() and
+                    truephase()) of the lunation in progress at a given
+                    date.
+
+                    The original PHASEHUNT scanned mean new moons one by
+                    one from 45 days before the date.  Mean new moons are
+                    evenly spaced by synmonth, give or take the tiny
+                    secular terms of meanphase(),  so the lunation is
+                    computed directly,  then corrected (by one step at
+                    most, for any date in historical times).  */
+
+static double lunation_k(double sdate)
+{
+    double k;
+
+    k = floor((sdate - 2415020.75933) / synmonth);
+    /* Intentionally t at sdate, not the scan's date: < 2E-6 days off */
+    while (meanphase(sdate, k) > sdate)
+        k -= 1;
+    while (meanphase(sdate, k + 1) <= sdate)
+        k += 1;
+    return k;
+}
+
 /*   PHASEHUNT  --  Find time of phases of the moon which surround the
                     current date.  Five phases are found, starting and
                     ending with the new moons which bound the  current
@@ -751,45 +1477,61 @@ static double truephase(double k, double phase)
 
 static void phasehunt(double sdate, double phases[5])
 {
-    double adate, k1, k2, nt1, nt2;
-    long yy;
-    int mm, dd;
+    truephases(lunation_k(sdate), phases);
+}
 
-    adate = sdate - 45;
+/*  BROWN_LUNATION  --  Brown Lunation Number of the lunation starting
+                        with the given new moon.  */
 
-    jyear(adate, &yy, &mm, &dd);
-    k1 = floor((yy + ((mm - 1) * (1.0 / 12.0)) - 1900) * 12.3685);
+static long brown_lunation(double newmoon)
+{
+    return (long) floor(((newmoon + 7) - lunatbase) / synmonth) + 1;
+}
 
-    adate = nt1 = meanphase(adate, k1);
-    while (TRUE) {
-        adate += synmonth;
-        k2 = k1 + 1;
-        nt2 = meanphase(adate, k2);
-        if (nt1 <= sdate && nt2 > sdate)
-            break;
-        nt1 = nt2;
-        k1 = k2;
-    }
-    phases[0] = truephase(k1, 0.0);
-    phases[1] = truephase(k1, 0.25);
-    phases[2] = truephase(k1, 0.5);
-    phases[3] = truephase(k1, 0.75);
-    phases[4] = truephase(k2, 0.0);
+/*  KEPLER_SUN  --  Solve the equation of Kepler,  E - e sin E = M,  for
+                    the eccentricity of the Sun's orbit (eccent),  given
+                    M in radians and its sine and cosine.  Also stores
+                    the sine and cosine of E.
+
+    In place of the original open-ended loop,  two fixed steps are
+    taken.  For f(E) = E - e sin E - M,  a Newton step from E0 leaves an
+    error of f''(x) / (2 f'(E0)) times the square of that of E0,  for
+    some x in between,  where |f''| <= e and f' >= 1 - e.  The first
+    step starts at M,  which is within e of the root,  so it ends within
+    e^3 / (2 (1 - e)) = 2.4E-6.  The second adds the known part of its
+    error,  f''(E0) / (2 f'(E0)) h^2 for a step h,  which leaves less
+    than 1E-18.  The sine and cosine of the first result,  M + d,  follow
+    from those of M,  with |d| <= e / (1 - e) = 0.017:  the series for
+    sin d and cos d used leave out less than 1E-17.  E is thus exact to
+    rounding,  where the loop only guaranteed 1E-6.  */
+
+static inline double kepler_sun_sc(double m, double sinm, double cosm,
+                                   double *sine, double *cose)
+{
+    double d, d2, sd, cd, se, ce, h;
+
+    d = eccent * sinm / (1 - eccent * cosm);
+    d2 = d * d;
+    sd = d * (1 - d2 / 6 * (1 - d2 / 20));
+    cd = 1 - d2 / 2 * (1 - d2 / 12 * (1 - d2 / 30));
+    se = sinm * cd + cosm * sd;
+    ce = cosm * cd - sinm * sd;
+
+    h = (d - eccent * se) / (1 - eccent * ce);
+    h += eccent * se / (2 * (1 - eccent * ce)) * h * h;
+    *sine = se * (1 - h * h / 2) - h * ce;
+    *cose = ce * (1 - h * h / 2) + h * se;
+    return m + d - h;
 }
 
-/*  KEPLER  --   Solve the equation of Kepler.  */
+/*  KEPLER_SUN  --  Same,  given M in degrees,  like the original.  */
 
-static double kepler(double m, double ecc)
+static double kepler_sun(double m)
 {
-    double e, delta;
-#define EPSILON 1E-6
+    double sine, cose;
 
-    e = m = torad(m);
-    do {
-        delta = e - ecc * sin(e) - m;
-        e -= delta / (1 - ecc * cos(e));
-    } while (abs(delta) > EPSILON);
-    return e;
+    m = torad(m);
+    return kepler_sun_sc(m, sin(m), cos(m), &sine, &cose);
 }
 
 /*  PHASE  --  Calculate phase of moon as a fraction:
@@ -826,7 +1568,7 @@ static double phase(
     N = fixangle((360 / 365.2422) * Day);   /* Mean anomaly of the Sun */
     M = fixangle(N + elonge - elongp);      /* Convert from perigee
                                                co-ordinates to epoch 1980.0 */
-    Ec = kepler(M, eccent);                 /* Solve equation of Kepler */
+    Ec = kepler_sun(M);                     /* Solve equation of Kepler */
     Ec = sqrt((1 + eccent) / (1 - eccent)) * tan(Ec / 2);
     Ec = 2 * todeg(atan(Ec));               /* True anomaly */
     Lambdasun = fixangle(Ec + elongp);      /* Sun's geocentric ecliptic
@@ -924,3 +1666,2672 @@ static double phase(
     *suangdia = SunAng;
     return fixangle(MoonAge) / 360.0;
 }
+
+/* Precomputed Lunation Table */
+
+/*  When built with MOON_LUNATION_TABLE defined,  the phases of all the
+    lunations of 1900 to 2100 are read from lunation_table.h instead of
+    being hunted down.  That file is generated at build time by running
+    tools/gen_lunation_table.c,  which uses this very file (without the
+    table) to compute it.  Entries hold exactly what phasehunt() would
+    return, and the date from which phasehunt() would select them, so
+    lookups are indistinguishable from the computation.  */
+
+#ifdef MOON_LUNATION_TABLE
+
+typedef struct {
+    double start;                     /* Smallest date for which phasehunt()
+                                         selects this lunation */
+    double phases[4];                 /* New moon, first quarter, full moon,
+                                         last quarter */
+    long lunation;                    /* Brown Lunation Number */
+} LunationEntry;
+
+#include "lunation_table.h"
+
+#endif
+
+/*  LUNATION_TABLE_LOOKUP  --  Same as phasehunt(), plus the Brown Lunation
+                               Number, but from the precomputed table.
+                               Returns FALSE if the date is not covered
+                               (or if there is no table).  */
+
+static int lunation_table_lookup(double sdate, double phases[5],
+                                 long *lunation)
+{
+#ifdef MOON_LUNATION_TABLE
+    const LunationEntry *e;
+    long i;
+
+    if (!(sdate >= lunation_table[0].start &&
+          sdate < lunation_table[LUNATION_TABLE_SIZE - 1].start))
+        return FALSE;
+
+    /* Lunations are nearly evenly spaced, so the guess is off by one
+       entry at most.  */
+    i = (long) ((sdate - lunation_table[0].start) / synmonth);
+    if (i > LUNATION_TABLE_SIZE - 2)
+        i = LUNATION_TABLE_SIZE - 2;
+    while (lunation_table[i].start > sdate)
+        i--;
+    while (lunation_table[i + 1].start <= sdate)
+        i++;
+
+    e = &lunation_table[i];
+    phases[0] = e->phases[0];
+    phases[1] = e->phases[1];
+    phases[2] = e->phases[2];
+    phases[3] = e->phases[3];
+    phases[4] = e[1].phases[0];
+    *lunation = e->lunation;
+    return TRUE;
+#else
+    (void) sdate;
+    (void) phases;
+    (void) lunation;
+    return FALSE;
+#endif
+}
+
+/*  LUNATION_TABLE_PHASES  --  New moon,  first quarter,  full moon, and
+                               last quarter of lunation k (as counted by
+                               truephase()),  plus its Brown Lunation
+                               Number,  from the precomputed table.
+                               Returns FALSE if k is not covered (or if
+                               there is no table).  */
+
+static int lunation_table_phases(double k, double phases[4], long *lunation)
+{
+#ifdef MOON_LUNATION_TABLE
+    const LunationEntry *e;
+    double i = k - LUNATION_TABLE_FIRST_K;
+
+    if (!(i >= 0 && i < LUNATION_TABLE_SIZE))
+        return FALSE;
+
+    e = &lunation_table[(long) i];
+    phases[0] = e->phases[0];
+    phases[1] = e->phases[1];
+    phases[2] = e->phases[2];
+    phases[3] = e->phases[3];
+    *lunation = e->lunation;
+    return TRUE;
+#else
+    (void) k;
+    (void) phases;
+    (void) lunation;
+    return FALSE;
+#endif
+}
+
+/* Ephemeris Files */
+
+/*  Ephemeris files hold lunations and phase samples precomputed by
+    truephase() and phase(), for ranges too wide to be compiled in.  They
+    are meant to be mapped into memory and read in place:  all fields are
+    little-endian 64-bit words, and every section starts on a multiple of
+    8 bytes.
+
+        Offset  Size  Field
+        ------  ----  -----
+             0     8  Magic, "MOONEPH\0"
+             8     4  Version (u32), EPHEM_VERSION
+            12     4  Header size (u32), EPHEM_HEADER_SIZE
+            16     8  Julian date of the first phase sample (f64)
+            24     8  Interval between phase samples, in days (f64)
+            32     8  Number of phase samples (u64)
+            40     8  Number of lunations (u64)
+            48     8  Reserved, zero
+            56     8  Checksum (u64)
+            64        Lunations, each EPHEM_LUNATION_SIZE bytes:
+                        Brown Lunation Number (i64), then new moon,
+                        first quarter, full moon, last quarter, and next
+                        new moon (f64)
+                      Phase samples, each EPHEM_SAMPLE_SIZE bytes:
+                        fraction of lunation, age, fraction illuminated,
+                        Moon's distance, Moon's angular diameter, Sun's
+                        distance, Sun's angular diameter (f64)
+
+    Sample i is for Julian date (first + i * interval).  The checksum is
+    a 64-bit FNV-1a over all the other words of the file, taken one word
+    (not byte) at a time.  */
+
+#define EPHEM_MAGIC          "MOONEPH"
+#define EPHEM_VERSION        1
+#define EPHEM_HEADER_SIZE    64
+#define EPHEM_LUNATION_SIZE  48
+#define EPHEM_SAMPLE_SIZE    56
+#define EPHEM_CHECKSUM_AT    56
+
+#define FNV_OFFSET_BASIS     UINT64_C(14695981039346656037)
+#define FNV_PRIME            UINT64_C(1099511628211)
+
+static uint64_t le64_load(const unsigned char *p)
+{
+    return (uint64_t) p[0]       | (uint64_t) p[1] << 8
+         | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24
+         | (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40
+         | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+}
+
+static void le64_store(unsigned char *p, uint64_t v)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+        p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static double le64_load_double(const unsigned char *p)
+{
+    uint64_t v = le64_load(p);
+    double d;
+
+    memcpy(&d, &v, sizeof d);
+    return d;
+}
+
+static void le64_store_double(unsigned char *p, double d)
+{
+    uint64_t v;
+
+    memcpy(&v, &d, sizeof v);
+    le64_store(p, v);
+}
+
+static uint64_t ephem_checksum(uint64_t h, const unsigned char *p, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i += 8) {
+        h ^= le64_load(p + i);
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+/*  EPHEM_SAMPLE_INDEX  --  Index of the first phase sample taken at or
+                            after the given date.  */
+
+static size_t ephem_sample_index(const MoonEphemeris *eph, double jd)
+{
+    double x = ceil((jd - eph->first_julian_date) / eph->step);
+    size_t i;
+
+    if (!(x > 0))
+        return 0;
+    if (x >= (double) eph->sample_count)
+        return eph->sample_count;
+
+    /* Division rounding may be off by one;  settle on actual dates.  */
+    i = (size_t) x;
+    while (i > 0 && eph->first_julian_date + (i - 1) * eph->step >= jd)
+        i--;
+    while (i < eph->sample_count && eph->first_julian_date + i * eph->step < jd)
+        i++;
+    return i;
+}
+
+int moonephem_write(const char *path, double from_jd, double to_jd,
+                    double step)
+{
+    unsigned char header[EPHEM_HEADER_SIZE] = {0};
+    unsigned char record[EPHEM_SAMPLE_SIZE];
+    double k, k_first, k_last, x, jd, p, aom, cphase, cdist, cangdia,
+           csund, csuang, phases[5];
+    uint64_t h, i, n;
+    FILE *f;
+    int ok;
+
+    if (!isfinite(from_jd) || !isfinite(to_jd) || !(to_jd >= from_jd) ||
+        !isfinite(step) || !(step > 0))
+        return FALSE;
+
+    /* One lunation of margin on each side, since lunation_k() goes by
+       mean new moons, and true ones may be up to half a day apart.  */
+    k_first = lunation_k(from_jd) - 1;
+    k_last = lunation_k(to_jd) + 1;
+
+    x = floor((to_jd - from_jd) / step);
+    if (!(x < 1e12))
+        return FALSE;
+    n = (uint64_t) x + 1;
+    while (n > 1 && from_jd + (n - 1) * step > to_jd)
+        n--;
+
+    memcpy(header, EPHEM_MAGIC, sizeof EPHEM_MAGIC);
+    header[8] = EPHEM_VERSION;
+    header[12] = EPHEM_HEADER_SIZE;
+    le64_store_double(header + 16, from_jd);
+    le64_store_double(header + 24, step);
+    le64_store(header + 32, n);
+    le64_store(header + 40, (uint64_t) (k_last - k_first + 1));
+
+    f = fopen(path, "wb");
+    if (f == NULL)
+        return FALSE;
+
+    /* Header first, with a blank checksum, which is filled in last.  */
+    ok = fwrite(header, EPHEM_HEADER_SIZE, 1, f) == 1;
+    h = ephem_checksum(FNV_OFFSET_BASIS, header, EPHEM_CHECKSUM_AT);
+
+    for (k = k_first; ok && k <= k_last; k += 1) {
+        truephases(k, phases);
+        le64_store(record, (uint64_t) (int64_t) brown_lunation(phases[0]));
+        for (i = 0; i < 5; i++)
+            le64_store_double(record + 8 + 8 * i, phases[i]);
+        ok = fwrite(record, EPHEM_LUNATION_SIZE, 1, f) == 1;
+        h = ephem_checksum(h, record, EPHEM_LUNATION_SIZE);
+    }
+
+    for (i = 0; ok && i < n; i++) {
+        jd = from_jd + i * step;
+        p = phase(jd, &cphase, &aom, &cdist, &cangdia, &csund, &csuang);
+        le64_store_double(record, p);
+        le64_store_double(record + 8, aom);
+        le64_store_double(record + 16, cphase);
+        le64_store_double(record + 24, cdist);
+        le64_store_double(record + 32, cangdia);
+        le64_store_double(record + 40, csund);
+        le64_store_double(record + 48, csuang);
+        ok = fwrite(record, EPHEM_SAMPLE_SIZE, 1, f) == 1;
+        h = ephem_checksum(h, record, EPHEM_SAMPLE_SIZE);
+    }
+
+    le64_store(header + EPHEM_CHECKSUM_AT, h);
+    ok = ok && fseek(f, EPHEM_CHECKSUM_AT, SEEK_SET) == 0
+            && fwrite(header + EPHEM_CHECKSUM_AT, 8, 1, f) == 1;
+
+    if (fclose(f) != 0 || !ok) {
+        remove(path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*  EPHEM_VALIDATE  --  Check the header and checksum of a mapped file,
+                        and fill in the informative fields of eph.  */
+
+static int ephem_validate(MoonEphemeris *eph)
+{
+    const unsigned char *d = eph->data;
+    uint64_t samples, lunations, h;
+
+    if (eph->size < EPHEM_HEADER_SIZE ||
+        memcmp(d, EPHEM_MAGIC, sizeof EPHEM_MAGIC) != 0 ||
+        le64_load(d + 8) != ((uint64_t) EPHEM_HEADER_SIZE << 32 | EPHEM_VERSION))
+        return FALSE;
+
+    samples = le64_load(d + 32);
+    lunations = le64_load(d + 40);
+    if (lunations > (eph->size - EPHEM_HEADER_SIZE) / EPHEM_LUNATION_SIZE ||
+        samples > (eph->size - EPHEM_HEADER_SIZE) / EPHEM_SAMPLE_SIZE ||
+        eph->size != EPHEM_HEADER_SIZE + lunations * EPHEM_LUNATION_SIZE
+                                       + samples * EPHEM_SAMPLE_SIZE)
+        return FALSE;
+
+    h = ephem_checksum(FNV_OFFSET_BASIS, d, EPHEM_CHECKSUM_AT);
+    h = ephem_checksum(h, d + EPHEM_HEADER_SIZE, eph->size - EPHEM_HEADER_SIZE);
+    if (h != le64_load(d + EPHEM_CHECKSUM_AT))
+        return FALSE;
+
+    eph->version = EPHEM_VERSION;
+    eph->first_julian_date = le64_load_double(d + 16);
+    eph->step = le64_load_double(d + 24);
+    eph->sample_count = (size_t) samples;
+    eph->lunation_count = (size_t) lunations;
+    return isfinite(eph->first_julian_date) && eph->step > 0;
+}
+
+int moonephem_open(MoonEphemeris *eph, const char *path)
+{
+    memset(eph, 0, sizeof *eph);
+
+#ifndef _WIN32
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return FALSE;
+    if (fstat(fd, &st) != 0 || st.st_size < EPHEM_HEADER_SIZE) {
+        close(fd);
+        return FALSE;
+    }
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return FALSE;
+
+    eph->data = map;
+    eph->size = (size_t) st.st_size;
+#else
+    /* No mmap(), read the whole file instead.  */
+    unsigned char *buf;
+    long size;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (f == NULL)
+        return FALSE;
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < EPHEM_HEADER_SIZE ||
+        fseek(f, 0, SEEK_SET) != 0 || (buf = malloc(size)) == NULL) {
+        fclose(f);
+        return FALSE;
+    }
+    if (fread(buf, 1, size, f) != (size_t) size) {
+        free(buf);
+        fclose(f);
+        return FALSE;
+    }
+    fclose(f);
+
+    eph->data = buf;
+    eph->size = (size_t) size;
+#endif
+
+    if (!ephem_validate(eph)) {
+        moonephem_close(eph);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void moonephem_close(MoonEphemeris *eph)
+{
+    if (eph->data != NULL) {
+#ifndef _WIN32
+        munmap((void *) eph->data, eph->size);
+#else
+        free((void *) eph->data);
+#endif
+    }
+    memset(eph, 0, sizeof *eph);
+}
+
+int moonephem_lunations(const MoonEphemeris *eph, double from_jd, double to_jd,
+                        MoonLunation *lunations, size_t capacity, size_t *count)
+{
+    const unsigned char *base = eph->data + EPHEM_HEADER_SIZE;
+    const unsigned char *r;
+    size_t lo, hi, mid, first, i;
+
+    /* First lunation ending after the start of the range.  */
+    lo = 0;
+    hi = eph->lunation_count;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (le64_load_double(base + mid * EPHEM_LUNATION_SIZE + 40) > from_jd)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    first = lo;
+
+    /* First lunation starting at or after the end of the range.  */
+    hi = eph->lunation_count;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (le64_load_double(base + mid * EPHEM_LUNATION_SIZE + 8) >= to_jd)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    *count = lo - first;
+    if (*count > capacity)
+        return FALSE;
+
+    for (i = 0; i < *count; i++) {
+        r = base + (first + i) * EPHEM_LUNATION_SIZE;
+        lunations[i].lunation = (long) (int64_t) le64_load(r);
+        lunations[i].new_moon = le64_load_double(r + 8);
+        lunations[i].first_quarter = le64_load_double(r + 16);
+        lunations[i].full_moon = le64_load_double(r + 24);
+        lunations[i].last_quarter = le64_load_double(r + 32);
+        lunations[i].next_new_moon = le64_load_double(r + 40);
+    }
+    return TRUE;
+}
+
+int moonephem_phases(const MoonEphemeris *eph, double from_jd, double to_jd,
+                     const MoonPhaseColumns *columns, size_t capacity,
+                     size_t *count)
+{
+    const unsigned char *base = eph->data + EPHEM_HEADER_SIZE
+                                + eph->lunation_count * EPHEM_LUNATION_SIZE;
+    const unsigned char *r;
+    size_t first, last, i;
+    double p;
+
+    first = ephem_sample_index(eph, from_jd);
+    last = ephem_sample_index(eph, to_jd);
+
+    *count = (last > first) ? last - first : 0;
+    if (*count > capacity)
+        return FALSE;
+
+    for (i = 0; i < *count; i++) {
+        r = base + (first + i) * EPHEM_SAMPLE_SIZE;
+        p = le64_load_double(r);
+        if (columns->julian_date != NULL)
+            columns->julian_date[i] = eph->first_julian_date + (first + i) * eph->step;
+        if (columns->fraction_of_lunation != NULL)
+            columns->fraction_of_lunation[i] = p;
+        if (columns->phase != NULL)
+            columns->phase[i] = fraction_of_lunation_to_phase(p);
+        if (columns->age != NULL)
+            columns->age[i] = le64_load_double(r + 8);
+        if (columns->fraction_illuminated != NULL)
+            columns->fraction_illuminated[i] = le64_load_double(r + 16);
+        if (columns->distance_to_earth_km != NULL)
+            columns->distance_to_earth_km[i] = le64_load_double(r + 24);
+        if (columns->subtends != NULL)
+            columns->subtends[i] = le64_load_double(r + 32);
+        if (columns->sun_distance_to_earth_km != NULL)
+            columns->sun_distance_to_earth_km[i] = le64_load_double(r + 40);
+        if (columns->sun_subtends != NULL)
+            columns->sun_subtends[i] = le64_load_double(r + 48);
+    }
+    return TRUE;
+}
+
+/* Binary Records */
+
+/*  Fixed-width binary records of the phase of the Moon,  for bulk
+    exports.  Layouts are documented in moon.h;  the header lists the
+    fields below,  so readers don't depend on offsets.  */
+
+#define RECORD_MAGIC         "MOONREC"
+#define RECORD_VERSION       1
+#define RECORD_FIELD_SIZE    40
+
+#define RECORD_I64           1
+#define RECORD_F64           2
+#define RECORD_U8            3
+
+static const struct {
+    const char *name;
+    unsigned char offset, type, size;
+} record_fields[] = {
+    {"timestamp",                  0, RECORD_I64, 8},
+    {"julian_date",                8, RECORD_F64, 8},
+    {"age",                       16, RECORD_F64, 8},
+    {"fraction_of_lunation",      24, RECORD_F64, 8},
+    {"fraction_illuminated",      32, RECORD_F64, 8},
+    {"distance_to_earth_km",      40, RECORD_F64, 8},
+    {"subtends",                  48, RECORD_F64, 8},
+    {"sun_distance_to_earth_km",  56, RECORD_F64, 8},
+    {"sun_subtends",              64, RECORD_F64, 8},
+    {"phase",                     72, RECORD_U8,  1}
+};
+
+#define RECORD_FIELDS (sizeof record_fields / sizeof record_fields[0])
+
+static void le32_store(unsigned char *p, uint32_t v)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        p[i] = (unsigned char) (v >> (8 * i));
+}
+
+size_t moonphase_record_header(unsigned char *buf)
+{
+    unsigned char *field;
+    size_t i;
+
+    memset(buf, 0, MOON_RECORD_HEADER_SIZE);
+    memcpy(buf, RECORD_MAGIC, sizeof RECORD_MAGIC);
+    le32_store(buf + 8, RECORD_VERSION);
+    le32_store(buf + 12, MOON_RECORD_HEADER_SIZE);
+    le32_store(buf + 16, MOON_RECORD_SIZE);
+    le32_store(buf + 20, RECORD_FIELDS);
+
+    for (i = 0; i < RECORD_FIELDS; i++) {
+        field = buf + 24 + i * RECORD_FIELD_SIZE;
+        strncpy((char *) field, record_fields[i].name, 32);
+        le32_store(field + 32, record_fields[i].offset);
+        field[36] = record_fields[i].type;
+        field[37] = record_fields[i].size;
+    }
+    return MOON_RECORD_HEADER_SIZE;
+}
+
+void moonphase_to_record(unsigned char *rec, const MoonPhase *mphase)
+{
+    le64_store(rec, (uint64_t) (int64_t) mphase->timestamp);
+    le64_store_double(rec + 8, mphase->julian_date);
+    le64_store_double(rec + 16, mphase->age);
+    le64_store_double(rec + 24, mphase->fraction_of_lunation);
+    le64_store_double(rec + 32, mphase->fraction_illuminated);
+    le64_store_double(rec + 40, mphase->distance_to_earth_km);
+    le64_store_double(rec + 48, mphase->subtends);
+    le64_store_double(rec + 56, mphase->sun_distance_to_earth_km);
+    le64_store_double(rec + 64, mphase->sun_subtends);
+    memset(rec + 72, 0, MOON_RECORD_SIZE - 72);
+    rec[72] = (unsigned char) mphase->phase;
+}
+
+/* Chebyshev Approximation */
+
+/*  Between two dates,  the quantities computed by phase() are smooth
+    functions of time,  and are cheaply approximated with polynomials.
+    Like JPL's ephemerides, the range is split in intervals,  over which
+    each quantity gets its own Chebyshev series.  The series interpolate
+    phase() at the Chebyshev nodes, which is close to the best possible
+    fit of the degree.  The fraction of lunation wraps around at new
+    moon, so it is unwrapped before fitting, and wrapped back after.  */
+
+#define CHEB_MAX_DEGREE  30
+#define CHEB_CHECKS      8            /* Error checks per node, in fit */
+
+/*  CHEB_SAMPLE  --  Evaluate the fitted quantities with phase().  The
+                     fraction of lunation is unwrapped to lie close to
+                     the `near' estimate.  */
+
+static void cheb_sample(double jd, double near, double q[MOON_CHEBYSHEV_QUANTITIES])
+{
+    double aom;
+
+    q[0] = phase(jd, &q[1], &aom, &q[2], &q[3], &q[4], &q[5]);
+    q[0] += floor(near - q[0] + 0.5);
+}
+
+/*  CHEB_EVAL  --  Evaluate a Chebyshev series at x in [-1, 1], using
+                   Clenshaw's recurrence.  */
+
+static double cheb_eval(const double *c, int degree, double x)
+{
+    double b0 = 0, b1 = 0, b2;
+    int j;
+
+    for (j = degree; j >= 1; j--) {
+        b2 = b1;
+        b1 = b0;
+        b0 = 2 * x * b1 - b2 + c[j];
+    }
+    return x * b0 - b1 + c[0];
+}
+
+int moonchebyshev_fit(MoonChebyshev *cheb, double from_jd, double to_jd,
+                      double interval, int degree)
+{
+    double f[CHEB_MAX_DEGREE + 1][MOON_CHEBYSHEV_QUANTITIES];
+    double q[MOON_CHEBYSHEV_QUANTITIES];
+    double x, a, mid, near, err, *c;
+    size_t i, count;
+    int n, j, k, m;
+
+    memset(cheb, 0, sizeof *cheb);
+
+    if (!isfinite(from_jd) || !isfinite(to_jd) || !(to_jd > from_jd) ||
+        !isfinite(interval) || !(interval > 0) ||
+        degree < 0 || degree > CHEB_MAX_DEGREE)
+        return FALSE;
+
+    x = ceil((to_jd - from_jd) / interval);
+    if (!(x < 1e9))
+        return FALSE;
+    count = (size_t) x;
+    n = degree + 1;
+
+    c = malloc(count * MOON_CHEBYSHEV_QUANTITIES * n * sizeof *c);
+    if (c == NULL)
+        return FALSE;
+
+    cheb->first_julian_date = from_jd;
+    cheb->interval = interval;
+    cheb->interval_count = count;
+    cheb->degree = degree;
+    cheb->coefficients = c;
+
+    for (i = 0; i < count; i++) {
+        a = from_jd + i * interval;
+        mid = a + interval / 2;
+        cheb_sample(mid, 0, q);
+        near = q[0];
+
+        /* Sample at the nodes, cos(pi * (k + 1/2) / n).  */
+        for (k = 0; k < n; k++) {
+            x = cos(PI * (k + 0.5) / n);
+            cheb_sample(mid + x * interval / 2,
+                        near + x * interval / 2 / synmonth, f[k]);
+        }
+
+        /* Discrete cosine transform of the samples.  */
+        for (m = 0; m < MOON_CHEBYSHEV_QUANTITIES; m++) {
+            for (j = 0; j < n; j++) {
+                double sum = 0;
+                for (k = 0; k < n; k++)
+                    sum += f[k][m] * cos(PI * j * (k + 0.5) / n);
+                c[m * n + j] = ((j == 0) ? 1.0 : 2.0) * sum / n;
+            }
+        }
+
+        /* Measure the error between (and on) the nodes.  */
+        for (k = 0; k <= n * CHEB_CHECKS; k++) {
+            x = -1.0 + 2.0 * k / (n * CHEB_CHECKS);
+            cheb_sample(mid + x * interval / 2,
+                        near + x * interval / 2 / synmonth, q);
+            for (m = 0; m < MOON_CHEBYSHEV_QUANTITIES; m++) {
+                err = abs(cheb_eval(c + m * n, degree, x) - q[m]);
+                if (err > cheb->max_error[m])
+                    cheb->max_error[m] = err;
+            }
+        }
+
+        c += MOON_CHEBYSHEV_QUANTITIES * n;
+    }
+
+    return TRUE;
+}
+
+void moonchebyshev_free(MoonChebyshev *cheb)
+{
+    free(cheb->coefficients);
+    memset(cheb, 0, sizeof *cheb);
+}
+
+int moonchebyshev_batch(const MoonChebyshev *cheb,
+                        const MoonPhaseColumns *columns,
+                        const time_t *timestamps, size_t count)
+{
+    const double *c;
+    double jd, x, p;
+    size_t i, interval;
+    int n = cheb->degree + 1;
+
+    for (i = 0; i < count; i++) {
+        if (!unixtoj(timestamps[i], &jd))
+            return FALSE;
+
+        x = floor((jd - cheb->first_julian_date) / cheb->interval);
+        if (!(x >= 0 && x < (double) cheb->interval_count))
+            return FALSE;
+        interval = (size_t) x;
+
+        c = cheb->coefficients + interval * MOON_CHEBYSHEV_QUANTITIES * n;
+        x = 2 * (jd - cheb->first_julian_date - interval * cheb->interval)
+              / cheb->interval - 1;
+
+        p = cheb_eval(c, cheb->degree, x);
+        p -= floor(p);
+
+        if (columns->julian_date != NULL)
+            columns->julian_date[i] = jd;
+        if (columns->age != NULL)
+            columns->age[i] = synmonth * p;
+        if (columns->fraction_of_lunation != NULL)
+            columns->fraction_of_lunation[i] = p;
+        if (columns->phase != NULL)
+            columns->phase[i] = fraction_of_lunation_to_phase(p);
+        if (columns->fraction_illuminated != NULL)
+            columns->fraction_illuminated[i] = cheb_eval(c + n, cheb->degree, x);
+        if (columns->distance_to_earth_km != NULL)
+            columns->distance_to_earth_km[i] = cheb_eval(c + 2 * n, cheb->degree, x);
+        if (columns->subtends != NULL)
+            columns->subtends[i] = cheb_eval(c + 3 * n, cheb->degree, x);
+        if (columns->sun_distance_to_earth_km != NULL)
+            columns->sun_distance_to_earth_km[i] = cheb_eval(c + 4 * n, cheb->degree, x);
+        if (columns->sun_subtends != NULL)
+            columns->sun_subtends[i] = cheb_eval(c + 5 * n, cheb->degree, x);
+    }
+
+    return TRUE;
+}
+
+/* Incremental Calculation Routines */
+
+/*  On a uniform time grid,  the iterator computes whole groups of
+    PHASE_LANES consecutive steps with phase_lanes_iter(),  a variant of
+    the batch kernel that takes,  for each lane,  the sines and cosines
+    of the angles that are linear in time:  the Sun's mean anomaly (M),
+    and the argument of the evection (D = 2 ml - MM).  From one group to
+    the next,  each lane moves on by PHASE_LANES steps,  so they are
+    advanced by rotation,  by the same angle in every lane.
+
+    Rotations accumulate rounding errors,  so the state is resynchronized
+    from scratch every ITER_RESYNC groups.  In between,  the angles follow
+    the exact time,  where PHASE takes them from a Julian date,  rounded
+    to 4.7E-10 days:  that moves the Sun's mean anomaly by up to 8E-12
+    rad,  and its distance by up to 2E-5 km.  Groups are kept in the
+    iterator,  and handed out as requested:  the results don't depend on
+    how the steps are split between calls.  */
+
+#define ITER_RESYNC      64           /* Groups */
+
+#define iter_rotate(s, c, ds, dc) do {                                     \
+        double s_ = (s);                                                   \
+        (s) = s_ * (dc) + (c) * (ds);                                      \
+        (c) = (c) * (dc) - s_ * (ds);                                      \
+    } while (0)
+
+/*  ITER_ANGLES  --  Mean anomaly of the Sun (M), and argument D of the
+                     evection,  exactly as computed by PHASE.  */
+
+static void iter_angles(double jd, double *m, double *d)
+{
+    double Day, N, ml, MM;
+
+    Day = jd - epoch;
+    N = fixangle((360 / 365.2422) * Day);
+    *m = fixangle(N + elonge - elongp);
+    ml = fixangle(13.1763966 * Day + mmlong);
+    MM = fixangle(ml - 0.1114041 * Day - mmlongp);
+    *d = 2 * ml - MM;
+}
+
+/*  ITER_GROUP  --  Compute the group of steps starting at the iterator's
+                    timestamp,  and advance the angles to the next one.
+                    Steps past the range of unixtoj() are left out of
+                    the count of valid ones.  */
+
+static int iter_group(MoonPhaseIterator *it)
+{
+    double m, d;
+    unsigned int j;
+
+    for (j = 0; j < PHASE_LANES; j++) {
+        if (!unixtoj(it->timestamp + (time_t) j * it->step, &it->jd[j]))
+            break;
+    }
+    if (j == 0)
+        return FALSE;
+    it->valid = j;
+    for (; j < PHASE_LANES; j++)
+        it->jd[j] = it->jd[it->valid - 1];
+
+    if (it->until_resync == 0) {
+        for (j = 0; j < PHASE_LANES; j++) {
+            iter_angles(it->jd[j], &m, &d);
+            it->sin_m[j] = dsin(m);
+            it->cos_m[j] = dcos(m);
+            it->sin_d[j] = dsin(d);
+            it->cos_d[j] = dcos(d);
+        }
+        it->until_resync = ITER_RESYNC;
+    }
+
+    phase_lanes_iter(it->jd, it->sin_m, it->cos_m, it->sin_d, it->cos_d,
+                     it->pfrac, it->pphase, it->mage, it->dist, it->angdia,
+                     it->sudist, it->suangdia);
+
+    for (j = 0; j < PHASE_LANES; j++) {
+        iter_rotate(it->sin_m[j], it->cos_m[j], it->sin_dm, it->cos_dm);
+        iter_rotate(it->sin_d[j], it->cos_d[j], it->sin_dd, it->cos_dd);
+    }
+    it->until_resync--;
+    return TRUE;
+}
+
+int moonphase_iter_init(MoonPhaseIterator *it, const time_t *start, long step)
+{
+    double group_days = PHASE_LANES * (step / 86400.0);
+
+    if (step == 0)
+        return FALSE;
+
+    memset(it, 0, sizeof *it);
+    it->timestamp = (start != NULL) ? *start : time(NULL);
+    it->step = step;
+
+    /* Angles by which M and D advance from one group to the next */
+    it->sin_dm = dsin((360 / 365.2422) * group_days);
+    it->cos_dm = dcos((360 / 365.2422) * group_days);
+    it->sin_dd = dsin((13.1763966 + 0.1114041) * group_days);
+    it->cos_dd = dcos((13.1763966 + 0.1114041) * group_days);
+
+    it->until_resync = 0;
+    it->lane = 0;
+    return TRUE;
+}
+
+int moonphase_iter_next(MoonPhaseIterator *it, const MoonPhaseColumns *columns,
+                        size_t count)
+{
+    size_t i, j, k, n;
+
+    for (i = 0; i < count; i += n) {
+        if (it->lane == 0 && !iter_group(it))
+            return FALSE;
+
+        n = PHASE_LANES - it->lane;
+        if (n > count - i)
+            n = count - i;
+        if (it->lane + n > it->valid)
+            return FALSE;
+
+        for (j = 0; j < n; j++) {
+            k = it->lane + j;
+            if (columns->julian_date != NULL)
+                columns->julian_date[i + j] = it->jd[k];
+            if (columns->age != NULL)
+                columns->age[i + j] = it->mage[k];
+            if (columns->fraction_of_lunation != NULL)
+                columns->fraction_of_lunation[i + j] = it->pfrac[k];
+            if (columns->phase != NULL)
+                columns->phase[i + j] =
+                    fraction_of_lunation_to_phase(it->pfrac[k]);
+            if (columns->fraction_illuminated != NULL)
+                columns->fraction_illuminated[i + j] = it->pphase[k];
+            if (columns->distance_to_earth_km != NULL)
+                columns->distance_to_earth_km[i + j] = it->dist[k];
+            if (columns->subtends != NULL)
+                columns->subtends[i + j] = it->angdia[k];
+            if (columns->sun_distance_to_earth_km != NULL)
+                columns->sun_distance_to_earth_km[i + j] = it->sudist[k];
+            if (columns->sun_subtends != NULL)
+                columns->sun_subtends[i + j] = it->suangdia[k];
+        }
+
+        it->lane = (it->lane + n) % PHASE_LANES;
+        it->timestamp += (time_t) n * it->step;
+    }
+
+    return TRUE;
+}
+
+/* Vectorized Calculation Routines */
+
+/*  The routines below evaluate PHASE on groups of PHASE_LANES dates at
+    once.  They are plain C,  free of branches and of libm calls inside
+    the lane loop,  so that the compiler maps the lanes onto SIMD
+    registers (SSE2, AVX2, AVX-512, NEON, ...)  when auto-vectorizing.
+    There is no separate scalar fallback: on targets without SIMD,  the
+    very same loop simply runs one lane at a time.
+
+    Trigonometric functions are replaced by polynomial approximations
+    (fdlibm kernels for sine and cosine,  Cephes for arc tangent),  and
+    KEPLER by a fixed number of Newton iterations.  Between 1800 and 2200,
+    results agree with PHASE within:
+
+        fraction of lunation,  fraction illuminated    1e-14
+        age of the Moon                                 1e-13 days
+        distance to the Moon                            1e-9 km
+        distance to the Sun                             1e-6 km
+        angular diameters                               1e-15 degrees
+
+    Vectorizing requires the compiler to if-convert the selects,  which
+    GCC only does with -fno-trapping-math (clang's default).  LANE_ROUND
+    relies on IEEE 754 round-to-nearest,  and must not be compiled with
+    -ffast-math,  which would fold the magic constant away.  */
+
+#define LANE_ROUND_MAGIC 6755399441055744.0    /* 1.5 * 2^52 */
+#define LANE_PIO2_1      1.57079632673412561417e+00  /* First 33 bits of pi/2 */
+#define LANE_PIO2_1T     6.07710050650619224932e-11  /* pi/2 - LANE_PIO2_1 */
+#define LANE_T3P8        2.41421356237309504880      /* tan(3 pi / 8) */
+#define LANE_MOREBITS    6.123233995736765886130e-17 /* pi/2 - double(pi/2) */
+
+/*  LANE_ROUND  --  Round to nearest integer (|x| < 2^51).  */
+
+static inline double lane_round(double x)
+{
+    return (x + LANE_ROUND_MAGIC) - LANE_ROUND_MAGIC;
+}
+
+/*  LANE_FLOOR  --  Largest integer not greater than x (|x| < 2^51).  */
+
+static inline double lane_floor(double x)
+{
+    double r = lane_round(x);
+    return (r > x) ? r - 1.0 : r;
+}
+
+/*  LANE_FIXANGLE  --  Branch-free equivalent of fixangle().  */
+
+static inline double lane_fixangle(double a)
+{
+    return a - 360.0 * lane_floor(a / 360.0);
+}
+
+/*  LANE_SIN_QUADRANT  --  Sine of (r + q * pi / 2),  for |r| <= pi / 4
+                           and integer q.  */
+
+static inline double lane_sin_quadrant(double r, double q)
+{
+    double z, s, c, q4, v;
+
+    z = r * r;
+    s = r + r * z * (-1.66666666666666324348e-01
+            + z * ( 8.33333333332248946124e-03
+            + z * (-1.98412698298579493134e-04
+            + z * ( 2.75573137070700676789e-06
+            + z * (-2.50507602534068634195e-08
+            + z *   1.58969099521155010221e-10)))));
+    c = 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02
+            + z * (-1.38888888888741095749e-03
+            + z * ( 2.48015872894767294178e-05
+            + z * (-2.75573143513906633035e-07
+            + z * ( 2.08757232129817482790e-09
+            + z *  -1.13596475577881948265e-11)))));
+
+    q4 = q - 4.0 * lane_floor(q * 0.25);    /* Quadrant, 0 to 3 */
+    v = (q4 - 2.0 * lane_floor(q4 * 0.5) != 0.0) ? c : s;
+    return (q4 >= 2.0) ? -v : v;
+}
+
+/*  LANE_SIN, LANE_COS  --  Sine and cosine of an angle in radians.  */
+
+static inline double lane_sin(double x)
+{
+    double q = lane_round(x * (2.0 / PI));
+    return lane_sin_quadrant((x - q * LANE_PIO2_1) - q * LANE_PIO2_1T, q);
+}
+
+static inline double lane_cos(double x)
+{
+    double q = lane_round(x * (2.0 / PI));
+    return lane_sin_quadrant((x - q * LANE_PIO2_1) - q * LANE_PIO2_1T, q + 1.0);
+}
+
+/*  LANE_DSIN, LANE_DCOS  --  Sine and cosine of an angle in degrees. The
+                              reduction to +/- 45 degrees is done before
+                              converting to radians,  which keeps it
+                              exact.  */
+
+static inline double lane_dsin(double x)
+{
+    double q = lane_round(x / 90.0);
+    return lane_sin_quadrant(torad(x - 90.0 * q), q);
+}
+
+static inline double lane_dcos(double x)
+{
+    double q = lane_round(x / 90.0);
+    return lane_sin_quadrant(torad(x - 90.0 * q), q + 1.0);
+}
+
+/*  LANE_ATAN  --  Arc tangent,  in radians.  */
+
+static inline double lane_atan(double x)
+{
+    double ax, xr, y, more, z, p, q;
+
+    /* Comparisons are repeated rather than stored into int flags,  so
+       that lanes only ever hold doubles. */
+    ax = fabs(x);
+    xr = (ax > LANE_T3P8) ? -1.0 / ax
+         : (ax > 0.66) ? (ax - 1.0) / (ax + 1.0) : ax;
+    y = (ax > LANE_T3P8) ? PI / 2 : (ax > 0.66) ? PI / 4 : 0.0;
+    more = (ax > LANE_T3P8) ? LANE_MOREBITS
+           : (ax > 0.66) ? 0.5 * LANE_MOREBITS : 0.0;
+
+    z = xr * xr;
+    p = (((-8.750608600031904122785e-01 * z
+          - 1.615753718733365076637e+01) * z
+          - 7.500855792314704667340e+01) * z
+          - 1.228866684490136173410e+02) * z
+          - 6.485021904942025371773e+01;
+    q = ((((z + 2.485846490142306297962e+01) * z
+              + 1.650270098316988542046e+02) * z
+              + 4.328810604912902668951e+02) * z
+              + 4.853903996359136964868e+02) * z
+              + 1.945506571482613964425e+02;
+    z = xr * (z * p / q) + xr;
+
+    y += z + more;
+    return (x < 0) ? -y : y;
+}
+
+/*  PHASE_LANES_IMPL  --  Calculate the phase of the Moon for PHASE_LANES
+                          dates.  Called through phase_lanes().
+
+    Same as PHASE,  with every argument turned into an array of
+    PHASE_LANES elements.  The Moon's ecliptic longitude and latitude,
+    and its parallax,  which PHASE computes but never returns,  are
+    skipped.  */
+
+static KERNEL_INLINE void phase_lanes_impl(
+  const double  *restrict pdate,      /* Dates for which to calculate phase */
+  double  *restrict pfrac,            /* Terminator phase angles, 0 to 1 */
+  double  *restrict pphase,           /* Illuminated fractions */
+  double  *restrict mage,             /* Ages of moon in days */
+  double  *restrict dist,             /* Distances in kilometres */
+  double  *restrict angdia,           /* Angular diameters in degrees */
+  double  *restrict sudist,           /* Distances to Sun */
+  double  *restrict suangdia)         /* Sun's angular diameters */
+{
+    int i;
+
+    for (i = 0; i < PHASE_LANES; i++) {
+        double Day, N, M, Em, Ec, se, ce, Lambdasun, ml, MM, Ev, Ae, A3,
+               MmP, mEc, A4, lP, V, lPP, MoonAge, MoonDist, F;
+
+        /* Calculation of the Sun's position */
+
+        Day = pdate[i] - epoch;
+        N = lane_fixangle((360 / 365.2422) * Day);
+        M = lane_fixangle(N + elonge - elongp);
+
+        Em = torad(M);                      /* Equation of Kepler */
+        Ec = kepler_sun_sc(Em, lane_sin(Em), lane_cos(Em), &se, &ce);
+
+        Ec = sqrt((1 + eccent) / (1 - eccent))
+             * (lane_sin(Ec / 2) / lane_cos(Ec / 2));
+        Ec = 2 * todeg(lane_atan(Ec));      /* True anomaly */
+        Lambdasun = lane_fixangle(Ec + elongp);
+
+        F = ((1 + eccent * lane_dcos(Ec)) / (1 - eccent * eccent));
+        sudist[i] = sunsmax / F;
+        suangdia[i] = F * sunangsiz;
+
+        /* Calculation of the Moon's position */
+
+        ml = lane_fixangle(13.1763966 * Day + mmlong);
+        MM = lane_fixangle(ml - 0.1114041 * Day - mmlongp);
+        Ev = 1.2739 * lane_dsin(2 * (ml - Lambdasun) - MM);
+        Ae = 0.1858 * lane_dsin(M);
+        A3 = 0.37 * lane_dsin(M);
+        MmP = MM + Ev - Ae - A3;
+        mEc = 6.2886 * lane_dsin(MmP);
+        A4 = 0.214 * lane_dsin(2 * MmP);
+        lP = ml + Ev + mEc - Ae + A4;
+        V = 0.6583 * lane_dsin(2 * (lP - Lambdasun));
+        lPP = lP + V;
+
+        /* Calculation of the phase of the Moon */
+
+        MoonAge = lPP - Lambdasun;
+        pphase[i] = (1 - lane_dcos(MoonAge)) / 2;
+
+        MoonDist = (msmax * (1 - mecc * mecc)) /
+                   (1 + mecc * lane_dcos(MmP + mEc));
+        dist[i] = MoonDist;
+        angdia[i] = mangsiz / (MoonDist / msmax);
+
+        pfrac[i] = lane_fixangle(MoonAge) / 360.0;
+        mage[i] = synmonth * pfrac[i];
+    }
+}
+
+/*  PHASE_LANES_ITER_IMPL  --  Same as PHASE_LANES_IMPL,  given the sines
+                               and cosines of the Sun's mean anomaly (M)
+                               and of the argument of the evection
+                               (D = 2 ml - MM)  for each date.  Called
+                               through phase_lanes_iter().
+
+    The other sines and cosines that follow from these are derived
+    rather than computed:
+
+        - The Sun's true anomaly comes from the sine and cosine of the
+          eccentric anomaly,  which KEPLER_SUN computes anyway,  through
+          the tangent of its half.
+        - The evection is the sine of a difference,  D minus twice the
+          Sun's longitude,  which is doubled from its sine and cosine.
+        - The annual equation and A3 take the sine of M as is.
+
+    That leaves five of the eleven sines and cosines PHASE_LANES_IMPL
+    computes,  and the arc tangent.  */
+
+static KERNEL_INLINE void phase_lanes_iter_impl(
+  const double  *restrict pdate,      /* Dates for which to calculate phase */
+  const double  *restrict sinm,       /* Sines of M */
+  const double  *restrict cosm,       /* Cosines of M */
+  const double  *restrict sind,       /* Sines of D */
+  const double  *restrict cosd,       /* Cosines of D */
+  double  *restrict pfrac,            /* Terminator phase angles, 0 to 1 */
+  double  *restrict pphase,           /* Illuminated fractions */
+  double  *restrict mage,             /* Ages of moon in days */
+  double  *restrict dist,             /* Distances in kilometres */
+  double  *restrict angdia,           /* Angular diameters in degrees */
+  double  *restrict sudist,           /* Distances to Sun */
+  double  *restrict suangdia)         /* Sun's angular diameters */
+{
+    double sinp, cosp;
+    int i;
+
+    sinp = dsin(elongp);
+    cosp = dcos(elongp);
+
+    for (i = 0; i < PHASE_LANES; i++) {
+        double Day, N, M, se, ce, den, sinv, cosv, Ec, Lambdasun, sl, cl,
+               sin2l, cos2l, F, ml, MM, Ev, Ae, A3, MmP, mEc, A4, lP, V,
+               lPP, MoonAge, MoonDist;
+
+        /* Calculation of the Sun's position */
+
+        Day = pdate[i] - epoch;
+        N = lane_fixangle((360 / 365.2422) * Day);
+        M = lane_fixangle(N + elonge - elongp);
+
+        /* Equation of Kepler */
+        kepler_sun_sc(torad(M), sinm[i], cosm[i], &se, &ce);
+
+        /* True anomaly,  from the tangent of its half,  taken where it
+           is best conditioned */
+        den = 1 - eccent * ce;
+        cosv = (ce - eccent) / den;
+        sinv = sqrt(1 - eccent * eccent) * se / den;
+        Ec = (cosv >= 0) ? sinv / (1 + cosv) : (1 - cosv) / sinv;
+        Ec = 2 * todeg(lane_atan(Ec));
+        Lambdasun = lane_fixangle(Ec + elongp);
+
+        /* Sun's longitude, doubled */
+        sl = sinv * cosp + cosv * sinp;
+        cl = cosv * cosp - sinv * sinp;
+        sin2l = 2 * sl * cl;
+        cos2l = cl * cl - sl * sl;
+
+        F = (1 + eccent * cosv) / (1 - eccent * eccent);
+        sudist[i] = sunsmax / F;
+        suangdia[i] = F * sunangsiz;
+
+        /* Calculation of the Moon's position */
+
+        ml = lane_fixangle(13.1763966 * Day + mmlong);
+        MM = lane_fixangle(ml - 0.1114041 * Day - mmlongp);
+        Ev = 1.2739 * (sind[i] * cos2l - cosd[i] * sin2l);
+        Ae = 0.1858 * sinm[i];
+        A3 = 0.37 * sinm[i];
+        MmP = MM + Ev - Ae - A3;
+        mEc = 6.2886 * lane_dsin(MmP);
+        A4 = 0.214 * lane_dsin(2 * MmP);
+        lP = ml + Ev + mEc - Ae + A4;
+        V = 0.6583 * lane_dsin(2 * (lP - Lambdasun));
+        lPP = lP + V;
+
+        /* Calculation of the phase of the Moon */
+
+        MoonAge = lPP - Lambdasun;
+        pphase[i] = (1 - lane_dcos(MoonAge)) / 2;
+
+        MoonDist = (msmax * (1 - mecc * mecc)) /
+                   (1 + mecc * lane_dcos(MmP + mEc));
+        dist[i] = MoonDist;
+        angdia[i] = mangsiz / (MoonDist / msmax);
+
+        pfrac[i] = lane_fixangle(MoonAge) / 360.0;
+        mage[i] = synmonth * pfrac[i];
+    }
+}
+
+/*  Single precision.
+
+    PHASE_LANES_FLOAT_IMPL follows PHASE_LANES_IMPL in float,  so twice
+    as many lanes fit in a vector register.  Only the mean elements are
+    reduced from the date in double:  a float can't even hold a Julian
+    date to the day.  Sine and cosine use the Cephes sinf() and cosf()
+    polynomials.  The Sun's true anomaly comes from the series of the
+    equation of the centre,  to e^3,  rather than from KEPLER:  the
+    missing terms are well below float precision.
+
+    Between 1800 and 2200,  results agree with PHASE_LANES within:
+
+        fraction of lunation,  fraction illuminated    5e-7
+        age of the Moon                                 1e-5 days
+        distance to the Moon                            0.1 km
+        distance to the Sun                             25 km
+        angular diameters                               5e-7 degrees
+
+    That is,  within a few units in the last place of a float.  */
+
+#define LANE_ROUND_MAGICF 12582912.0f  /* 1.5 * 2^23 */
+
+/*  LANE_ROUNDF, LANE_FLOORF  --  Same as their double counterparts
+                                  (|x| < 2^22).  */
+
+static inline float lane_roundf(float x)
+{
+    return (x + LANE_ROUND_MAGICF) - LANE_ROUND_MAGICF;
+}
+
+static inline float lane_floorf(float x)
+{
+    float r = lane_roundf(x);
+    return (r > x) ? r - 1.0f : r;
+}
+
+/*  LANE_FIXANGLEF  --  Same as lane_fixangle(),  but strictly below 360:
+                        a tiny negative angle plus 360 rounds to 360
+                        much more often in float.  */
+
+static inline float lane_fixanglef(float a)
+{
+    a -= 360.0f * lane_floorf(a / 360.0f);
+    return (a >= 360.0f) ? a - 360.0f : a;
+}
+
+/*  LANE_DSINCOSF  --  Sine and cosine of an angle in degrees.  */
+
+static inline void lane_dsincosf(float x, float *sinx, float *cosx)
+{
+    float q, r, z, s, c, q4, odd;
+
+    q = lane_roundf(x / 90.0f);
+    r = (x - 90.0f * q) * (float) (PI / 180.0);
+    z = r * r;
+    s = r + r * z * (-1.6666654611e-1f
+            + z * ( 8.3321608736e-3f
+            + z *  -1.9515295891e-4f));
+    c = 1.0f - 0.5f * z + z * z * (4.166664568298827e-2f
+            + z * (-1.388731625493765e-3f
+            + z *   2.443315711809948e-5f));
+
+    q4 = q - 4.0f * lane_floorf(q * 0.25f);    /* Quadrant, 0 to 3 */
+    odd = q4 - 2.0f * lane_floorf(q4 * 0.5f);
+    *sinx = (q4 >= 2.0f) ? -((odd != 0.0f) ? c : s)
+                         :  ((odd != 0.0f) ? c : s);
+    *cosx = (q4 == 1.0f || q4 == 2.0f) ? -((odd != 0.0f) ? s : c)
+                                       :  ((odd != 0.0f) ? s : c);
+}
+
+static inline float lane_dsinf(float x)
+{
+    float s, c;
+    lane_dsincosf(x, &s, &c);
+    return s;
+}
+
+static inline float lane_dcosf(float x)
+{
+    float s, c;
+    lane_dsincosf(x, &s, &c);
+    return c;
+}
+
+/*  PHASE_LANES_FLOAT_IMPL  --  Calculate the phase of the Moon for
+                                PHASE_LANES_FLOAT dates,  in single
+                                precision.  Called through
+                                phase_lanes_float().  */
+
+static KERNEL_INLINE void phase_lanes_float_impl(
+  const double  *restrict pdate,      /* Dates for which to calculate phase */
+  float  *restrict pfrac,             /* Terminator phase angles, 0 to 1 */
+  float  *restrict pphase,            /* Illuminated fractions */
+  float  *restrict mage,              /* Ages of moon in days */
+  float  *restrict dist,              /* Distances in kilometres */
+  float  *restrict angdia,            /* Angular diameters in degrees */
+  float  *restrict sudist,            /* Distances to Sun */
+  float  *restrict suangdia)          /* Sun's angular diameters */
+{
+    int i;
+
+    for (i = 0; i < PHASE_LANES_FLOAT; i++) {
+        double Day, N, mld;
+        float M, MM, D, sm, cm, s2m, c2m, s3m, C, cEc, F, Ev, Ae, A3, MmP,
+              smp, cmp, mEc, A4, lP, V, MoonAge, MoonDist;
+
+        /* Mean elements,  in double precision.  Rather than the Moon's
+           and the Sun's longitudes,  only their difference is kept,
+           starting with the mean elongation D:  the sums below then
+           only add small terms to it. */
+
+        Day = pdate[i] - epoch;
+        N = lane_fixangle((360 / 365.2422) * Day);
+        M = (float) lane_fixangle(N + elonge - elongp);
+        mld = lane_fixangle(13.1763966 * Day + mmlong);
+        MM = (float) lane_fixangle(mld - 0.1114041 * Day - mmlongp);
+        D = (float) lane_fixangle(mld - N - elonge);
+
+        /* Calculation of the Sun's position */
+
+        lane_dsincosf(M, &sm, &cm);
+        s2m = 2 * sm * cm;
+        c2m = cm * cm - sm * sm;
+        s3m = s2m * cm + c2m * sm;
+        C = (float) (2 * eccent - eccent * eccent * eccent / 4) * sm
+            + (float) (1.25 * eccent * eccent) * s2m
+            + (float) (13.0 / 12.0 * eccent * eccent * eccent) * s3m;
+        cEc = cm * (1 - C * C / 2) - sm * (C - C * C * C / 6);
+        C *= (float) (180.0 / PI);    /* Equation of the centre */
+
+        F = 1 + (float) eccent * cEc;
+        sudist[i] = (float) (sunsmax * (1 - eccent * eccent)) / F;
+        suangdia[i] = F * (float) (sunangsiz / (1 - eccent * eccent));
+
+        /* Calculation of the Moon's position */
+
+        Ev = 1.2739f * lane_dsinf(2 * (D - C) - MM);
+        Ae = 0.1858f * sm;
+        A3 = 0.37f * sm;
+        MmP = MM + Ev - Ae - A3;
+        lane_dsincosf(MmP, &smp, &cmp);
+        mEc = 6.2886f * smp;
+        A4 = 0.214f * (2 * smp * cmp);
+        lP = (Ev + mEc - Ae + A4) - C;  /* Minus the Sun's longitude */
+        V = 0.6583f * lane_dsinf(2 * (D + lP));
+
+        /* Calculation of the phase of the Moon */
+
+        MoonAge = D + (lP + V);
+        pphase[i] = (1 - lane_dcosf(MoonAge)) / 2;
+
+        MoonDist = (float) (msmax * (1 - mecc * mecc)) /
+                   (1 + (float) mecc * lane_dcosf(MmP + mEc));
+        dist[i] = MoonDist;
+        angdia[i] = (float) mangsiz / (MoonDist / (float) msmax);
+
+        pfrac[i] = lane_fixanglef(MoonAge) / 360.0f;
+        mage[i] = (float) synmonth * pfrac[i];
+    }
+}
+
+/* CPU Dispatch */
+
+/*  The kernels of the batch routines,  phase_lanes(),
+    phase_lanes_iter(),  phase_lanes_float(),  truephases() and
+    jtouct(),  are compiled once per x86 instruction set level below,
+    and the most recent one the CPU supports is selected when the
+    program is loaded.  The generic variant targets whatever the
+    compiler was told to (SSE2 for x86-64 by default),  so a single
+    binary runs everywhere,  and still makes use of AVX2 or AVX-512
+    where available.
+
+    The selected variant is the library's only global variable.  It is
+    written once,  by a constructor,  before main() runs,  and only read
+    afterwards.
+
+    Setting the MOON_CPU environment variable to the name of a variant
+    (generic,  sse4,  avx2 or avx512)  forces it,  for testing and
+    benchmarking.  A variant the CPU doesn't support is never selected:
+    the override is then ignored.
+
+    All variants return exactly the same results.  Vector and scalar
+    instructions round alike,  and FMA is left out:  contracting a
+    multiplication and an addition would round differently.  AVX-512
+    implies FMA,  so contraction must stay disabled,  which it is with
+    GCC in ISO C modes (-std=c17),  and with clang by the FP_CONTRACT
+    pragma at the top of this file.
+
+    Dispatching needs GCC or clang,  for target attributes and
+    __builtin_cpu_supports(),  on x86.  Elsewhere,  or when compiled
+    with MOON_NO_DISPATCH defined,  the generic variant is the only
+    one.  */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && !defined(MOON_NO_DISPATCH)
+#define CPU_DISPATCH
+#endif
+
+#define CPU_TARGET_SSE4     __attribute__((target("sse4.2,popcnt")))
+#define CPU_TARGET_AVX2     __attribute__((target("avx2,bmi,bmi2,popcnt")))
+#ifdef __clang__
+#define CPU_TARGET_AVX512   __attribute__((target( \
+        "avx512f,avx512dq,avx512vl,avx512bw,avx2,bmi,bmi2,popcnt")))
+#else
+#define CPU_TARGET_AVX512   __attribute__((target( \
+        "avx512f,avx512dq,avx512vl,avx512bw,avx2,bmi,bmi2,popcnt," \
+        "prefer-vector-width=512")))
+#endif
+
+/*  CPU_KERNELS  --  Define the kernels of a variant,  each compiled
+                     for the given target from the inlined body.  */
+
+#define CPU_KERNELS(variant, target)                                        \
+    target static void phase_lanes_##variant(                               \
+      const double *restrict pdate, double *restrict pfrac,                 \
+      double *restrict pphase, double *restrict mage,                       \
+      double *restrict dist, double *restrict angdia,                       \
+      double *restrict sudist, double *restrict suangdia)                   \
+    {                                                                       \
+        phase_lanes_impl(pdate, pfrac, pphase, mage, dist, angdia,          \
+                         sudist, suangdia);                                 \
+    }                                                                       \
+                                                                            \
+    target static void phase_lanes_iter_##variant(                          \
+      const double *restrict pdate, const double *restrict sinm,            \
+      const double *restrict cosm, const double *restrict sind,             \
+      const double *restrict cosd, double *restrict pfrac,                  \
+      double *restrict pphase, double *restrict mage,                       \
+      double *restrict dist, double *restrict angdia,                       \
+      double *restrict sudist, double *restrict suangdia)                   \
+    {                                                                       \
+        phase_lanes_iter_impl(pdate, sinm, cosm, sind, cosd, pfrac, pphase, \
+                              mage, dist, angdia, sudist, suangdia);        \
+    }                                                                       \
+                                                                            \
+    target static void phase_lanes_float_##variant(                         \
+      const double *restrict pdate, float *restrict pfrac,                  \
+      float *restrict pphase, float *restrict mage,                         \
+      float *restrict dist, float *restrict angdia,                         \
+      float *restrict sudist, float *restrict suangdia)                     \
+    {                                                                       \
+        phase_lanes_float_impl(pdate, pfrac, pphase, mage, dist, angdia,    \
+                               sudist, suangdia);                           \
+    }                                                                       \
+                                                                            \
+    target static void truephases_##variant(double k, double phases[5])     \
+    {                                                                       \
+        truephases_impl(k, phases);                                         \
+    }                                                                       \
+                                                                            \
+    target static void jtouct_##variant(double utime, struct tm *gm)        \
+    {                                                                       \
+        jtouct_impl(utime, gm);                                             \
+    }
+
+CPU_KERNELS(generic, )
+
+static int cpu_supports_generic(void)
+{
+    return TRUE;
+}
+
+#ifdef CPU_DISPATCH
+
+CPU_KERNELS(sse4, CPU_TARGET_SSE4)
+CPU_KERNELS(avx2, CPU_TARGET_AVX2)
+CPU_KERNELS(avx512, CPU_TARGET_AVX512)
+
+static int cpu_supports_sse4(void)
+{
+    return __builtin_cpu_supports("sse4.2")
+           && __builtin_cpu_supports("popcnt");
+}
+
+static int cpu_supports_avx2(void)
+{
+    return cpu_supports_sse4()
+           && __builtin_cpu_supports("avx2")
+           && __builtin_cpu_supports("bmi")
+           && __builtin_cpu_supports("bmi2");
+}
+
+static int cpu_supports_avx512(void)
+{
+    return cpu_supports_avx2()
+           && __builtin_cpu_supports("avx512f")
+           && __builtin_cpu_supports("avx512dq")
+           && __builtin_cpu_supports("avx512vl")
+           && __builtin_cpu_supports("avx512bw");
+}
+
+#endif
+
+typedef struct {
+    const char *name;
+    int (*supports)(void);
+    void (*phase_lanes)(const double *restrict, double *restrict,
+                        double *restrict, double *restrict,
+                        double *restrict, double *restrict,
+                        double *restrict, double *restrict);
+    void (*phase_lanes_iter)(const double *restrict, const double *restrict,
+                             const double *restrict, const double *restrict,
+                             const double *restrict, double *restrict,
+                             double *restrict, double *restrict,
+                             double *restrict, double *restrict,
+                             double *restrict, double *restrict);
+    void (*phase_lanes_float)(const double *restrict, float *restrict,
+                              float *restrict, float *restrict,
+                              float *restrict, float *restrict,
+                              float *restrict, float *restrict);
+    void (*truephases)(double, double[5]);
+    void (*jtouct)(double, struct tm *);
+} CpuVariant;
+
+#define CPU_VARIANT(variant) \
+    { #variant, cpu_supports_##variant, phase_lanes_##variant, \
+      phase_lanes_iter_##variant, phase_lanes_float_##variant, truephases_##variant, jtouct_##variant }
+
+/*  Most recent first,  generic last.  */
+
+static const CpuVariant cpu_variants[] = {
+#ifdef CPU_DISPATCH
+    CPU_VARIANT(avx512),
+    CPU_VARIANT(avx2),
+    CPU_VARIANT(sse4),
+#endif
+    CPU_VARIANT(generic)
+};
+
+#define CPU_VARIANTS (sizeof cpu_variants / sizeof cpu_variants[0])
+
+static const CpuVariant *cpu_variant = &cpu_variants[CPU_VARIANTS - 1];
+
+/*  CPU_FIND  --  Variant of the given name,  or NULL if there is none
+                  or the CPU doesn't support it.  */
+
+static const CpuVariant *cpu_find(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < CPU_VARIANTS; i++) {
+        if (strcmp(name, cpu_variants[i].name) == 0)
+            return cpu_variants[i].supports() ? &cpu_variants[i] : NULL;
+    }
+    return NULL;
+}
+
+/*  CPU_DISPATCH_INIT  --  Select the variant,  once,  at load time.  */
+
+#ifdef __GNUC__
+__attribute__((constructor))
+static void cpu_dispatch_init(void)
+{
+    const char *name;
+    const CpuVariant *forced;
+    size_t i;
+
+#ifdef CPU_DISPATCH
+    __builtin_cpu_init();
+#endif
+
+    name = getenv("MOON_CPU");
+    forced = (name != NULL) ? cpu_find(name) : NULL;
+    if (forced != NULL) {
+        cpu_variant = forced;
+        return;
+    }
+
+    for (i = 0; !cpu_variants[i].supports(); i++)
+        ;
+    cpu_variant = &cpu_variants[i];
+}
+#endif
+
+const char *moon_cpu_variant(void)
+{
+    return cpu_variant->name;
+}
+
+static void phase_lanes(const double *restrict pdate, double *restrict pfrac,
+                        double *restrict pphase, double *restrict mage,
+                        double *restrict dist, double *restrict angdia,
+                        double *restrict sudist, double *restrict suangdia)
+{
+    cpu_variant->phase_lanes(pdate, pfrac, pphase, mage, dist, angdia,
+                             sudist, suangdia);
+}
+
+static void phase_lanes_iter(const double *restrict pdate,
+                             const double *restrict sinm,
+                             const double *restrict cosm,
+                             const double *restrict sind,
+                             const double *restrict cosd,
+                             double *restrict pfrac, double *restrict pphase,
+                             double *restrict mage, double *restrict dist,
+                             double *restrict angdia, double *restrict sudist,
+                             double *restrict suangdia)
+{
+    cpu_variant->phase_lanes_iter(pdate, sinm, cosm, sind, cosd, pfrac, pphase,
+                                  mage, dist, angdia, sudist, suangdia);
+}
+
+static void phase_lanes_float(const double *restrict pdate,
+                              float *restrict pfrac, float *restrict pphase,
+                              float *restrict mage, float *restrict dist,
+                              float *restrict angdia, float *restrict sudist,
+                              float *restrict suangdia)
+{
+    cpu_variant->phase_lanes_float(pdate, pfrac, pphase, mage, dist, angdia,
+                                   sudist, suangdia);
+}
+
+static void truephases(double k, double phases[5])
+{
+    cpu_variant->truephases(k, phases);
+}
+
+static void jtouct(double utime, struct tm *gm)
+{
+    cpu_variant->jtouct(utime, gm);
+}
+
+/* Range Evaluation */
+
+/*  MOONPHASE_RANGE and MOONCAL_RANGE split the range into one contiguous
+    slice per thread.  Slices are whole multiples of RANGE_ALIGN elements
+    (at least a cache line's worth), so threads never write to the same
+    cache line,  save for one at each boundary, once.  Threads are created
+    per call:  a persistent pool would be global state.  */
+
+#define RANGE_MAX_THREADS   256
+#define RANGE_MIN_SLICE     64        /* Don't start a thread for less */
+#define RANGE_ALIGN         8
+
+typedef struct {
+    MoonPhase *mphases;               /* One of the two is set */
+    MoonCalendar *mcals;
+    time_t start;
+    long step;
+    size_t first, count;
+    int ok;
+} RangeSlice;
+
+static void *range_slice(void *arg)
+{
+    RangeSlice *slice = arg;
+    time_t t;
+    size_t i;
+
+    slice->ok = TRUE;
+    for (i = slice->first; i < slice->first + slice->count; i++) {
+        t = slice->start + (time_t) i * slice->step;
+        if (slice->mphases != NULL) {
+            if (!moonphase(&slice->mphases[i], &t))
+                slice->ok = FALSE;
+        } else {
+            if (!mooncal(&slice->mcals[i], &t))
+                slice->ok = FALSE;
+        }
+    }
+    return NULL;
+}
+
+/*  RANGE_THREADS  --  Number of threads to use for count elements.  */
+
+static size_t range_threads(size_t count, int threads)
+{
+    size_t n;
+
+    if (threads <= 0) {
+#ifndef _WIN32
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cores > 0) ? (int) cores : 1;
+#else
+        threads = 1;
+#endif
+    }
+    n = (size_t) threads;
+    if (n > RANGE_MAX_THREADS)
+        n = RANGE_MAX_THREADS;
+    if (n > count / RANGE_MIN_SLICE)
+        n = count / RANGE_MIN_SLICE;
+    return (n > 0) ? n : 1;
+}
+
+static int range_run(MoonPhase *mphases, MoonCalendar *mcals,
+                     const time_t *start, long step, size_t count,
+                     int threads)
+{
+    RangeSlice slices[RANGE_MAX_THREADS];
+    size_t n, per, i, first;
+    time_t t;
+    int ok;
+#ifndef _WIN32
+    pthread_t tids[RANGE_MAX_THREADS];
+    int started[RANGE_MAX_THREADS];
+#endif
+
+    if (start == NULL)
+        t = time(NULL);
+    else
+        t = *start;
+
+    n = range_threads(count, threads);
+    per = (count + n - 1) / n;
+    per = (per + RANGE_ALIGN - 1) / RANGE_ALIGN * RANGE_ALIGN;
+
+    for (i = 0, first = 0; i < n; i++) {
+        slices[i].mphases = mphases;
+        slices[i].mcals = mcals;
+        slices[i].start = t;
+        slices[i].step = step;
+        slices[i].first = first;
+        slices[i].count = (count - first < per) ? count - first : per;
+        first += slices[i].count;
+    }
+
+    /* The calling thread takes the first slice.  If a thread can't be
+       started,  its slice is done here too. */
+
+#ifndef _WIN32
+    for (i = 1; i < n; i++)
+        started[i] = pthread_create(&tids[i], NULL, range_slice,
+                                    &slices[i]) == 0;
+    range_slice(&slices[0]);
+    for (i = 1; i < n; i++) {
+        if (started[i])
+            pthread_join(tids[i], NULL);
+        else
+            range_slice(&slices[i]);
+    }
+#else
+    for (i = 0; i < n; i++)
+        range_slice(&slices[i]);
+#endif
+
+    ok = TRUE;
+    for (i = 0; i < n; i++)
+        ok = ok && slices[i].ok;
+    return ok;
+}
+
+int moonphase_range(MoonPhase *mphases, const time_t *start, long step,
+                    size_t count, int threads)
+{
+    return range_run(mphases, NULL, start, step, count, threads);
+}
+
+int mooncal_range(MoonCalendar *mcals, const time_t *start, long step,
+                  size_t count, int threads)
+{
+    return range_run(NULL, mcals, start, step, count, threads);
+}
+
+/* Threshold Crossings */
+
+/*  The Moon's elongation from the Sun always increases,  so the fraction
+    of lunation returned by phase() sweeps [0, 1) exactly once per
+    lunation.  Thresholds on the age and the fraction illuminated are
+    mapped to targets on it:  an age a is crossed at a / synmonth,  an
+    illumination x at acos(1 - 2x) / 2pi waxing,  and at one minus that
+    waning.  Each target is thus crossed once per lunation,  and its
+    time is bracketed around where it would fall if the lunation,  from
+    the new moons given by truephase(),  progressed uniformly.  */
+
+#define CROSSING_BRACKET    2.0       /* Initial half-width, days */
+#define CROSSING_MAX_WIDEN  8
+#define CROSSING_MAX_ITER   100
+
+/*  CROSSING_OFFSET  --  Signed distance from the fraction of lunation at
+                         pdate to the target,  in (-0.5, 0.5].  It goes
+                         from negative to positive at the crossing.  */
+
+static double crossing_offset(double pdate, double target)
+{
+    double pphase, mage, dist, angdia, sudist, suangdia, d;
+
+    d = phase(pdate, &pphase, &mage, &dist, &angdia, &sudist, &suangdia)
+        - target;
+    if (d > 0.5)
+        d -= 1.0;
+    else if (d <= -0.5)
+        d += 1.0;
+    return d;
+}
+
+/*  CROSSING_REFINE  --  Brent's method:  inverse quadratic interpolation
+                         or secant steps,  falling back to bisection
+                         whenever they would leave the bracket or fail
+                         to shrink it fast enough.  Returns a date within
+                         tol of the crossing in [a, b],  where fa <= 0
+                         <= fb.  */
+
+static double crossing_refine(double target, double a, double b,
+                              double fa, double fb, double tol)
+{
+    double c, fc, d, e, tol1, xm, p, q, r, s;
+    int iter;
+
+    c = a;
+    fc = fa;
+    d = e = b - a;
+
+    for (iter = 0; iter < CROSSING_MAX_ITER; iter++) {
+        if (abs(fc) < abs(fb)) {
+            a = b;  b = c;  c = a;
+            fa = fb;  fb = fc;  fc = fa;
+        }
+        tol1 = 2.0 * DBL_EPSILON * abs(b) + 0.5 * tol;
+        xm = 0.5 * (c - b);
+        if (abs(xm) <= tol1 || fb == 0.0)
+            break;
+
+        if (abs(e) >= tol1 && abs(fa) > abs(fb)) {
+            s = fb / fa;
+            if (a == c) {
+                p = 2.0 * xm * s;
+                q = 1.0 - s;
+            } else {
+                q = fa / fc;
+                r = fb / fc;
+                p = s * (2.0 * xm * q * (q - r) - (b - a) * (r - 1.0));
+                q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+            }
+            if (p > 0.0)
+                q = -q;
+            else
+                p = -p;
+            if (2.0 * p < 3.0 * xm * q - abs(tol1 * q)
+                && p < abs(0.5 * e * q)) {
+                e = d;
+                d = p / q;
+            } else {
+                d = xm;
+                e = d;
+            }
+        } else {
+            d = xm;
+            e = d;
+        }
+
+        a = b;
+        fa = fb;
+        b += (abs(d) > tol1) ? d : ((xm > 0.0) ? tol1 : -tol1);
+        fb = crossing_offset(b, target);
+
+        if ((fb > 0.0 && fc > 0.0) || (fb < 0.0 && fc < 0.0)) {
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+    }
+    return b;
+}
+
+/*  CROSSING_FIND  --  Crossing of target in the lunation starting with
+                       the new moon at newmoon,  and ending at nextnew.  */
+
+static double crossing_find(double target, double newmoon, double nextnew,
+                            double tol)
+{
+    double guess, a, b, fa, fb;
+    int i;
+
+    guess = newmoon + target * (nextnew - newmoon);
+    a = guess - CROSSING_BRACKET;
+    b = guess + CROSSING_BRACKET;
+    fa = crossing_offset(a, target);
+    fb = crossing_offset(b, target);
+
+    /* Never needed in practice:  the lunation doesn't stray that far
+       from uniform progress. */
+
+    for (i = 0; fa > 0.0 && i < CROSSING_MAX_WIDEN; i++) {
+        a -= CROSSING_BRACKET;
+        fa = crossing_offset(a, target);
+    }
+    for (i = 0; fb < 0.0 && i < CROSSING_MAX_WIDEN; i++) {
+        b += CROSSING_BRACKET;
+        fb = crossing_offset(b, target);
+    }
+
+    return crossing_refine(target, a, b, fa, fb, tol);
+}
+
+/*  CROSSING_SCAN  --  Crossings in [from, to),  in direction (0 = both).
+                       If stop,  the scan ends once capacity is reached.
+                       If crossings is NULL,  they are only counted.  */
+
+static int crossing_scan(MoonCrossing *crossings, size_t capacity,
+                         int quantity, double threshold, int direction,
+                         double from, double to, double tolerance,
+                         int stop, size_t *count)
+{
+    double targets[2], newmoon, nextnew, k, t, phases[4], guess, reach;
+    int rising[2], ntargets, i;
+    long lunation;
+    size_t n = 0;
+
+    *count = 0;
+
+    if (quantity == MOON_CROSSING_FRACTION_ILLUMINATED) {
+        if (!(threshold > 0.0 && threshold < 1.0))
+            return FALSE;
+        targets[0] = acos(1.0 - 2.0 * threshold) / (2.0 * PI);
+        targets[1] = 1.0 - targets[0];
+        rising[0] = TRUE;
+        rising[1] = FALSE;
+        ntargets = 2;
+    } else if (quantity == MOON_CROSSING_AGE) {
+        if (!(threshold >= 0.0 && threshold < synmonth))
+            return FALSE;
+        targets[0] = threshold / synmonth;
+        rising[0] = TRUE;
+        ntargets = 1;
+    } else {
+        return FALSE;
+    }
+
+    if (tolerance < 0.0)
+        tolerance = 0.0;
+
+    /* CROSSING_FIND never strays further than this from its guess. */
+
+    reach = CROSSING_BRACKET * (CROSSING_MAX_WIDEN + 1) + tolerance;
+
+    /* lunation_k() goes by mean new moons;  the true one may be up to a
+       day later,  so start one lunation earlier.  Crossings near new
+       moon may precede the lunation's true new moon a little. */
+
+    k = lunation_k(from) - 1;
+    if (!lunation_table_phases(k, phases, &lunation))
+        phases[0] = truephase(k, 0.0);
+    nextnew = phases[0];
+
+    for (; nextnew - CROSSING_BRACKET < to; k++) {
+        newmoon = nextnew;
+        if (!lunation_table_phases(k + 1, phases, &lunation))
+            phases[0] = truephase(k + 1, 0.0);
+        nextnew = phases[0];
+
+        for (i = 0; i < ntargets; i++) {
+            if ((direction > 0 && !rising[i])
+                || (direction < 0 && rising[i]))
+                continue;
+
+            /* When counting,  only crossings near an end of the range
+               need finding. */
+            if (crossings == NULL) {
+                guess = newmoon + targets[i] * (nextnew - newmoon);
+                if (guess + reach < from || guess - reach >= to)
+                    continue;
+                if (guess - reach >= from && guess + reach < to) {
+                    n++;
+                    continue;
+                }
+            }
+
+            t = crossing_find(targets[i], newmoon, nextnew, tolerance);
+            if (t < from || t >= to)
+                continue;
+            if (crossings != NULL && n < capacity) {
+                crossings[n].date = t;
+                jtouct(t, &crossings[n].date_utc);
+                crossings[n].rising = rising[i];
+            }
+            n++;
+            if (stop && n >= capacity) {
+                *count = n;
+                return TRUE;
+            }
+        }
+    }
+
+    *count = n;
+    return n <= capacity;
+}
+
+int moonphase_crossings(MoonCrossing *crossings, size_t capacity,
+                        int quantity, double threshold, double from_jd,
+                        double to_jd, double tolerance, size_t *count)
+{
+    /* Nothing is written unless all crossings fit,  so count them first,
+       unless there is room for two every 29 days,  which is more than
+       there can be:  a synodic month is always longer. */
+
+    if (!(to_jd - from_jd < 29.0 * ((double) (capacity / 2) - 1))) {
+        if (!crossing_scan(NULL, SIZE_MAX, quantity, threshold, 0,
+                           from_jd, to_jd, tolerance, FALSE, count))
+            return FALSE;
+        if (*count > capacity)
+            return FALSE;
+    }
+
+    return crossing_scan(crossings, capacity, quantity, threshold, 0,
+                         from_jd, to_jd, tolerance, FALSE, count);
+}
+
+int moonphase_next_crossing(MoonCrossing *crossing, int quantity,
+                            double threshold, int direction,
+                            double after_jd, double tolerance)
+{
+    size_t count;
+
+    /* Every target is crossed once per lunation:  two are plenty. */
+
+    return crossing_scan(crossing, 1, quantity, threshold, direction,
+                         after_jd, after_jd + 2.0 * synmonth, tolerance,
+                         TRUE, &count)
+           && count == 1;
+}
+
+/* Apsides */
+
+/*  In phase(),  the Moon's distance depends only on its corrected true
+    anomaly,  MmP + mEc,  which always increases:  perigees are exactly
+    where it is 0 degrees,  and apogees where it is 180.  Apsis n is the
+    one the mean anomaly,  which is linear in time,  reaches n * 180
+    degrees at,  even ones being perigees.  The true anomaly never strays
+    more than a few degrees from the mean,  so each apsis lies within a
+    day of that date,  and is refined by Newton's method from there.  */
+
+#define APSIS_RATE       13.0649925   /* Mean anomaly, degrees per day */
+#define APSIS_EVECTION   11.3165061   /* Argument of evection, deg/day */
+#define APSIS_BRACKET    1.5          /* Half-width of bracket, days */
+#define APSIS_MAX_ITER   50
+#define APSIS_TOLERANCE  1E-6         /* Days, for syzygy classification */
+#define APSIS_NOISE      1E-9         /* Days;  two ulps of a Julian date */
+
+/*  APSIS_MEAN  --  Date of mean apsis n.  */
+
+static double apsis_mean(double n)
+{
+    return epoch + (n * 180.0 - (mmlong - mmlongp)) / APSIS_RATE;
+}
+
+/*  APSIS_INDEX  --  Index of the last mean apsis at or before pdate.  */
+
+static double apsis_index(double pdate)
+{
+    return floor(((pdate - epoch) * APSIS_RATE + (mmlong - mmlongp))
+                 / 180.0);
+}
+
+/*  APSIS_OFFSET  --  Signed difference between the true anomaly at pdate
+                      and target,  in (-180, 180],  and its rate of
+                      change,  in degrees per day.  The steps are those
+                      of phase().  */
+
+static double apsis_offset(double pdate, double target, double *rate)
+{
+    double Day, N, M, Ec, Lambdasun, ml, MM, Ev, Ae, A3, MmP, mEc, d;
+
+    Day = pdate - epoch;
+    N = fixangle((360 / 365.2422) * Day);
+    M = fixangle(N + elonge - elongp);
+    Ec = kepler_sun(M);
+    Ec = sqrt((1 + eccent) / (1 - eccent)) * tan(Ec / 2);
+    Ec = 2 * todeg(atan(Ec));
+    Lambdasun = fixangle(Ec + elongp);
+
+    ml = fixangle(13.1763966 * Day + mmlong);
+    MM = fixangle(ml - 0.1114041 * Day - mmlongp);
+    Ev = 1.2739 * sin(torad(2 * (ml - Lambdasun) - MM));
+    Ae = 0.1858 * sin(torad(M));
+    A3 = 0.37 * sin(torad(M));
+    MmP = MM + Ev - Ae - A3;
+    mEc = 6.2886 * sin(torad(MmP));
+
+    /* The annual terms are too slow to matter to the rate. */
+
+    *rate = (APSIS_RATE + 1.2739 * torad(APSIS_EVECTION)
+                          * cos(torad(2 * (ml - Lambdasun) - MM)))
+            * (1 + torad(6.2886) * cos(torad(MmP)));
+
+    d = fixangle(MmP + mEc - target);
+    return (d > 180.0) ? d - 360.0 : d;
+}
+
+/*  APSIS_FIND  --  Date of apsis n,  to within tol.  Newton steps which
+                    would leave the bracket are replaced by bisection.  */
+
+static double apsis_find(double n, double tol)
+{
+    double target, t, a, b, d, rate, step;
+    int iter;
+
+    if (tol < APSIS_NOISE)
+        tol = APSIS_NOISE;
+    target = fixangle(n * 180.0);
+    t = apsis_mean(n);
+    a = t - APSIS_BRACKET;
+    b = t + APSIS_BRACKET;
+
+    for (iter = 0; iter < APSIS_MAX_ITER; iter++) {
+        d = apsis_offset(t, target, &rate);
+        if (d < 0.0)
+            a = t;
+        else
+            b = t;
+        step = d / rate;
+        if (abs(step) <= tol) {
+            t -= step;
+            break;
+        }
+        t -= step;
+        if (!(t > a && t < b))
+            t = 0.5 * (a + b);
+    }
+    return t;
+}
+
+static double apsis_distance(double pdate)
+{
+    double pphase, mage, dist, angdia, sudist, suangdia;
+
+    phase(pdate, &pphase, &mage, &dist, &angdia, &sudist, &suangdia);
+    return dist;
+}
+
+int moonphase_apsides(MoonApsis *apsides, size_t capacity, double from_jd,
+                      double to_jd, double tolerance, size_t *count)
+{
+    double n, first, last, t, reach;
+    size_t found = 0;
+
+    first = apsis_index(from_jd) - 1;
+    last = apsis_index(to_jd) + 1;
+
+    /* Nothing is written unless all apsides fit,  so count them first,
+       unless every candidate does.  APSIS_FIND stays within its bracket
+       (give or take the tolerance),  so only apsides near an end of the
+       range need finding. */
+
+    if (last - first + 1 > (double) capacity) {
+        reach = APSIS_BRACKET + ((tolerance > APSIS_NOISE) ? tolerance
+                                                           : APSIS_NOISE);
+        for (n = first; n <= last; n++) {
+            t = apsis_mean(n);
+            if (t + reach < from_jd || t - reach >= to_jd)
+                continue;
+            if (t - reach < from_jd || t + reach >= to_jd) {
+                t = apsis_find(n, tolerance);
+                if (t < from_jd || t >= to_jd)
+                    continue;
+            }
+            found++;
+        }
+        if (found > capacity) {
+            *count = found;
+            return FALSE;
+        }
+        found = 0;
+    }
+
+    for (n = first; n <= last; n++) {
+        t = apsis_find(n, tolerance);
+        if (t < from_jd || t >= to_jd)
+            continue;
+        if (found < capacity) {
+            apsides[found].date = t;
+            jtouct(t, &apsides[found].date_utc);
+            apsides[found].apogee = fmod(n, 2.0) != 0.0;
+            apsides[found].distance_to_earth_km = apsis_distance(t);
+        }
+        found++;
+    }
+
+    *count = found;
+    return found <= capacity;
+}
+
+/*  SYZYGY_PHASES  --  Dates of the new and full moons of lunation k,
+                       in phases[0] and phases[2].  */
+
+static void syzygy_phases(double k, double phases[4])
+{
+    long lunation;
+
+    if (!lunation_table_phases(k, phases, &lunation)) {
+        phases[0] = truephase(k, 0.0);
+        phases[2] = truephase(k, 0.5);
+    }
+}
+
+/*  MOONCAL_SYZYGIES  --  New and full moons,  each placed between the
+                          apsides either side of it.  Both phases and
+                          apsides come in order,  so the pair is only
+                          ever moved forward.  */
+
+int mooncal_syzygies(MoonSyzygy *syzygies, size_t capacity, double from_jd,
+                     double to_jd, double closeness, size_t *count)
+{
+    double k, n, phases[4], t, lo, hi, dlo, dhi, d, perigee, apogee;
+    size_t found = 0;
+    int i;
+
+    *count = 0;
+    if (!(closeness >= 0.5 && closeness <= 1.0))
+        return FALSE;
+
+    /* Nothing is written unless all of them fit,  so count them first:
+       that only takes the dates of the phases. */
+
+    for (k = lunation_k(from_jd) - 1; ; k++) {
+        syzygy_phases(k, phases);
+        if (phases[0] >= to_jd)
+            break;
+        for (i = 0; i < 4; i += 2) {
+            if (phases[i] >= from_jd && phases[i] < to_jd)
+                found++;
+        }
+    }
+    if (found > capacity) {
+        *count = found;
+        return FALSE;
+    }
+    found = 0;
+
+    n = apsis_index(from_jd) - 1;
+    lo = apsis_find(n, APSIS_TOLERANCE);
+    hi = apsis_find(n + 1, APSIS_TOLERANCE);
+    dlo = apsis_distance(lo);
+    dhi = apsis_distance(hi);
+
+    /* As in mooncal_year(),  start one lunation early. */
+
+    for (k = lunation_k(from_jd) - 1; ; k++) {
+        syzygy_phases(k, phases);
+        if (phases[0] >= to_jd)
+            break;
+
+        for (i = 0; i < 4; i += 2) {
+            t = phases[i];
+            if (t < from_jd || t >= to_jd)
+                continue;
+
+            while (hi <= t) {
+                n++;
+                lo = hi;
+                dlo = dhi;
+                hi = apsis_find(n + 1, APSIS_TOLERANCE);
+                dhi = apsis_distance(hi);
+            }
+
+            if (found < capacity) {
+                if (fmod(n, 2.0) == 0.0) {
+                    perigee = dlo;
+                    apogee = dhi;
+                } else {
+                    perigee = dhi;
+                    apogee = dlo;
+                }
+                d = apsis_distance(t);
+                syzygies[found].date = t;
+                jtouct(t, &syzygies[found].date_utc);
+                syzygies[found].phase = i;
+                syzygies[found].distance_to_earth_km = d;
+                syzygies[found].closeness = (apogee - d) / (apogee - perigee);
+                if (syzygies[found].closeness >= closeness)
+                    syzygies[found].supermoon = 1;
+                else if (syzygies[found].closeness <= 1.0 - closeness)
+                    syzygies[found].supermoon = -1;
+                else
+                    syzygies[found].supermoon = 0;
+            }
+            found++;
+        }
+    }
+
+    *count = found;
+    return found <= capacity;
+}
+
+/* Precision Tiers */
+
+/*  PHASE is the STANDARD tier.  The two others share its interface.
+
+    FAST keeps only the main terms of PHASE.  It solves the Sun's orbit
+    with the first term of the equation of the centre instead of KEPLER,
+    and drops the two smallest corrections to the Moon's anomaly and
+    longitude (A3 and A4).  It also gets the Moon's distance without
+    another sine.  That takes about half as many trigonometric
+    functions.
+
+    HIGH follows Meeus,  "Astronomical Algorithms" (2nd ed.).  The
+    Moon's position comes from the main periodic terms of ELP-2000/82
+    (chapter 47),  the Sun's from its low accuracy formulae
+    (chapter 25),  and the illuminated fraction from the phase angle
+    (chapter 48).  Both bodies are computed in dynamical time,  which
+    differs from UT by DELTA_T.  The age and the fraction of lunation
+    still come from the elongation in longitude,  as in PHASE.  Rather
+    than 240 sines and cosines,  the periodic terms are summed from the
+    sines and cosines of the multiples of their four arguments.  */
+
+#define MEEUS_J2000         2451545.0     /* 2000 January 1.5 TD */
+#define MEEUS_DELTA0        385000.56     /* Mean distance of the Moon, km */
+#define MEEUS_ABERRATION    0.005691611   /* Aberration of the Sun,
+                                             degrees at 1 AU */
+
+/*  Periodic terms for the Moon's longitude and distance (Meeus, table
+    47.A):  multiples of D, M, M', F,  then the coefficients of the sine
+    (10^-6 degree) and cosine (10^-3 km).  */
+
+static const long meeus_lr[60][6] = {
+    {0,  0,  1,  0, 6288774, -20905355}, {2,  0, -1,  0, 1274027, -3699111},
+    {2,  0,  0,  0,  658314,  -2955968}, {0,  0,  2,  0,  213618,  -569925},
+    {0,  1,  0,  0, -185116,     48888}, {0,  0,  0,  2, -114332,    -3149},
+    {2,  0, -2,  0,   58793,    246158}, {2, -1, -1,  0,   57066,  -152138},
+    {2,  0,  1,  0,   53322,   -170733}, {2, -1,  0,  0,   45758,  -204586},
+    {0,  1, -1,  0,  -40923,   -129620}, {1,  0,  0,  0,  -34720,   108743},
+    {0,  1,  1,  0,  -30383,    104755}, {2,  0,  0, -2,   15327,    10321},
+    {0,  0,  1,  2,  -12528,         0}, {0,  0,  1, -2,   10980,    79661},
+    {4,  0, -1,  0,   10675,    -34782}, {0,  0,  3,  0,   10034,   -23210},
+    {4,  0, -2,  0,    8548,    -21636}, {2,  1, -1,  0,   -7888,    24208},
+    {2,  1,  0,  0,   -6766,     30824}, {1,  0, -1,  0,   -5163,    -8379},
+    {1,  1,  0,  0,    4987,    -16675}, {2, -1,  1,  0,    4036,   -12831},
+    {2,  0,  2,  0,    3994,    -10445}, {4,  0,  0,  0,    3861,   -11650},
+    {2,  0, -3,  0,    3665,     14403}, {0,  1, -2,  0,   -2689,    -7003},
+    {2,  0, -1,  2,   -2602,         0}, {2, -1, -2,  0,    2390,    10056},
+    {1,  0,  1,  0,   -2348,      6322}, {2, -2,  0,  0,    2236,    -9884},
+    {0,  1,  2,  0,   -2120,      5751}, {0,  2,  0,  0,   -2069,        0},
+    {2, -2, -1,  0,    2048,     -4950}, {2,  0,  1, -2,   -1773,     4130},
+    {2,  0,  0,  2,   -1595,         0}, {4, -1, -1,  0,    1215,    -3958},
+    {0,  0,  2,  2,   -1110,         0}, {3,  0, -1,  0,    -892,     3258},
+    {2,  1,  1,  0,    -810,      2616}, {4, -1, -2,  0,     759,    -1897},
+    {0,  2, -1,  0,    -713,     -2117}, {2,  2, -1,  0,    -700,     2354},
+    {2,  1, -2,  0,     691,         0}, {2, -1,  0, -2,     596,        0},
+    {4,  0,  1,  0,     549,     -1423}, {0,  0,  4,  0,     537,    -1117},
+    {4, -1,  0,  0,     520,     -1571}, {1,  0, -2,  0,    -487,    -1739},
+    {2,  1,  0, -2,    -399,         0}, {0,  0,  2, -2,    -381,    -4421},
+    {1,  1,  1,  0,     351,         0}, {3,  0, -2,  0,    -340,        0},
+    {4,  0, -3,  0,     330,         0}, {2, -1,  2,  0,     327,        0},
+    {0,  2,  1,  0,    -323,      1165}, {1,  1, -1,  0,     299,        0},
+    {2,  0,  3,  0,     294,         0}, {2,  0, -1, -2,       0,     8752}
+};
+
+/*  Periodic terms for the Moon's latitude (Meeus, table 47.B):  multiples
+    of D, M, M', F,  then the coefficient of the sine (10^-6 degree).  */
+
+static const long meeus_b[60][5] = {
+    {0,  0,  0,  1, 5128122}, {0,  0,  1,  1,  280602}, {0,  0,  1, -1,  277693},
+    {2,  0,  0, -1,  173237}, {2,  0, -1,  1,   55413}, {2,  0, -1, -1,   46271},
+    {2,  0,  0,  1,   32573}, {0,  0,  2,  1,   17198}, {2,  0,  1, -1,    9266},
+    {0,  0,  2, -1,    8822}, {2, -1,  0, -1,    8216}, {2,  0, -2, -1,    4324},
+    {2,  0,  1,  1,    4200}, {2,  1,  0, -1,   -3359}, {2, -1, -1,  1,    2463},
+    {2, -1,  0,  1,    2211}, {2, -1, -1, -1,    2065}, {0,  1, -1, -1,   -1870},
+    {4,  0, -1, -1,    1828}, {0,  1,  0,  1,   -1794}, {0,  0,  0,  3,   -1749},
+    {0,  1, -1,  1,   -1565}, {1,  0,  0,  1,   -1491}, {0,  1,  1,  1,   -1475},
+    {0,  1,  1, -1,   -1410}, {0,  1,  0, -1,   -1344}, {1,  0,  0, -1,   -1335},
+    {0,  0,  3,  1,    1107}, {4,  0,  0, -1,    1021}, {4,  0, -1,  1,     833},
+    {0,  0,  1, -3,     777}, {4,  0, -2,  1,     671}, {2,  0,  0, -3,     607},
+    {2,  0,  2, -1,     596}, {2, -1,  1, -1,     491}, {2,  0, -2,  1,    -451},
+    {0,  0,  3, -1,     439}, {2,  0,  2,  1,     422}, {2,  0, -3, -1,     421},
+    {2,  1, -1,  1,    -366}, {2,  1,  0,  1,    -351}, {4,  0,  0,  1,     331},
+    {2, -1,  1,  1,     315}, {2, -2,  0, -1,     302}, {0,  0,  1,  3,    -283},
+    {2,  1,  1, -1,    -229}, {1,  1,  0, -1,     223}, {1,  1,  0,  1,     223},
+    {0,  1, -2, -1,    -220}, {2,  1, -1, -1,    -220}, {1,  0,  1,  1,    -185},
+    {2, -1, -2, -1,     181}, {0,  1,  2,  1,    -177}, {4,  0, -2, -1,     176},
+    {4, -1, -1, -1,     166}, {1,  0,  1, -1,    -164}, {4,  0,  1, -1,     132},
+    {1,  0, -1, -1,    -119}, {4, -1,  0, -1,     115}, {2, -2,  0,  1,     107}
+};
+
+/*  PHASE_FAST  --  Same as PHASE,  with fewer terms.  */
+
+static double phase_fast(
+  double  pdate,                      /* Date for which to calculate phase */
+  double  *pphase,                    /* Illuminated fraction */
+  double  *mage,                      /* Age of moon in days */
+  double  *dist,                      /* Distance in kilometres */
+  double  *angdia,                    /* Angular diameter in degrees */
+  double  *sudist,                    /* Distance to Sun */
+  double  *suangdia)                  /* Sun's angular diameter */
+{
+    double Day, M, sm, cm, Ec, Lambdasun, F, ml, MM, Ev, Ae, MmP, mEc,
+           lP, MoonAge, MoonDist;
+
+    /* Calculation of the Sun's position */
+
+    Day = pdate - epoch;
+    M = torad(fixangle((360 / 365.2422) * Day + elonge - elongp));
+    sm = sin(M);
+    cm = cos(M);
+    Ec = 2 * eccent * sm;             /* Equation of the centre, radians */
+    Lambdasun = todeg(M + Ec) + elongp;
+
+    F = (1 + eccent * (cm - sm * Ec)) / (1 - eccent * eccent);
+    *sudist = sunsmax / F;
+    *suangdia = F * sunangsiz;
+
+    /* Calculation of the Moon's position */
+
+    ml = fixangle(13.1763966 * Day + mmlong);
+    MM = fixangle(ml - 0.1114041 * Day - mmlongp);
+    Ev = 1.2739 * dsin(2 * (ml - Lambdasun) - MM);
+    Ae = 0.1858 * sm;
+    MmP = torad(MM + Ev - Ae);
+    mEc = 6.2886 * sin(MmP);
+    lP = ml + Ev + mEc - Ae;
+
+    /* Calculation of the phase of the Moon */
+
+    MoonAge = lP + 0.6583 * dsin(2 * (lP - Lambdasun)) - Lambdasun;
+    *pphase = (1 - dcos(MoonAge)) / 2;
+
+    /* cos(MmP + mEc),  with mEc below 0.11 radian */
+    mEc = torad(mEc);
+    MoonDist = (msmax * (1 - mecc * mecc)) /
+               (1 + mecc * (cos(MmP) * (1 - mEc * mEc / 2)
+                            - (sin(MmP) * mEc)));
+    *dist = MoonDist;
+    *angdia = mangsiz / (MoonDist / msmax);
+
+    *mage = synmonth * (fixangle(MoonAge) / 360.0);
+    return fixangle(MoonAge) / 360.0;
+}
+
+/*  DELTA_T  --  Difference between dynamical time and universal time,
+                 in seconds,  at a Julian date.  Polynomials of Espenak
+                 and Meeus (2006) from 1700 to 2150,  and Morrison and
+                 Stephenson's parabola outside.  */
+
+static double delta_t(double jd)
+{
+    double y, t, u;
+
+    y = 2000.0 + (jd - MEEUS_J2000) / 365.25;
+    u = (y - 1820.0) / 100.0;
+
+    if (y < 1700.0 || y >= 2150.0)
+        return -20.0 + 32.0 * u * u;
+    if (y < 1800.0) {
+        t = y - 1700.0;
+        return 8.83 + t * (0.1603 + t * (-0.0059285
+               + t * (0.00013336 - t / 1174000.0)));
+    }
+    if (y < 1860.0) {
+        t = y - 1800.0;
+        return 13.72 + t * (-0.332447 + t * (0.0068612 + t * (0.0041116
+               + t * (-0.00037436 + t * (0.0000121272 + t * (-0.0000001699
+               + t * 0.000000000875))))));
+    }
+    if (y < 1900.0) {
+        t = y - 1860.0;
+        return 7.62 + t * (0.5737 + t * (-0.251754 + t * (0.01680668
+               + t * (-0.0004473624 + t / 233174.0))));
+    }
+    if (y < 1920.0) {
+        t = y - 1900.0;
+        return -2.79 + t * (1.494119 + t * (-0.0598939
+               + t * (0.0061966 - t * 0.000197)));
+    }
+    if (y < 1941.0) {
+        t = y - 1920.0;
+        return 21.20 + t * (0.84493 + t * (-0.076100 + t * 0.0020936));
+    }
+    if (y < 1961.0) {
+        t = y - 1950.0;
+        return 29.07 + t * (0.407 + t * (-1.0 / 233.0 + t / 2547.0));
+    }
+    if (y < 1986.0) {
+        t = y - 1975.0;
+        return 45.45 + t * (1.067 + t * (-1.0 / 260.0 - t / 718.0));
+    }
+    if (y < 2005.0) {
+        t = y - 2000.0;
+        return 63.86 + t * (0.3345 + t * (-0.060374 + t * (0.0017275
+               + t * (0.000651814 + t * 0.00002373599))));
+    }
+    if (y < 2050.0) {
+        t = y - 2000.0;
+        return 62.92 + t * (0.32217 + t * 0.005589);
+    }
+    return -20.0 + 32.0 * u * u - 0.5628 * (2150.0 - y);
+}
+
+/*  MULTIPLES  --  Sines and cosines of 0 to 4 times an angle in degrees,
+                   by angle addition.  */
+
+static void multiples(double x, double s[5], double c[5])
+{
+    int k;
+
+    s[0] = 0.0;
+    c[0] = 1.0;
+    s[1] = sin(torad(x));
+    c[1] = cos(torad(x));
+    for (k = 2; k < 5; k++) {
+        s[k] = s[k - 1] * c[1] + c[k - 1] * s[1];
+        c[k] = c[k - 1] * c[1] - s[k - 1] * s[1];
+    }
+}
+
+/*  TERM_SINCOS  --  Sine and cosine of dD + mM + m'M' + fF,  given the
+                     multiples of D, M, M' and F.  */
+
+static inline void term_sincos(const long *n, double ms[4][5],
+                               double mc[4][5], double *s, double *c)
+{
+    double ts, tc, us, uc, r;
+    int j;
+
+    ts = 0.0;
+    tc = 1.0;
+    for (j = 0; j < 4; j++) {
+        us = (n[j] < 0) ? -ms[j][-n[j]] : ms[j][n[j]];
+        uc = mc[j][abs(n[j])];
+        r = tc * uc - ts * us;
+        ts = ts * uc + tc * us;
+        tc = r;
+    }
+    *s = ts;
+    *c = tc;
+}
+
+/*  MOON_POSITION_HIGH  --  Geocentric ecliptic longitude and latitude of
+                            the Moon (mean equinox of date,  degrees),
+                            and distance (km),  at a Julian ephemeris
+                            date.  */
+
+static void moon_position_high(double jde, double *lambda, double *beta,
+                               double *delta)
+{
+    double T, Lp, D, M, Mp, F, A1, A2, A3, E, ms[4][5], mc[4][5],
+           sl, sr, sb, s, c, e;
+    int i;
+
+    T = (jde - MEEUS_J2000) / 36525.0;
+
+    Lp = fixangle(218.3164477 + 481267.88123421 * T - 0.0015786 * T * T
+                  + T * T * T / 538841.0 - T * T * T * T / 65194000.0);
+    D = fixangle(297.8501921 + 445267.1114034 * T - 0.0018819 * T * T
+                 + T * T * T / 545868.0 - T * T * T * T / 113065000.0);
+    M = fixangle(357.5291092 + 35999.0502909 * T - 0.0001536 * T * T
+                 + T * T * T / 24490000.0);
+    Mp = fixangle(134.9633964 + 477198.8675055 * T + 0.0087414 * T * T
+                  + T * T * T / 69699.0 - T * T * T * T / 14712000.0);
+    F = fixangle(93.2720950 + 483202.0175233 * T - 0.0036539 * T * T
+                 - T * T * T / 3526000.0 + T * T * T * T / 863310000.0);
+    A1 = fixangle(119.75 + 131.849 * T);
+    A2 = fixangle(53.09 + 479264.290 * T);
+    A3 = fixangle(313.45 + 481266.484 * T);
+    E = 1 - 0.002516 * T - 0.0000074 * T * T;
+
+    multiples(D, ms[0], mc[0]);
+    multiples(M, ms[1], mc[1]);
+    multiples(Mp, ms[2], mc[2]);
+    multiples(F, ms[3], mc[3]);
+
+    sl = sr = sb = 0.0;
+    for (i = 0; i < 60; i++) {
+        /* Terms in M are multiplied by E,  to account for the decreasing
+           eccentricity of the Earth's orbit. */
+        e = (meeus_lr[i][1] == 0) ? 1.0 : (abs(meeus_lr[i][1]) == 1) ? E : E * E;
+        term_sincos(meeus_lr[i], ms, mc, &s, &c);
+        sl += e * meeus_lr[i][4] * s;
+        sr += e * meeus_lr[i][5] * c;
+
+        e = (meeus_b[i][1] == 0) ? 1.0 : (abs(meeus_b[i][1]) == 1) ? E : E * E;
+        term_sincos(meeus_b[i], ms, mc, &s, &c);
+        sb += e * meeus_b[i][4] * s;
+    }
+
+    /* Action of Venus (A1),  of Jupiter (A2),  and flattening of the
+       Earth (L') */
+    sl += 3958 * dsin(A1) + 1962 * dsin(Lp - F) + 318 * dsin(A2);
+    sb += -2235 * dsin(Lp) + 382 * dsin(A3) + 175 * dsin(A1 - F)
+          + 175 * dsin(A1 + F) + 127 * dsin(Lp - Mp) - 115 * dsin(Lp + Mp);
+
+    *lambda = fixangle(Lp + sl / 1000000.0);
+    *beta = sb / 1000000.0;
+    *delta = MEEUS_DELTA0 + sr / 1000.0;
+}
+
+/*  SUN_POSITION_HIGH  --  Geometric ecliptic longitude of the Sun (mean
+                           equinox of date,  degrees),  and distance (AU),
+                           at a Julian ephemeris date.  */
+
+static void sun_position_high(double jde, double *lambda, double *r)
+{
+    double T, L0, M, e, C;
+
+    T = (jde - MEEUS_J2000) / 36525.0;
+
+    L0 = 280.46646 + 36000.76983 * T + 0.0003032 * T * T;
+    M = fixangle(357.52911 + 35999.05029 * T - 0.0001537 * T * T);
+    e = 0.016708634 - 0.000042037 * T - 0.0000001267 * T * T;
+    C = (1.914602 - 0.004817 * T - 0.000014 * T * T) * dsin(M)
+        + (0.019993 - 0.000101 * T) * dsin(2 * M)
+        + 0.000289 * dsin(3 * M);
+
+    *lambda = fixangle(L0 + C);
+    *r = 1.000001018 * (1 - e * e) / (1 + e * dcos(M + C));
+}
+
+/*  PHASE_HIGH  --  Same as PHASE,  from Meeus' theories.  */
+
+static double phase_high(
+  double  pdate,                      /* Date for which to calculate phase */
+  double  *pphase,                    /* Illuminated fraction */
+  double  *mage,                      /* Age of moon in days */
+  double  *dist,                      /* Distance in kilometres */
+  double  *angdia,                    /* Angular diameter in degrees */
+  double  *sudist,                    /* Distance to Sun */
+  double  *suangdia)                  /* Sun's angular diameter */
+{
+    double jde, lambda, beta, delta, lambdasun, r, psi, i, p;
+
+    jde = pdate + delta_t(pdate) / 86400.0;
+    moon_position_high(jde, &lambda, &beta, &delta);
+    sun_position_high(jde, &lambdasun, &r);
+
+    /* The Sun is seen where it was when its light left it.  Nutation
+       moves both bodies alike,  and is left out. */
+    lambdasun -= MEEUS_ABERRATION / r;
+
+    /* Phase angle,  from the geocentric elongation of the Moon */
+    psi = acos(dcos(beta) * dcos(lambda - lambdasun));
+    i = atan2(r * sunsmax * sin(psi), delta - r * sunsmax * cos(psi));
+    *pphase = (1 + cos(i)) / 2;
+
+    *dist = delta;
+    *angdia = mangsiz / (delta / msmax);
+    *sudist = r * sunsmax;
+    *suangdia = sunangsiz / r;
+
+    p = fixangle(lambda - lambdasun) / 360.0;
+    *mage = synmonth * p;
+    return p;
+}
+
+/*  PHASE_TIERS  --  Indexed by MOON_PRECISION_*.  */
+
+static const PhaseTier phase_tiers[3] = {
+    phase_fast, phase, phase_high
+};
+
+int moonphase_precision(MoonPhase *mphase, const time_t *timestamp,
+                        int precision)
+{
+    if (precision < MOON_PRECISION_FAST || precision > MOON_PRECISION_HIGH)
+        return FALSE;
+    return moonphase_tier(mphase, timestamp, phase_tiers[precision]);
+}
+
+int moonphase_batch_precision(const MoonPhaseColumns *columns,
+                              const time_t *timestamps, size_t count,
+                              int precision)
+{
+    double jd, p, aom, cphase, cdist, cangdia, csund, csuang;
+    size_t i;
+
+    if (precision < MOON_PRECISION_FAST || precision > MOON_PRECISION_HIGH)
+        return FALSE;
+
+    /* Only the STANDARD tier has a lane kernel. */
+    if (precision == MOON_PRECISION_STANDARD)
+        return moonphase_batch(columns, timestamps, count);
+
+    for (i = 0; i < count; i++) {
+        if (!unixtoj((long) timestamps[i], &jd))
+            return FALSE;
+
+        p = phase_tiers[precision](jd, &cphase, &aom, &cdist, &cangdia,
+                                   &csund, &csuang);
+
+        if (columns->julian_date != NULL)
+            columns->julian_date[i] = jd;
+        if (columns->age != NULL)
+            columns->age[i] = aom;
+        if (columns->fraction_of_lunation != NULL)
+            columns->fraction_of_lunation[i] = p;
+        if (columns->phase != NULL)
+            columns->phase[i] = fraction_of_lunation_to_phase(p);
+        if (columns->fraction_illuminated != NULL)
+            columns->fraction_illuminated[i] = cphase;
+        if (columns->distance_to_earth_km != NULL)
+            columns->distance_to_earth_km[i] = cdist;
+        if (columns->subtends != NULL)
+            columns->subtends[i] = cangdia;
+        if (columns->sun_distance_to_earth_km != NULL)
+            columns->sun_distance_to_earth_km[i] = csund;
+        if (columns->sun_subtends != NULL)
+            columns->sun_subtends[i] = csuang;
+    }
+
+    return TRUE;
+}
@@ -1,6 +1,7 @@
 #ifndef MOON_MOON_H_
 #define MOON_MOON_H_
 
+#include <stddef.h>
 #include <time.h>
 
 
@@ -9,6 +10,22 @@ namespace moon {
 extern "C" {
 #endif
 
+/*
+ * Thread safety:
+ *
+ * The library holds no mutable global state. Its one global variable,
+ * the CPU variant of the batch kernels (see `moon_cpu_variant()`), is
+ * set once, when the program is loaded, before any user code runs, and
+ * is only read afterwards. Functions only write to the structs and
+ * arrays passed in by the caller (and to their own stack), and use the
+ * reentrant `gmtime_r()` and `localtime_r()` for time conversions. All
+ * functions may thus be called concurrently from any number of threads,
+ * provided each thread has its own output.
+ *
+ * The one shared input is the process' time zone (`TZ`), used only to
+ * print local time. Don't change it while other threads are printing.
+ */
+
 /**
  * Information about the phase of the Moon at given time.
  *
@@ -95,6 +112,378 @@ typedef struct {
 } MoonCalendar;
 
 
+/**
+ * Column-oriented (struct-of-arrays) output of `moonphase_batch()`.
+ *
+ * Each member points to a caller-provided array of at least as many
+ * elements as there are timestamps. Members left to NULL are skipped,
+ * so only the columns that are actually needed get written.
+ *
+ * Fields have the same meaning as their `MoonPhase` counterparts.
+ *
+ * Examples:
+ *
+ * ```c
+ * #include "moon.h"
+ *
+ * time_t timestamps[3] = {1714809600, 1714896000, 1714982400};
+ * double age[3], illuminated[3];
+ *
+ * MoonPhaseColumns columns = {0};
+ * columns.age = age;
+ * columns.fraction_illuminated = illuminated;
+ *
+ * moonphase_batch(&columns, timestamps, 3);
+ * ```
+ */
+typedef struct {
+    double* julian_date;
+    double* age;
+    double* fraction_of_lunation;
+    int* phase;
+    double* fraction_illuminated;
+    double* distance_to_earth_km;
+    double* subtends;
+    double* sun_distance_to_earth_km;
+    double* sun_subtends;
+} MoonPhaseColumns;
+
+/**
+ * Single precision output of `moonphase_batch_float()`.
+ *
+ * Same as `MoonPhaseColumns`, with `float` arrays; the Julian date
+ * stays a `double` (a `float` would only be precise to the quarter of
+ * a day).
+ */
+typedef struct {
+    double* julian_date;
+    float* age;
+    float* fraction_of_lunation;
+    int* phase;
+    float* fraction_illuminated;
+    float* distance_to_earth_km;
+    float* subtends;
+    float* sun_distance_to_earth_km;
+    float* sun_subtends;
+} MoonPhaseColumnsFloat;
+
+
+/**
+ * A phase of the Moon (new, first quarter, full, or last quarter), as
+ * listed by `mooncal_year()`.
+ */
+typedef struct {
+    /**
+     * Julian Day Number (JDN), see `MoonCalendar`.
+     */
+    double date;
+    struct tm date_utc;
+    /**
+     * 0 = New Moon, 1 = First Quarter, 2 = Full Moon, 3 = Last Quarter.
+     */
+    int phase;
+    /**
+     * Brown Lunation Number (BLN) of the lunation the phase is part of.
+     */
+    long lunation;
+} MoonPhaseEvent;
+
+/**
+ * Maximum number of phases of the Moon in a year (at most 13 of each).
+ */
+#define MOON_YEAR_MAX_EVENTS 52
+
+
+/**
+ * Quantities whose threshold crossings `moonphase_crossings()` finds.
+ */
+#define MOON_CROSSING_FRACTION_ILLUMINATED 0
+#define MOON_CROSSING_AGE 1
+
+/**
+ * Precision tiers of `moonphase_precision()`.
+ *
+ * - FAST: the STANDARD model without its two smallest corrections to
+ *   the Moon's anomaly and longitude (A3 and A4), and with the first
+ *   term of the equation of the centre for the Sun; the evection and
+ *   annual equation are kept. About twice as fast.
+ * - STANDARD: the model of the original Moontool (simplified orbital
+ *   elements of 1980), as used by `moonphase()`.
+ * - HIGH: the periodic terms of ELP-2000/82 of Meeus' "Astronomical
+ *   Algorithms" (chapter 47), with dynamical time.
+ */
+#define MOON_PRECISION_FAST 0
+#define MOON_PRECISION_STANDARD 1
+#define MOON_PRECISION_HIGH 2
+
+/**
+ * A time at which a quantity crosses a threshold, as found by
+ * `moonphase_crossings()`.
+ */
+typedef struct {
+    /**
+     * Julian Day Number (JDN), see `MoonCalendar`.
+     */
+    double date;
+    struct tm date_utc;
+    /**
+     * 1 = the quantity goes above the threshold (illumination while
+     * waxing, and age), 0 = it goes below (illumination while waning).
+     */
+    int rising;
+} MoonCrossing;
+
+/**
+ * A perigee or apogee of the Moon, as found by `moonphase_apsides()`.
+ */
+typedef struct {
+    /**
+     * Julian Day Number (JDN), see `MoonCalendar`.
+     */
+    double date;
+    struct tm date_utc;
+    /**
+     * 0 = perigee (closest), 1 = apogee (farthest).
+     */
+    int apogee;
+    double distance_to_earth_km;
+} MoonApsis;
+
+/**
+ * A new or full moon, and how close to perigee it is, as listed by
+ * `mooncal_syzygies()`.
+ */
+typedef struct {
+    /**
+     * Julian Day Number (JDN), see `MoonCalendar`.
+     */
+    double date;
+    struct tm date_utc;
+    /**
+     * 0 = New Moon, 2 = Full Moon (as in `MoonPhaseEvent`).
+     */
+    int phase;
+    double distance_to_earth_km;
+    /**
+     * Where the distance falls between the apogee (0) and the perigee
+     * (1) either side of the new or full moon.
+     */
+    double closeness;
+    /**
+     * 1 = supermoon, -1 = micromoon, 0 = neither.
+     */
+    int supermoon;
+} MoonSyzygy;
+
+
+/**
+ * Lunation record, as stored in ephemeris files.
+ *
+ * Dates are Julian Day Numbers (JDN), see `MoonCalendar`.
+ */
+typedef struct {
+    /**
+     * Brown Lunation Number (BLN).
+     */
+    long lunation;
+    double new_moon;
+    double first_quarter;
+    double full_moon;
+    double last_quarter;
+    double next_new_moon;
+} MoonLunation;
+
+
+/**
+ * Read-only, memory-mapped ephemeris file.
+ *
+ * Ephemeris files hold precomputed lunations and phase samples (at
+ * regular intervals) for a range of dates. They are written once with
+ * `moonephem_write()`, and can then be shared by any number of
+ * processes, which only map them into memory.
+ *
+ * The format is versioned and little-endian regardless of the host, so
+ * files can be moved between machines. It is described in `moon.c`.
+ *
+ * Members are informative; don't modify them.
+ *
+ * Examples:
+ *
+ * ```c
+ * #include "moon.h"
+ *
+ * MoonEphemeris eph;
+ * MoonLunation lunations[4];
+ * size_t count;
+ *
+ * moonephem_write("moon.eph", 2451544.5, 2488069.5, 1.0 / 24);
+ *
+ * moonephem_open(&eph, "moon.eph");
+ * moonephem_lunations(&eph, 2460310.5, 2460341.5, lunations, 4, &count);
+ * moonephem_close(&eph);
+ * ```
+ */
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    unsigned int version;
+    /**
+     * Julian date of the first phase sample.
+     */
+    double first_julian_date;
+    /**
+     * Interval between phase samples, in days.
+     */
+    double step;
+    size_t sample_count;
+    size_t lunation_count;
+} MoonEphemeris;
+
+
+/**
+ * Number of quantities fitted per interval by `moonchebyshev_fit()`.
+ */
+#define MOON_CHEBYSHEV_QUANTITIES 6
+
+/**
+ * Piecewise Chebyshev approximation of the phase of the Moon.
+ *
+ * The date range is split into `interval_count` consecutive intervals
+ * of `interval` days, starting at `first_julian_date`. Over each one,
+ * every quantity is approximated by a Chebyshev series of degree
+ * `degree`, of the date mapped to [-1, 1].
+ *
+ * Coefficients are stored interval by interval, then quantity by
+ * quantity, lowest degree first. That is, coefficient `j` of quantity
+ * `q` of interval `i` is at:
+ *
+ * ```c
+ * coefficients[(i * MOON_CHEBYSHEV_QUANTITIES + q) * (degree + 1) + j]
+ * ```
+ *
+ * Quantities are, in order: fraction of lunation (unwrapped, i.e., it
+ * keeps increasing past new moon), fraction illuminated, Moon's
+ * distance, Moon's angular diameter, Sun's distance, and Sun's angular
+ * diameter. The first coefficient is not halved.
+ *
+ * `max_error` holds, for each quantity, the largest difference with
+ * `moonphase()` found while fitting (sampling each interval finely).
+ * It is an estimate, not a proof, but a tight one.
+ *
+ * Examples:
+ *
+ * ```c
+ * #include "moon.h"
+ *
+ * MoonChebyshev cheb;
+ * time_t timestamps[3] = {1714809600, 1714896000, 1714982400};
+ * double illuminated[3];
+ *
+ * MoonPhaseColumns columns = {0};
+ * columns.fraction_illuminated = illuminated;
+ *
+ * // 2024, one polynomial of degree 8 per day.
+ * moonchebyshev_fit(&cheb, 2460310.5, 2460676.5, 1.0, 8);
+ * moonchebyshev_batch(&cheb, &columns, timestamps, 3);
+ * moonchebyshev_free(&cheb);
+ * ```
+ */
+typedef struct {
+    double first_julian_date;
+    /**
+     * Length of intervals, in days.
+     */
+    double interval;
+    size_t interval_count;
+    int degree;
+    double* coefficients;
+    double max_error[MOON_CHEBYSHEV_QUANTITIES];
+} MoonChebyshev;
+
+
+/**
+ * Size of a binary phase record, see `moonphase_to_record()`.
+ */
+#define MOON_RECORD_SIZE 80
+
+/**
+ * Size of the header of a binary phase record file, see
+ * `moonphase_record_header()`.
+ */
+#define MOON_RECORD_HEADER_SIZE 424
+
+/**
+ * Header of the rows of `moonphase_to_csv()`.
+ */
+#define MOON_CSV_HEADER \
+    "timestamp,julian_date,age,fraction_of_lunation,phase," \
+    "fraction_illuminated,distance_to_earth_km,subtends," \
+    "sun_distance_to_earth_km,sun_subtends"
+
+
+/**
+ * Number of steps a `MoonPhaseIterator` computes at once.
+ */
+#define MOON_ITER_LANES 8
+
+/**
+ * Iterator over the phase of the Moon on a uniform time grid.
+ *
+ * Steps are computed by groups of `MOON_ITER_LANES`, like with
+ * `moonphase_batch()`. Stepping by a fixed interval lets sines and
+ * cosines of the angles that are linear in time be advanced by rotation,
+ * instead of being computed from scratch. Results agree with
+ * `moonphase()` within:
+ *
+ * - fraction of lunation, fraction illuminated: 1e-11
+ * - age of the Moon: 1e-10 days
+ * - distance to the Moon: 1e-6 km
+ * - distance to the Sun: 5e-5 km
+ * - angular diameters: 1e-12 degrees
+ *
+ * Most of the difference is `moonphase()`'s: it rounds the time to a
+ * Julian date, to within 2e-10 days, and rotations don't.
+ *
+ * Results don't depend on how the steps are split between calls to
+ * `moonphase_iter_next()`.
+ *
+ * Only `timestamp` (time of the next step) and `step` are public.
+ *
+ * Examples:
+ *
+ * ```c
+ * #include "moon.h"
+ *
+ * MoonPhaseIterator it;
+ * time_t start = 1704067200;
+ * double illuminated[24];
+ *
+ * MoonPhaseColumns columns = {0};
+ * columns.fraction_illuminated = illuminated;
+ *
+ * // 2024-01-01, hourly.
+ * moonphase_iter_init(&it, &start, 3600);
+ * moonphase_iter_next(&it, &columns, 24);
+ * ```
+ */
+typedef struct {
+    time_t timestamp;
+    /**
+     * Interval between steps, in seconds (may be negative).
+     */
+    long step;
+    double sin_m[MOON_ITER_LANES], cos_m[MOON_ITER_LANES];
+    double sin_d[MOON_ITER_LANES], cos_d[MOON_ITER_LANES];
+    double sin_dm, cos_dm, sin_dd, cos_dd;
+    unsigned int until_resync;
+    unsigned int lane, valid;
+    double jd[MOON_ITER_LANES], pfrac[MOON_ITER_LANES];
+    double pphase[MOON_ITER_LANES], mage[MOON_ITER_LANES];
+    double dist[MOON_ITER_LANES], angdia[MOON_ITER_LANES];
+    double sudist[MOON_ITER_LANES], suangdia[MOON_ITER_LANES];
+} MoonPhaseIterator;
+
+
 /**
  * Populate MoonPhase struct with info about the Moon at given time.
  *
@@ -104,6 +493,177 @@ typedef struct {
  */
 int moonphase(MoonPhase* mphase, const time_t* timestamp);
 
+/**
+ * Same as `moonphase()`, with a choice of model.
+ *
+ * Deviation from HIGH, sampled over 1800-2200 (rms / max):
+ *
+ * | Field                    | FAST              | STANDARD          |
+ * |--------------------------|-------------------|-------------------|
+ * | `age` (minutes)          | 24 / 74           | 15 / 52           |
+ * | `fraction_illuminated`   | 0.0015 / 0.0068   | 0.0012 / 0.0049   |
+ * | `distance` (km)          | 3261 / 7073       | 3260 / 7074       |
+ * | `subtends` (degrees)     | 0.0046 / 0.0106   | 0.0046 / 0.0106   |
+ * | `sun_distance` (km)      | 62000 / 165000    | 62000 / 165000    |
+ * | `sun_subtends` (degrees) | 0.00022 / 0.00059 | 0.00022 / 0.00059 |
+ *
+ * HIGH itself puts New and Full Moons within about a minute of the
+ * published times. Per call, FAST costs about half of STANDARD, and
+ * HIGH about two and a half times as much.
+ *
+ * Examples:
+ *
+ * ```c
+ * #include "moon.h"
+ *
+ * MoonPhase mphase;
+ * moonphase_precision(&mphase, NULL, MOON_PRECISION_HIGH);
+ * ```
+ *
+ * @param mphase The MoonPhase struct.
+ * @param timestamp Time of snapshot; if NULL, current UTC time is used.
+ * @param precision One of the `MOON_PRECISION_*` tiers.
+ * @return 1 (true) = OK, 0 (false) = KO (or unknown tier).
+ */
+int moonphase_precision(
+    MoonPhase* mphase, const time_t* timestamp, int precision
+);
+
+/**
+ * Populate MoonPhase structs on a uniform time grid, using many threads.
+ *
+ * Entry `i` is for time `start + i * step`, and is exactly what
+ * `moonphase()` gives for that time, whatever the number of threads.
+ * Each thread fills one contiguous slice of `mphases`; threads are
+ * started and joined within the call.
+ *
+ * Example:
+ *
+ * ```c
+ * MoonPhase hours[24 * 365];
+ * time_t start = 1704067200;
+ *
+ * moonphase_range(hours, &start, 3600, 24 * 365, 0);
+ * ```
+ *
+ * @param mphases Output array, of at least `count` structs.
+ * @param start Time of the first entry; if NULL, current UTC time is used.
+ * @param step Interval between entries, in seconds (may be negative).
+ * @param count Number of entries.
+ * @param threads Maximum number of threads; 0 = one per online core.
+ *        Small ranges use fewer threads.
+ * @return 1 (true) = OK, 0 (false) = KO.
+ */
+int moonphase_range(
+    MoonPhase* mphases, const time_t* start, long step, size_t count, int threads
+);
+
+/**
+ * Compute the phase of the Moon for many timestamps at once.
+ *
+ * Results are written column by column into the arrays of `columns`,
+ * at the same index as their timestamp. This skips everything that is
+ * not numeric (`struct tm`, names, icons), and is the preferred entry
+ * point for bulk computations.
+ *
+ * @param columns Output arrays; NULL members are not written to.
+ * @param timestamps Times of snapshots.
+ * @param count Number of timestamps (and minimum length of columns).
+ * @return 1 (true) = OK, 0 (false) = KO.
+ */
+int moonphase_batch(
+    const MoonPhaseColumns* columns, const time_t* timestamps, size_t count
+);
+
+/**
+ * Same as `moonphase_batch()`, computed in single precision.
+ *
+ * This is two to three times as fast, as twice as many dates fit in a
+ * vector register, and the output takes half the memory. Between 1800
+ * and 2200, results differ from those of `moonphase_batch()` by at most:
+ *
+ * | Field                      | Max. absolute error |
+ * |----------------------------|---------------------|
+ * | `age`                      | 1e-5 days (~1 s)    |
+ * | `fraction_of_lunation`     | 5e-7                |
+ * | `fraction_illuminated`     | 5e-7                |
+ * | `distance_to_earth_km`     | 0.1 km              |
+ * | `subtends`                 | 5e-7 degrees        |
+ * | `sun_distance_to_earth_km` | 25 km               |
+ * | `sun_subtends`             | 5e-7 degrees        |
+ *
+ * That is, within a few units in the last place of a `float`. `phase`
+ * is derived from `fraction_of_lunation`, and may thus differ from the
+ * double precision one right at the boundary between two phases.
+ *
+ * Examples:
+ *
+ * ```c
+ * #include "moon.h"
+ *
+ * time_t timestamps[3] = {1714809600, 1714896000, 1714982400};
+ * float age[3], illuminated[3];
+ *
+ * MoonPhaseColumnsFloat columns = {0};
+ * columns.age = age;
+ * columns.fraction_illuminated = illuminated;
+ *
+ * moonphase_batch_float(&columns, timestamps, 3);
+ * ```
+ *
+ * @param columns Output arrays; NULL members are not written to.
+ * @param timestamps Times of snapshots.
+ * @param count Number of timestamps (and minimum length of columns).
+ * @return 1 (true) = OK, 0 (false) = KO.
+ */
+int moonphase_batch_float(
+    const MoonPhaseColumnsFloat* columns, const time_t* timestamps, size_t count
+);
+
+/**
+ * Same as `moonphase_batch()`, with a choice of model (see
+ * `moonphase_precision()`).
+ *
+ * Only the STANDARD tier is vectorized.
+ *
+ * @param columns Output arrays; NULL members are not written to.
+ * @param timestamps Times of snapshots.
+ * @param count Number of timestamps (and minimum length of columns).
+ * @param precision One of the `MOON_PRECISION_*` tiers.
+ * @return 1 (true) = OK, 0 (false) = KO (or unknown tier).
+ */
+int moonphase_batch_precision(
+    const MoonPhaseColumns* columns,
+    const time_t* timestamps,
+    size_t count,
+    int precision
+);
+
+/**
+ * Start iterating over the phase of the Moon.
+ *
+ * @param it The MoonPhaseIterator struct.
+ * @param start Time of the first step; if NULL, current UTC time is used.
+ * @param step Interval between steps, in seconds; must not be zero.
+ * @return 1 (true) = OK, 0 (false) = KO.
+ */
+int moonphase_iter_init(MoonPhaseIterator* it, const time_t* start, long step);
+
+/**
+ * Compute the next `count` steps of an iterator.
+ *
+ * Results are written like with `moonphase_batch()`, the first of them
+ * at index 0. Calling this with a count of 1 yields the steps one by one.
+ *
+ * @param it The MoonPhaseIterator struct.
+ * @param columns Output arrays; NULL members are not written to.
+ * @param count Number of steps (and minimum length of columns).
+ * @return 1 (true) = OK, 0 (false) = KO.
+ */
+int moonphase_iter_next(
+    MoonPhaseIterator* it, const MoonPhaseColumns* columns, size_t count
+);
+
 /**
  * Print MoonPhase object or print info at current time.
  *
@@ -118,6 +678,73 @@ void print_moonphase(const MoonPhase* mphase);
  */
 void print_moonphase_debug(const MoonPhase* mphase);
 
+/**
+ * Format the report printed by `print_moonphase()` into a buffer.
+ *
+ * No memory is allocated. Like `snprintf()`, at most `len` bytes are
+ * written, the output is always NUL-terminated (if `len` > 0), and the
+ * length of the full report is returned, whether it fit or not. If the
+ * local time can't be represented, it reads "unknown".
+ *
+ * Example:
+ *
+ * ```c
+ * char buf[1000];
+ * if (moonphase_format(buf, sizeof(buf), &mphase) >= sizeof(buf)) {
+ *     // Truncated.
+ * }
+ * ```
+ *
+ * @param buf Output buffer; may be NULL if `len` is 0.
+ * @param len Size of `buf`, in bytes.
+ * @param mphase Struct to format.
+ * @return Length of the full report, excluding the NUL terminator.
+ */
+size_t moonphase_format(char* buf, size_t len, const MoonPhase* mphase);
+
+/**
+ * Format MoonPhase object as a single-line JSON object, into a buffer.
+ *
+ * Keys are the names of the struct fields, except for the phase, which
+ * is an object: `"phase":{"index":5,"name":"Waning Gibbous","icon":"🌖"}`.
+ * Datetimes are in ISO 8601 (`"1994-12-22T13:53:34Z"`), and numbers
+ * have enough digits to read back as the exact same doubles.
+ *
+ * Same semantics as `moonphase_format()`.
+ *
+ * @param buf Output buffer; may be NULL if `len` is 0.
+ * @param len Size of `buf`, in bytes.
+ * @param mphase Struct to format.
+ * @return Length of the full JSON, excluding the NUL terminator.
+ */
+size_t moonphase_to_json(char* buf, size_t len, const MoonPhase* mphase);
+
+/**
+ * Format MoonPhase object as a CSV row, into a buffer.
+ *
+ * Columns are those of `MOON_CSV_HEADER`, without a line terminator.
+ * Numbers are formatted like `"%.17g"` would, so they read back as the
+ * exact same doubles, but several times faster.
+ *
+ * Same semantics as `moonphase_format()`.
+ *
+ * Examples:
+ *
+ * ```c
+ * char row[512];
+ *
+ * printf("%s\n", MOON_CSV_HEADER);
+ * moonphase_to_csv(row, sizeof(row), &mphase);
+ * printf("%s\n", row);
+ * ```
+ *
+ * @param buf Output buffer; may be NULL if `len` is 0.
+ * @param len Size of `buf`, in bytes.
+ * @param mphase Struct to format.
+ * @return Length of the full row, excluding the NUL terminator.
+ */
+size_t moonphase_to_csv(char* buf, size_t len, const MoonPhase* mphase);
+
 /**
  * Populate MoonCalendar struct with info about lunation at given time.
  *
@@ -127,6 +754,233 @@ void print_moonphase_debug(const MoonPhase* mphase);
  */
 int mooncal(MoonCalendar* mcal, const time_t* timestamp);
 
+/**
+ * List the phases of the Moon in a calendar year, in chronological order.
+ *
+ * The year goes from January 1 at 0:00 UTC to the next. Dates before
+ * October 15, 1582 are in the Julian calendar, as elsewhere.
+ *
+ * If there are more phases than `capacity`, nothing is written, and
+ * `count` is set to the number of phases. A capacity of
+ * `MOON_YEAR_MAX_EVENTS` is always enough.
+ *
+ * Example:
+ *
+ * ```c
+ * MoonPhaseEvent events[MOON_YEAR_MAX_EVENTS];
+ * size_t count;
+ *
+ * mooncal_year(events, MOON_YEAR_MAX_EVENTS, 2024, &count);
+ *
+ * for (size_t i = 0; i < count; ++i) {
+ *     if (events[i].phase == 2) {
+ *         // Full Moon, on events[i].date_utc.
+ *     }
+ * }
+ * ```
+ *
+ * @param events Output array.
+ * @param capacity Length of `events`.
+ * @param year Calendar year (e.g., 2024).
+ * @param count Number of phases in the year.
+ * @return 1 (true) = OK, 0 (false) = KO (not enough capacity).
+ */
+int mooncal_year(
+    MoonPhaseEvent* events, size_t capacity, long year, size_t* count
+);
+
+/**
+ * Populate MoonCalendar structs on a uniform time grid, using many
+ * threads.
+ *
+ * Same as `moonphase_range()`, but with `mooncal()`.
+ *
+ * @param mcals Output array, of at least `count` structs.
+ * @param start Time of the first entry; if NULL, current UTC time is used.
+ * @param step Interval between entries, in seconds (may be negative).
+ * @param count Number of entries.
+ * @param threads Maximum number of threads; 0 = one per online core.
+ * @return 1 (true) = OK, 0 (false) = KO.
+ */
+int mooncal_range(
+    MoonCalendar* mcals, const time_t* start, long step, size_t count, int threads
+);
+
+/**
+ * Find the times at which the fraction illuminated, or the age, of the
+ * Moon crosses a threshold, in chronological order.
+ *
+ * Both quantities are as in `MoonPhase`. Each crossing is bracketed
+ * from the new moons of its lunation, then refined until it is known to
+ * within `tolerance`, which costs about ten `moonphase()` calls. The age
+ * only ever rises, since it wraps to 0 at new moon instead of falling.
+ *
+ * If there are more crossings than `capacity`, nothing is written, and
+ * `count` is set to the number of crossings (pass a capacity of zero to
+ * find out how much room is needed).
+ *
+ * Example:
+ *
+ * ```c
+ * MoonCrossing crossings[32];
+ * size_t count;
+ *
+ * // Illumination going through 99% in 2024, to the second.
+ * moonphase_crossings(
+ *     crossings, 32, MOON_CROSSING_FRACTION_ILLUMINATED, 0.99,
+ *     2460310.5, 2460676.5, 1.0 / 86400, &count
+ * );
+ * ```
+ *
+ * @param crossings Output array.
+ * @param capacity Length of `crossings`.
+ * @param quantity `MOON_CROSSING_FRACTION_ILLUMINATED` (threshold in
+ *                 ]0, 1[) or `MOON_CROSSING_AGE` (threshold in days, in
+ *                 [0, 29.53[).
+ * @param threshold Value to cross.
+ * @param from_jd Start of the range (inclusive, Julian date).
+ * @param to_jd End of the range (exclusive, Julian date).
+ * @param tolerance Precision of the dates, in days (0 = full precision).
+ * @param count Number of crossings in the range.
+ * @return 1 (true) = OK, 0 (false) = KO (not enough capacity, or
+ *         invalid quantity or threshold).
+ */
+int moonphase_crossings(
+    MoonCrossing* crossings,
+    size_t capacity,
+    int quantity,
+    double threshold,
+    double from_jd,
+    double to_jd,
+    double tolerance,
+    size_t* count
+);
+
+/**
+ * Find the first time, at or after a date, at which the fraction
+ * illuminated, or the age, of the Moon crosses a threshold.
+ *
+ * Same as `moonphase_crossings()`, for one crossing. The Moon may
+ * already be past the threshold at `after_jd`.
+ *
+ * Example:
+ *
+ * ```c
+ * MoonCrossing crossing;
+ *
+ * // First time the Moon is at least 99% illuminated after a date.
+ * moonphase_next_crossing(
+ *     &crossing, MOON_CROSSING_FRACTION_ILLUMINATED, 0.99, 1,
+ *     2460310.5, 1.0 / 86400
+ * );
+ * ```
+ *
+ * @param crossing Output struct.
+ * @param quantity See `moonphase_crossings()`.
+ * @param threshold See `moonphase_crossings()`.
+ * @param direction 1 = rising only, -1 = falling only, 0 = either.
+ * @param after_jd Start of the search (inclusive, Julian date).
+ * @param tolerance Precision of the date, in days (0 = full precision).
+ * @return 1 (true) = OK, 0 (false) = KO (invalid quantity, threshold, or
+ *         direction).
+ */
+int moonphase_next_crossing(
+    MoonCrossing* crossing,
+    int quantity,
+    double threshold,
+    int direction,
+    double after_jd,
+    double tolerance
+);
+
+/**
+ * Find the perigees and apogees of the Moon, in chronological order.
+ *
+ * They are the extrema of `distance_to_earth_km` in `MoonPhase`, one
+ * pair per anomalistic month (27.55 days). Each is located from the
+ * Moon's mean anomaly, then refined until it is known to within
+ * `tolerance`, which costs a few `moonphase()` calls.
+ *
+ * In the model used, the distances at perigee and apogee barely vary;
+ * only their dates do.
+ *
+ * If there are more apsides than `capacity`, nothing is written, and
+ * `count` is set to the number of apsides (pass a capacity of zero to
+ * find out how much room is needed).
+ *
+ * Example:
+ *
+ * ```c
+ * MoonApsis apsides[32];
+ * size_t count;
+ *
+ * // 2024, to the second.
+ * moonphase_apsides(apsides, 32, 2460310.5, 2460676.5, 1.0 / 86400, &count);
+ * ```
+ *
+ * @param apsides Output array.
+ * @param capacity Length of `apsides`.
+ * @param from_jd Start of the range (inclusive, Julian date).
+ * @param to_jd End of the range (exclusive, Julian date).
+ * @param tolerance Precision of the dates, in days (0 = full precision).
+ * @param count Number of apsides in the range.
+ * @return 1 (true) = OK, 0 (false) = KO (not enough capacity).
+ */
+int moonphase_apsides(
+    MoonApsis* apsides,
+    size_t capacity,
+    double from_jd,
+    double to_jd,
+    double tolerance,
+    size_t* count
+);
+
+/**
+ * List the new and full moons between two dates, in chronological
+ * order, and flag supermoons and micromoons.
+ *
+ * A new or full moon is a supermoon if its distance to Earth is within
+ * `closeness` of the perigee, along the way from the apogee before or
+ * after it (R. Nolle's definition uses 0.9). Symmetrically, it is a
+ * micromoon if its distance is within `closeness` of the apogee.
+ *
+ * If there are more new and full moons than `capacity`, nothing is
+ * written, and `count` is set to their number (pass a capacity of zero
+ * to find out how much room is needed).
+ *
+ * Example:
+ *
+ * ```c
+ * MoonSyzygy syzygies[32];
+ * size_t count;
+ *
+ * mooncal_syzygies(syzygies, 32, 2460310.5, 2460676.5, 0.9, &count);
+ *
+ * for (size_t i = 0; i < count; ++i) {
+ *     if (syzygies[i].supermoon == 1 && syzygies[i].phase == 2) {
+ *         // Full supermoon, on syzygies[i].date_utc.
+ *     }
+ * }
+ * ```
+ *
+ * @param syzygies Output array.
+ * @param capacity Length of `syzygies`.
+ * @param from_jd Start of the range (inclusive, Julian date).
+ * @param to_jd End of the range (exclusive, Julian date).
+ * @param closeness Fraction of the apogee to perigee range, in [0.5, 1].
+ * @param count Number of new and full moons in the range.
+ * @return 1 (true) = OK, 0 (false) = KO (not enough capacity, or invalid
+ *         closeness).
+ */
+int mooncal_syzygies(
+    MoonSyzygy* syzygies,
+    size_t capacity,
+    double from_jd,
+    double to_jd,
+    double closeness,
+    size_t* count
+);
+
 /**
  * Print MoonCalendar object or print info at current time.
  *
@@ -141,6 +995,229 @@ void print_mooncal(const MoonCalendar* mcal);
  */
 void print_mooncal_debug(const MoonCalendar* mcal);
 
+/**
+ * Format the report printed by `print_mooncal()` into a buffer.
+ *
+ * Same semantics as `moonphase_format()`.
+ *
+ * @param buf Output buffer; may be NULL if `len` is 0.
+ * @param len Size of `buf`, in bytes.
+ * @param mcal Struct to format.
+ * @return Length of the full report, excluding the NUL terminator.
+ */
+size_t mooncal_format(char* buf, size_t len, const MoonCalendar* mcal);
+
+/**
+ * Format MoonCalendar object as a single-line JSON object, into a buffer.
+ *
+ * Same conventions as `moonphase_to_json()`.
+ *
+ * @param buf Output buffer; may be NULL if `len` is 0.
+ * @param len Size of `buf`, in bytes.
+ * @param mcal Struct to format.
+ * @return Length of the full JSON, excluding the NUL terminator.
+ */
+size_t mooncal_to_json(char* buf, size_t len, const MoonCalendar* mcal);
+
+/**
+ * Write the header of a binary phase record file.
+ *
+ * A record file is this header, followed by any number of records
+ * written by `moonphase_to_record()`. All values are little-endian.
+ * The header describes the records, so readers can find fields by name
+ * instead of hard-coding offsets (version 1):
+ *
+ * | Offset | Size | Field                                   |
+ * |--------|------|-----------------------------------------|
+ * | 0      | 8    | Magic, `"MOONREC\0"`                    |
+ * | 8      | 4    | Version (u32), 1                        |
+ * | 12     | 4    | Header size (u32), where records start  |
+ * | 16     | 4    | Record size (u32)                       |
+ * | 20     | 4    | Number of fields (u32)                  |
+ * | 24     | 40   | Fields, each:                           |
+ * |        |      | name (32 bytes, NUL-padded),            |
+ * |        |      | offset in record (u32),                 |
+ * |        |      | type (u8: 1 = i64, 2 = f64, 3 = u8),    |
+ * |        |      | size (u8), reserved (2 bytes, zero)     |
+ *
+ * The number of records is (file size - header size) / record size.
+ * Header and record sizes are multiples of 8, so every 8-byte field of
+ * a memory-mapped file is aligned.
+ *
+ * @param buf Output buffer, of `MOON_RECORD_HEADER_SIZE` bytes.
+ * @return `MOON_RECORD_HEADER_SIZE`.
+ */
+size_t moonphase_record_header(unsigned char* buf);
+
+/**
+ * Write MoonPhase object as a fixed-width binary record.
+ *
+ * Version 1 records are `MOON_RECORD_SIZE` bytes:
+ *
+ * | Offset | Type | Field                    |
+ * |--------|------|--------------------------|
+ * | 0      | i64  | timestamp                |
+ * | 8      | f64  | julian_date              |
+ * | 16     | f64  | age                      |
+ * | 24     | f64  | fraction_of_lunation     |
+ * | 32     | f64  | fraction_illuminated     |
+ * | 40     | f64  | distance_to_earth_km     |
+ * | 48     | f64  | subtends                 |
+ * | 56     | f64  | sun_distance_to_earth_km |
+ * | 64     | f64  | sun_subtends             |
+ * | 72     | u8   | phase                    |
+ * | 73     |      | Padding (7 bytes, zero)  |
+ *
+ * @param rec Output buffer, of `MOON_RECORD_SIZE` bytes.
+ * @param mphase Struct to write.
+ */
+void moonphase_to_record(unsigned char* rec, const MoonPhase* mphase);
+
+/**
+ * Write an ephemeris file covering the given range of Julian dates.
+ *
+ * Phase samples are computed every `step` days, from `from_jd` up to
+ * and including `to_jd`. Lunations are those in progress at any time
+ * of the range.
+ *
+ * @param path File to (over)write.
+ * @param from_jd First date of the range (first phase sample).
+ * @param to_jd Last date of the range.
+ * @param step Interval between phase samples, in days.
+ * @return 1 (true) = OK, 0 (false) = KO.
+ */
+int moonephem_write(
+    const char* path, double from_jd, double to_jd, double step
+);
+
+/**
+ * Map an ephemeris file into memory, read-only.
+ *
+ * The header and checksum are verified; files that are truncated,
+ * corrupted, or of an unknown version are rejected.
+ *
+ * @param eph The MoonEphemeris struct.
+ * @param path File to open.
+ * @return 1 (true) = OK, 0 (false) = KO.
+ */
+int moonephem_open(MoonEphemeris* eph, const char* path);
+
+/**
+ * Unmap an ephemeris file opened with `moonephem_open()`.
+ *
+ * @param eph The MoonEphemeris struct.
+ */
+void moonephem_close(MoonEphemeris* eph);
+
+/**
+ * Get the lunations in progress at any time between two dates.
+ *
+ * If there are more lunations than `capacity`, nothing is written, and
+ * `count` is set to the number of lunations (pass a capacity of zero to
+ * find out how much room is needed).
+ *
+ * @param eph The MoonEphemeris struct.
+ * @param from_jd Start of the range (inclusive).
+ * @param to_jd End of the range (exclusive).
+ * @param lunations Output array.
+ * @param capacity Length of `lunations`.
+ * @param count Number of lunations in the range.
+ * @return 1 (true) = OK, 0 (false) = KO (not enough capacity).
+ */
+int moonephem_lunations(
+    const MoonEphemeris* eph,
+    double from_jd,
+    double to_jd,
+    MoonLunation* lunations,
+    size_t capacity,
+    size_t* count
+);
+
+/**
+ * Get the phase samples taken between two dates.
+ *
+ * Same as `moonephem_lunations()`, but for phase samples, which are
+ * written to `columns` like with `moonphase_batch()`.
+ *
+ * @param eph The MoonEphemeris struct.
+ * @param from_jd Start of the range (inclusive).
+ * @param to_jd End of the range (exclusive).
+ * @param columns Output arrays; NULL members are not written to.
+ * @param capacity Length of the arrays of `columns`.
+ * @param count Number of samples in the range.
+ * @return 1 (true) = OK, 0 (false) = KO (not enough capacity).
+ */
+int moonephem_phases(
+    const MoonEphemeris* eph,
+    double from_jd,
+    double to_jd,
+    const MoonPhaseColumns* columns,
+    size_t capacity,
+    size_t* count
+);
+
+/**
+ * Fit a piecewise Chebyshev approximation of the phase of the Moon.
+ *
+ * The coefficients are allocated on the heap, and must be released with
+ * `moonchebyshev_free()`.
+ *
+ * @param cheb The MoonChebyshev struct.
+ * @param from_jd Start of the range (Julian date).
+ * @param to_jd End of the range (Julian date).
+ * @param interval Length of intervals, in days (e.g., 1.0).
+ * @param degree Degree of the polynomials (e.g., 8), 0 to 30.
+ * @return 1 (true) = OK, 0 (false) = KO.
+ */
+int moonchebyshev_fit(
+    MoonChebyshev* cheb,
+    double from_jd,
+    double to_jd,
+    double interval,
+    int degree
+);
+
+/**
+ * Release the coefficients allocated by `moonchebyshev_fit()`.
+ *
+ * @param cheb The MoonChebyshev struct.
+ */
+void moonchebyshev_free(MoonChebyshev* cheb);
+
+/**
+ * Same as `moonphase_batch()`, but evaluated from a Chebyshev
+ * approximation instead of the full model.
+ *
+ * This is much cheaper, at the cost of the errors in `max_error`.
+ *
+ * @param cheb Fitted approximation.
+ * @param columns Output arrays; NULL members are not written to.
+ * @param timestamps Times of snapshots.
+ * @param count Number of timestamps (and minimum length of columns).
+ * @return 1 (true) = OK, 0 (false) = KO (timestamp out of range).
+ */
+int moonchebyshev_batch(
+    const MoonChebyshev* cheb,
+    const MoonPhaseColumns* columns,
+    const time_t* timestamps,
+    size_t count
+);
+
+/**
+ * Name of the CPU variant the batch routines run with.
+ *
+ * The library selects the most recent one the CPU supports when it is
+ * loaded: "avx512", "avx2", "sse4" or "generic" (the only one outside
+ * x86, or when compiled with `MOON_NO_DISPATCH`). All variants return
+ * exactly the same results.
+ *
+ * The `MOON_CPU` environment variable forces a variant, by name, if
+ * the CPU supports it.
+ *
+ * @return Name of the variant.
+ */
+const char* moon_cpu_variant(void);
+
 #ifdef __cplusplus
 }  // extern "C"
 }  // namespace moon
@@ -0,0 +1,633 @@
+/**
+ * Microbenchmarks for moon.c.
+ *
+ * Every benchmark runs one operation over each of a fixed set of
+ * `N_INPUTS` inputs (the same on every run, and spread over 1900-2100 so
+ * all lunation ages and both calendar halves of the year are hit). One
+ * such pass is a sample. After `N_WARMUP` discarded passes, `N_SAMPLES`
+ * samples are timed; those outside Tukey's fences (1.5 interquartile
+ * range beyond the quartiles, e.g., preempted by the OS) are dropped as
+ * outliers, and the remaining ones are summarized.
+ *
+ * Usage: bench_moontool [NAME...]
+ *
+ * Only benchmarks whose names contain one of the NAMEs are run (all of
+ * them if there are none). With `make`: `make bench BENCH="phase kepler"`.
+ */
+
+#include "../moon/moon.c"
+#include "jtouct_float.h"
+#include "kepler_loop.h"
+#include "phasehunt_scan.h"
+#include "report_sprintf.h"
+#include "truephase_series.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define N_INPUTS 1024
+#define N_WARMUP 5
+#define N_SAMPLES 31
+
+typedef struct {
+    const char* name;
+    void (*run)(void);
+} Benchmark;
+
+static double dates[N_INPUTS];
+static time_t timestamps[N_INPUTS];
+static double anomalies[N_INPUTS];
+static double lunations[N_INPUTS];
+static MoonPhase mphases[N_INPUTS];
+static MoonCalendar mcals[N_INPUTS];
+static MoonChebyshev cheb;
+
+static double col_julian_date[N_INPUTS], col_age[N_INPUTS],
+    col_fraction_of_lunation[N_INPUTS], col_fraction_illuminated[N_INPUTS],
+    col_distance_to_earth_km[N_INPUTS], col_subtends[N_INPUTS],
+    col_sun_distance_to_earth_km[N_INPUTS], col_sun_subtends[N_INPUTS];
+static int col_phase[N_INPUTS];
+static float colf_age[N_INPUTS], colf_fraction_of_lunation[N_INPUTS],
+    colf_fraction_illuminated[N_INPUTS], colf_distance_to_earth_km[N_INPUTS],
+    colf_subtends[N_INPUTS], colf_sun_distance_to_earth_km[N_INPUTS],
+    colf_sun_subtends[N_INPUTS];
+static const MoonPhaseColumns columns = {
+    col_julian_date,
+    col_age,
+    col_fraction_of_lunation,
+    col_phase,
+    col_fraction_illuminated,
+    col_distance_to_earth_km,
+    col_subtends,
+    col_sun_distance_to_earth_km,
+    col_sun_subtends,
+};
+static const MoonPhaseColumnsFloat columns_float = {
+    col_julian_date,
+    colf_age,
+    colf_fraction_of_lunation,
+    col_phase,
+    colf_fraction_illuminated,
+    colf_distance_to_earth_km,
+    colf_subtends,
+    colf_sun_distance_to_earth_km,
+    colf_sun_subtends,
+};
+
+// Keeps results alive, so the compiler can't optimize the work away.
+static volatile double sink;
+
+double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void init_inputs(void) {
+    // 1900-01-01 to 2100-12-31, with an irrational-ish stride so that
+    // times of day and lunation ages don't repeat.
+    for (int i = 0; i < N_INPUTS; ++i) {
+        timestamps[i] = -2208988800 + (time_t)i * 6191423;
+        unixtoj(timestamps[i], &dates[i]);
+        anomalies[i] = fmod(i * 137.50776405, 360.0);
+        lunations[i] = floor((dates[i] - 2415020.75933) / synmonth);
+        moonphase(&mphases[i], &timestamps[i]);
+        mooncal(&mcals[i], &timestamps[i]);
+    }
+
+    // 1900 to 2100, for dates[] above.
+    moonchebyshev_fit(&cheb, 2415020.5, 2488435.5, 1.0, 8);
+}
+
+/* Original routines */
+
+void run_kepler(void) {
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = kepler_sun(anomalies[i]);
+    }
+}
+
+void run_kepler_loop(void) {
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = kepler_loop(anomalies[i], eccent);
+    }
+}
+
+void run_phase(void) {
+    double cphase, aom, cdist, cangdia, csund, csuang;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = phase(dates[i], &cphase, &aom, &cdist, &cangdia, &csund, &csuang)
+               + cphase + aom + cdist + cangdia + csund + csuang;
+    }
+}
+
+void run_phase_fast(void) {
+    double cphase, aom, cdist, cangdia, csund, csuang;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = phase_fast(dates[i], &cphase, &aom, &cdist, &cangdia, &csund, &csuang)
+               + cphase + aom + cdist + cangdia + csund + csuang;
+    }
+}
+
+void run_phase_high(void) {
+    double cphase, aom, cdist, cangdia, csund, csuang;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = phase_high(dates[i], &cphase, &aom, &cdist, &cangdia, &csund, &csuang)
+               + cphase + aom + cdist + cangdia + csund + csuang;
+    }
+}
+
+void run_meanphase(void) {
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = meanphase(dates[i], lunations[i]);
+    }
+}
+
+void run_truephase(void) {
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = truephase(lunations[i], (i % 4) * 0.25);
+    }
+}
+
+void run_truephase_series(void) {
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = truephase_series(lunations[i], (i % 4) * 0.25);
+    }
+}
+
+void run_truephases(void) {
+    double phases[5];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        truephases(lunations[i], phases);
+        sink = phases[0] + phases[1] + phases[2] + phases[3] + phases[4];
+    }
+}
+
+void run_phasehunt(void) {
+    double phasar[5];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        phasehunt(dates[i], phasar);
+        sink = phasar[0] + phasar[1] + phasar[2] + phasar[3] + phasar[4];
+    }
+}
+
+void run_phasehunt_scan(void) {
+    double phasar[5];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        phasehunt_scan(dates[i], phasar);
+        sink = phasar[0] + phasar[1] + phasar[2] + phasar[3] + phasar[4];
+    }
+}
+
+void run_lunation_table_lookup(void) {
+    double phasar[5];
+    long lunation;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = lunation_table_lookup(dates[i], phasar, &lunation) ? phasar[0] : 0;
+    }
+}
+
+void run_jtime(void) {
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = jtime(&mphases[i].utc_datetime);
+    }
+}
+
+void run_unixtoj(void) {
+    double jd;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = unixtoj(timestamps[i], &jd) ? jd : 0;
+    }
+}
+
+void run_jyear(void) {
+    long yy;
+    int mm, dd;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        jyear(dates[i], &yy, &mm, &dd);
+        sink = yy + mm + dd;
+    }
+}
+
+void run_jcivil(void) {
+    long yy;
+    int mm, dd;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        jcivil((int64_t) floor(dates[i] + 0.5), &yy, &mm, &dd);
+        sink = yy + mm + dd;
+    }
+}
+
+void run_jtouct_float(void) {
+    struct tm gm;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        jtouct_float(dates[i], &gm);
+        sink = gm.tm_year + gm.tm_mon + gm.tm_mday + gm.tm_wday
+               + gm.tm_hour + gm.tm_min + gm.tm_sec;
+    }
+}
+
+void run_jtouct(void) {
+    struct tm gm;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        jtouct(dates[i], &gm);
+        sink = gm.tm_year + gm.tm_mon + gm.tm_mday + gm.tm_wday
+               + gm.tm_hour + gm.tm_min + gm.tm_sec;
+    }
+}
+
+/* Public API */
+
+void run_moonphase(void) {
+    MoonPhase mphase;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = moonphase(&mphase, &timestamps[i]) ? mphase.age : 0;
+    }
+}
+
+void run_moonphase_precision_fast(void) {
+    MoonPhase mphase;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = moonphase_precision(&mphase, &timestamps[i], MOON_PRECISION_FAST)
+                   ? mphase.age : 0;
+    }
+}
+
+void run_moonphase_precision_high(void) {
+    MoonPhase mphase;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = moonphase_precision(&mphase, &timestamps[i], MOON_PRECISION_HIGH)
+                   ? mphase.age : 0;
+    }
+}
+
+void run_moonphase_batch(void) {
+    moonphase_batch(&columns, timestamps, N_INPUTS);
+    sink = col_age[0];
+}
+
+void run_moonphase_batch_float(void) {
+    moonphase_batch_float(&columns_float, timestamps, N_INPUTS);
+    sink = colf_age[0];
+}
+
+void run_moonchebyshev_batch(void) {
+    moonchebyshev_batch(&cheb, &columns, timestamps, N_INPUTS);
+    sink = col_age[0];
+}
+
+void run_moonphase_iter_next(void) {
+    MoonPhaseIterator it;
+    time_t start = 1704067200;  // 2024, every minute.
+    moonphase_iter_init(&it, &start, 60);
+    moonphase_iter_next(&it, &columns, N_INPUTS);
+    sink = col_age[0];
+}
+
+// Scaling: same range on 1 to 8 threads (fewer if there are fewer
+// cores, as extra threads then only add overhead).
+#define RANGE_BENCHMARKS(threads)                                        \
+    void run_moonphase_range_##threads(void) {                           \
+        moonphase_range(mphases_out, &timestamps[0], 6191423, N_INPUTS, threads); \
+        sink = mphases_out[0].age;                                       \
+    }                                                                    \
+    void run_mooncal_range_##threads(void) {                             \
+        mooncal_range(mcals_out, &timestamps[0], 6191423, N_INPUTS, threads); \
+        sink = mcals_out[0].full_moon;                                   \
+    }
+
+static MoonPhase mphases_out[N_INPUTS];
+static MoonCalendar mcals_out[N_INPUTS];
+
+RANGE_BENCHMARKS(1)
+RANGE_BENCHMARKS(2)
+RANGE_BENCHMARKS(4)
+RANGE_BENCHMARKS(8)
+
+void run_mooncal(void) {
+    MoonCalendar mcal;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = mooncal(&mcal, &timestamps[i]) ? mcal.full_moon : 0;
+    }
+}
+
+// A year per input, from `first`.
+static void mooncal_years(long first) {
+    MoonPhaseEvent events[MOON_YEAR_MAX_EVENTS];
+    size_t count;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = mooncal_year(events, MOON_YEAR_MAX_EVENTS, first + i % 200, &count)
+            ? events[0].date
+            : 0;
+    }
+}
+
+// The alternative: mooncal() often enough to see every lunation, keeping
+// each phase once.
+static void mooncal_years_by_mooncal(long first) {
+    for (int i = 0; i < N_INPUTS; ++i) {
+        MoonCalendar mcal;
+        time_t t = (first - 1970 + i % 200) * (time_t)31556952;
+        time_t end = t + 31556952;
+        double last = 0;
+        for (; t < end; t += 14 * 86400) {
+            mooncal(&mcal, &t);
+            if (mcal.last_new_moon > last)
+                last = mcal.last_new_moon;
+        }
+        sink = last;
+    }
+}
+
+void run_mooncal_year(void) {
+    mooncal_years(1900);
+}
+
+void run_mooncal_year_by_mooncal(void) {
+    mooncal_years_by_mooncal(1900);
+}
+
+// Past the lunation table.
+void run_mooncal_year_2200(void) {
+    mooncal_years(2200);
+}
+
+void run_mooncal_year_2200_by_mooncal(void) {
+    mooncal_years_by_mooncal(2200);
+}
+
+void run_moonphase_next_crossing(void) {
+    MoonCrossing crossing;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        moonphase_next_crossing(
+            &crossing, MOON_CROSSING_FRACTION_ILLUMINATED, 0.99, 1, dates[i],
+            1.0 / 86400
+        );
+        sink = crossing.date;
+    }
+}
+
+// The alternative: sampling every hour until the threshold is reached
+// (and still only knowing the time to within the hour).
+void run_moonphase_next_crossing_by_sampling(void) {
+    double pphase, mage, dist, angdia, sudist, suangdia;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        double jd = dates[i];
+        phase(jd, &pphase, &mage, &dist, &angdia, &sudist, &suangdia);
+        double last = pphase;
+        for (;; jd += 1.0 / 24) {
+            phase(jd, &pphase, &mage, &dist, &angdia, &sudist, &suangdia);
+            if (pphase >= 0.99 && last < 0.99)
+                break;
+            last = pphase;
+        }
+        sink = jd;
+    }
+}
+
+// A year from each date.
+void run_moonphase_apsides(void) {
+    MoonApsis apsides[32];
+    size_t count;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        moonphase_apsides(apsides, 32, dates[i], dates[i] + 365.25, 0, &count);
+        sink = apsides[0].date;
+    }
+}
+
+void run_mooncal_syzygies(void) {
+    MoonSyzygy syzygies[32];
+    size_t count;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        mooncal_syzygies(
+            syzygies, 32, dates[i], dates[i] + 365.25, 0.9, &count
+        );
+        sink = syzygies[0].closeness;
+    }
+}
+
+void run_moonphase_to_strbuf(void) {
+    char buf[1000];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        moonphase_to_strbuf(&mphases[i], buf);
+        sink = buf[0];
+    }
+}
+
+void run_mooncal_to_strbuf(void) {
+    char buf[500];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        mooncal_to_strbuf(&mcals[i], buf);
+        sink = buf[0];
+    }
+}
+
+void run_moonphase_to_strbuf_sprintf(void) {
+    char buf[1000];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        moonphase_to_strbuf_sprintf(&mphases[i], buf);
+        sink = buf[0];
+    }
+}
+
+void run_mooncal_to_strbuf_sprintf(void) {
+    char buf[500];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        mooncal_to_strbuf_sprintf(&mcals[i], buf);
+        sink = buf[0];
+    }
+}
+
+void run_moonphase_to_json(void) {
+    char buf[1000];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = (double)moonphase_to_json(buf, sizeof(buf), &mphases[i]);
+    }
+}
+
+void run_moonphase_to_csv(void) {
+    char buf[500];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = (double)moonphase_to_csv(buf, sizeof(buf), &mphases[i]);
+    }
+}
+
+void run_moonphase_to_csv_snprintf(void) {
+    char buf[500];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = (double)moonphase_to_csv_snprintf(buf, sizeof(buf), &mphases[i]);
+    }
+}
+
+void run_mooncal_to_json(void) {
+    char buf[1000];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = (double)mooncal_to_json(buf, sizeof(buf), &mcals[i]);
+    }
+}
+
+void run_moonphase_to_record(void) {
+    unsigned char rec[MOON_RECORD_SIZE];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        moonphase_to_record(rec, &mphases[i]);
+        sink = rec[72];
+    }
+}
+
+void run_fmt_double(void) {
+    char buf[32];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        FmtBuf f = {buf, sizeof(buf), 0};
+        fmt_double(&f, dates[i]);
+        sink = (double)fmt_end(&f);
+    }
+}
+
+void run_fmt_double_snprintf(void) {
+    char buf[32];
+    for (int i = 0; i < N_INPUTS; ++i) {
+        sink = snprintf(buf, sizeof(buf), "%.17g", dates[i]);
+    }
+}
+
+static const Benchmark benchmarks[] = {
+    {"kepler", run_kepler},
+    {"kepler_loop", run_kepler_loop},
+    {"phase", run_phase},
+    {"phase_fast", run_phase_fast},
+    {"phase_high", run_phase_high},
+    {"meanphase", run_meanphase},
+    {"truephase", run_truephase},
+    {"truephase_series", run_truephase_series},
+    {"truephases", run_truephases},
+    {"phasehunt", run_phasehunt},
+    {"phasehunt_scan", run_phasehunt_scan},
+    {"lunation_table_lookup", run_lunation_table_lookup},
+    {"jtime", run_jtime},
+    {"unixtoj", run_unixtoj},
+    {"jyear", run_jyear},
+    {"jcivil", run_jcivil},
+    {"jtouct_float", run_jtouct_float},
+    {"jtouct", run_jtouct},
+    {"moonphase", run_moonphase},
+    {"moonphase_precision_fast", run_moonphase_precision_fast},
+    {"moonphase_precision_high", run_moonphase_precision_high},
+    {"moonphase_batch", run_moonphase_batch},
+    {"moonphase_batch_float", run_moonphase_batch_float},
+    {"moonchebyshev_batch", run_moonchebyshev_batch},
+    {"moonphase_iter_next", run_moonphase_iter_next},
+    {"moonphase_range_1", run_moonphase_range_1},
+    {"moonphase_range_2", run_moonphase_range_2},
+    {"moonphase_range_4", run_moonphase_range_4},
+    {"moonphase_range_8", run_moonphase_range_8},
+    {"mooncal", run_mooncal},
+    {"mooncal_range_1", run_mooncal_range_1},
+    {"mooncal_range_2", run_mooncal_range_2},
+    {"mooncal_range_4", run_mooncal_range_4},
+    {"mooncal_range_8", run_mooncal_range_8},
+    {"mooncal_year", run_mooncal_year},
+    {"mooncal_year_by_mooncal", run_mooncal_year_by_mooncal},
+    {"mooncal_year_2200", run_mooncal_year_2200},
+    {"mooncal_year_2200_by_mooncal", run_mooncal_year_2200_by_mooncal},
+    {"moonphase_next_crossing", run_moonphase_next_crossing},
+    {"moonphase_next_crossing_by_sampling", run_moonphase_next_crossing_by_sampling},
+    {"moonphase_apsides", run_moonphase_apsides},
+    {"mooncal_syzygies", run_mooncal_syzygies},
+    {"moonphase_to_strbuf", run_moonphase_to_strbuf},
+    {"mooncal_to_strbuf", run_mooncal_to_strbuf},
+    {"moonphase_to_strbuf_sprintf", run_moonphase_to_strbuf_sprintf},
+    {"mooncal_to_strbuf_sprintf", run_mooncal_to_strbuf_sprintf},
+    {"moonphase_to_json", run_moonphase_to_json},
+    {"mooncal_to_json", run_mooncal_to_json},
+    {"moonphase_to_csv", run_moonphase_to_csv},
+    {"moonphase_to_csv_snprintf", run_moonphase_to_csv_snprintf},
+    {"moonphase_to_record", run_moonphase_to_record},
+    {"fmt_double", run_fmt_double},
+    {"fmt_double_snprintf", run_fmt_double_snprintf},
+};
+
+/* Harness */
+
+int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void run_benchmark(const Benchmark* benchmark) {
+    double samples[N_SAMPLES];
+
+    for (int i = 0; i < N_WARMUP; ++i) {
+        benchmark->run();
+    }
+
+    for (int i = 0; i < N_SAMPLES; ++i) {
+        double start = now_ns();
+        benchmark->run();
+        samples[i] = (now_ns() - start) / N_INPUTS;
+    }
+
+    qsort(samples, N_SAMPLES, sizeof(samples[0]), compare_doubles);
+
+    double q1 = samples[N_SAMPLES / 4];
+    double q3 = samples[(3 * N_SAMPLES) / 4];
+    double low = q1 - 1.5 * (q3 - q1);
+    double high = q3 + 1.5 * (q3 - q1);
+
+    double sum = 0.0, sum_sq = 0.0;
+    int kept = 0;
+    for (int i = 0; i < N_SAMPLES; ++i) {
+        if (samples[i] < low || samples[i] > high)
+            continue;
+        sum += samples[i];
+        sum_sq += samples[i] * samples[i];
+        ++kept;
+    }
+
+    double mean = sum / kept;
+    double variance = (kept > 1) ? (sum_sq - sum * mean) / (kept - 1) : 0.0;
+    double stddev = sqrt(variance > 0.0 ? variance : 0.0);
+
+    printf(
+        "%-36s %12.1f %9.1f%% %14.0f %6d/%d\n",
+        benchmark->name,
+        mean,
+        100.0 * stddev / mean,
+        1e9 / mean,
+        N_SAMPLES - kept,
+        N_SAMPLES
+    );
+}
+
+int is_selected(const char* name, int argc, char* argv[]) {
+    if (argc < 2)
+        return TRUE;
+    for (int i = 1; i < argc; ++i) {
+        if (strstr(name, argv[i]) != NULL)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+int main(int argc, char* argv[]) {
+    init_inputs();
+
+    printf(
+        "%-36s %12s %10s %14s %9s\n",
+        "benchmark",
+        "ns/op",
+        "stddev",
+        "ops/s",
+        "outliers"
+    );
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+        if (is_selected(benchmarks[i].name, argc, argv))
+            run_benchmark(&benchmarks[i]);
+    }
+
+    moonchebyshev_free(&cheb);
+    return EXIT_SUCCESS;
+}
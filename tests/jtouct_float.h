@@ -0,0 +1,73 @@
+#ifndef TESTS_JTOUCT_FLOAT_H_
+#define TESTS_JTOUCT_FLOAT_H_
+
+// Original, floating-point version of `jtouct()`, and the routines it
+// was made of, kept as a reference for tests and benchmarks. Must be
+// included after `moon.c`.
+
+/*  JYEAR  --  Convert    Julian    date  to  year,  month, day, which are
+               returned via integer pointers to integers (note that year is a long).  */
+
+static void jyear(double td, long *yy, int *mm, int *dd) {
+    double z, f, a, alpha, b, c, d, e;
+
+    td += 0.5;
+    z = floor(td);
+    f = td - z;
+
+    if (z < 2299161.0) {
+        a = z;
+    } else {
+        alpha = floor((z - 1867216.25) / 36524.25);
+        a = z + 1 + alpha - floor(alpha / 4);
+    }
+
+    b = a + 1524;
+    c = floor((b - 122.1) / 365.25);
+    d = floor(365.25 * c);
+    e = floor((b - d) / 30.6001);
+
+    *dd = (int) (b - d - floor(30.6001 * e) + f);
+    *mm = (int) ((e < 14) ? (e - 1) : (e - 13));
+    *yy = (long) ((*mm > 2) ? (c - 4716) : (c - 4715));
+}
+
+/*  JHMS  --  Convert Julian time to hour, minutes, and seconds.  */
+
+static void jhms(double j, int *h, int *m, int *s) {
+    long ij;
+
+    j += 0.5;                 /* Astronomical to civil */
+    ij = (long) (((j - floor(j)) * 86400.0) + 0.5);  // Round to nearest second
+    *h = (int) (ij / 3600L);
+    *m = (int) ((ij / 60L) % 60L);
+    *s = (int) (ij % 60L);
+}
+
+/*  JWDAY  --  Determine day of the week for a given Julian day.  */
+
+static int jwday(double j) {
+    return ((int) (j + 1.5)) % 7;
+}
+
+static void jtouct_float(double utime, struct tm *gm) {
+    long yy;
+    int mm, dd, wday, hh, mmm, ss;
+
+    jyear(utime, &yy, &mm, &dd);
+    jhms(utime, &hh, &mmm, &ss);
+    wday = jwday(utime);
+
+    memset(gm, 0, sizeof(struct tm));
+    gm->tm_isdst = 0;
+
+    gm->tm_year = yy - 1900;
+    gm->tm_mon = mm - 1;
+    gm->tm_mday = dd;
+    gm->tm_wday = wday;
+    gm->tm_hour = hh;
+    gm->tm_min = mmm;
+    gm->tm_sec = ss;
+}
+
+#endif  // TESTS_JTOUCT_FLOAT_H_
@@ -0,0 +1,19 @@
+#ifndef TESTS_KEPLER_LOOP_H_
+#define TESTS_KEPLER_LOOP_H_
+
+// Original, iterative version of `kepler_sun()`, for any eccentricity,
+// kept as a reference for tests and benchmarks. Must be included after
+// `moon.c`.
+
+static double kepler_loop(double m, double ecc) {
+    double e, delta;
+
+    e = m = torad(m);
+    do {
+        delta = e - ecc * sin(e) - m;
+        e -= delta / (1 - ecc * cos(e));
+    } while (abs(delta) > 1E-6);
+    return e;
+}
+
+#endif  // TESTS_KEPLER_LOOP_H_
@@ -0,0 +1,35 @@
+#ifndef TESTS_PHASEHUNT_SCAN_H_
+#define TESTS_PHASEHUNT_SCAN_H_
+
+// Original, scanning version of `phasehunt()`, kept as a reference for
+// tests and benchmarks. Must be included after `moon.c` and
+// `jtouct_float.h`.
+
+static void phasehunt_scan(double sdate, double phases[5]) {
+    double adate, k1, k2, nt1, nt2;
+    long yy;
+    int mm, dd;
+
+    adate = sdate - 45;
+
+    jyear(adate, &yy, &mm, &dd);
+    k1 = floor((yy + ((mm - 1) * (1.0 / 12.0)) - 1900) * 12.3685);
+
+    adate = nt1 = meanphase(adate, k1);
+    while (TRUE) {
+        adate += synmonth;
+        k2 = k1 + 1;
+        nt2 = meanphase(adate, k2);
+        if (nt1 <= sdate && nt2 > sdate)
+            break;
+        nt1 = nt2;
+        k1 = k2;
+    }
+    phases[0] = truephase(k1, 0.0);
+    phases[1] = truephase(k1, 0.25);
+    phases[2] = truephase(k1, 0.5);
+    phases[3] = truephase(k1, 0.75);
+    phases[4] = truephase(k2, 0.0);
+}
+
+#endif  // TESTS_PHASEHUNT_SCAN_H_
@@ -0,0 +1,107 @@
+#ifndef TESTS_RECORD_READER_H_
+#define TESTS_RECORD_READER_H_
+
+// Standalone reader for binary phase record files (see
+// `moonphase_record_header()`), as a downstream tool would write it:
+// it only relies on the documented format, not on `moon.c`.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RECORD_READER_VERSION 1
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t field_count;
+    size_t record_count;
+} RecordReader;
+
+typedef struct {
+    uint32_t offset;
+    uint8_t type;  // 1 = i64, 2 = f64, 3 = u8.
+    uint8_t size;
+} RecordField;
+
+static uint32_t record_reader_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+        | (uint32_t)p[3] << 24;
+}
+
+static uint64_t record_reader_u64(const unsigned char* p) {
+    return (uint64_t)record_reader_u32(p)
+        | (uint64_t)record_reader_u32(p + 4) << 32;
+}
+
+// Returns 0 if the data isn't a (complete) version 1 record file.
+static int record_reader_open(
+    RecordReader* reader, const unsigned char* data, size_t size
+) {
+    if (size < 24 || memcmp(data, "MOONREC", 8) != 0)
+        return 0;
+    if (record_reader_u32(data + 8) != RECORD_READER_VERSION)
+        return 0;
+
+    reader->data = data;
+    reader->size = size;
+    reader->header_size = record_reader_u32(data + 12);
+    reader->record_size = record_reader_u32(data + 16);
+    reader->field_count = record_reader_u32(data + 20);
+
+    if (reader->header_size > size
+        || reader->header_size < 24 + (size_t)reader->field_count * 40
+        || reader->record_size == 0
+        || (size - reader->header_size) % reader->record_size != 0)
+        return 0;
+
+    reader->record_count = (size - reader->header_size) / reader->record_size;
+    return 1;
+}
+
+// Returns 0 if there is no such field.
+static int record_reader_field(
+    const RecordReader* reader, const char* name, RecordField* field
+) {
+    for (uint32_t i = 0; i < reader->field_count; ++i) {
+        const unsigned char* p = reader->data + 24 + (size_t)i * 40;
+        if (strncmp((const char*)p, name, 32) != 0)
+            continue;
+        field->offset = record_reader_u32(p + 32);
+        field->type = p[36];
+        field->size = p[37];
+        return field->offset + field->size <= reader->record_size;
+    }
+    return 0;
+}
+
+static const unsigned char* record_reader_record(
+    const RecordReader* reader, size_t i
+) {
+    return reader->data + reader->header_size + i * reader->record_size;
+}
+
+static int64_t record_reader_i64(
+    const RecordReader* reader, size_t i, const RecordField* field
+) {
+    return (int64_t)record_reader_u64(record_reader_record(reader, i) + field->offset);
+}
+
+static double record_reader_f64(
+    const RecordReader* reader, size_t i, const RecordField* field
+) {
+    uint64_t bits = record_reader_u64(record_reader_record(reader, i) + field->offset);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+static uint8_t record_reader_u8(
+    const RecordReader* reader, size_t i, const RecordField* field
+) {
+    return record_reader_record(reader, i)[field->offset];
+}
+
+#endif  // TESTS_RECORD_READER_H_
@@ -0,0 +1,172 @@
+#ifndef TESTS_REPORT_SPRINTF_H_
+#define TESTS_REPORT_SPRINTF_H_
+
+// Original, sprintf()-based report formatting, kept as a reference for
+// tests and benchmarks. Must be included after `moon.c`.
+
+// clang-format off
+
+static void fmt_phase_time_sprintf(const struct tm *gm, char *buf)
+{
+    sprintf(buf, "%-9s %2d:%02d UTC %2d %-5s %d",
+    dayname [gm->tm_wday], gm->tm_hour, gm->tm_min,
+    gm->tm_mday, moname [gm->tm_mon], gm->tm_year + 1900);
+}
+
+static void moonphase_to_strbuf_sprintf(const MoonPhase *mphase, char *buf)
+{
+    MoonPhase p;
+    if (mphase == NULL) {
+        if (!init_moonphase((MoonPhase*) (mphase = &p))) {
+            fprintf(stderr, "Error computing info about the phase of the Moon.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double aom;
+    int aom_d, aom_h, aom_m;
+    unsigned int offset = 0;
+
+    aom = mphase->age;
+    aom_d = (int) aom;
+    aom_h = (int) (24 * (aom - floor(aom)));
+    aom_m = (int) (1440 * (aom - floor(aom))) % 60;
+
+    const struct tm *gm = &mphase->utc_datetime;
+    struct tm local;
+
+    offset += sprintf(buf + offset, "Phase\n=====\n\n");
+    offset += sprintf(
+        buf + offset,
+        "Julian date:\t\t%.5f   (0h variant: %.5f)\n",
+        mphase->julian_date,
+        mphase->julian_date + 0.5
+    );
+    offset += sprintf(
+        buf + offset,
+        "Universal time:\t\t%-9s %2d:%02d:%02d %2d %-5s %d\n",
+        dayname[gm->tm_wday],
+        gm->tm_hour,
+        gm->tm_min,
+        gm->tm_sec,
+        gm->tm_mday,
+        moname[gm->tm_mon],
+        gm->tm_year + 1900
+    );
+    gm = localtime_r(&mphase->timestamp, &local);
+    offset += sprintf(
+        buf + offset,
+        "Local time:\t\t%-9s %2d:%02d:%02d %2d %-5s %d\n\n",
+        dayname[gm->tm_wday],
+        gm->tm_hour,
+        gm->tm_min,
+        gm->tm_sec,
+        gm->tm_mday,
+        moname[gm->tm_mon],
+        gm->tm_year + 1900
+    );
+
+    offset += sprintf(
+        buf + offset,
+        "Age of moon:\t\t%d day%s, %d hour%s, %d minute%s.\n",
+        EPL(aom_d),
+        EPL(aom_h),
+        EPL(aom_m)
+    );
+    offset += sprintf(
+        buf + offset,
+        "Lunation:\t\t%.2f%%   (%s %s)\n",
+        mphase->fraction_of_lunation * 100,
+        mphase->phase_icon,
+        mphase->phase_name
+    );
+    offset += sprintf(
+        buf + offset,
+        "Moon phase:\t\t%.2f%%   (0%% = New, 100%% = Full)\n\n",
+        mphase->fraction_illuminated * 100
+    );
+
+    offset += sprintf(
+        buf + offset,
+        "Moon's distance:\t%ld kilometres, %.1f Earth radii.\n",
+        (long) mphase->distance_to_earth_km,
+        mphase->distance_to_earth_earth_radii
+    );
+    offset += sprintf(
+        buf + offset,
+        "Moon subtends:\t\t%.4f degrees.\n\n",
+        mphase->subtends
+    );
+
+    offset += sprintf(
+        buf + offset,
+        "Sun's distance:\t\t%ld kilometres, %.3f astronomical units.\n",
+        (long) mphase->sun_distance_to_earth_km,
+        mphase->sun_distance_to_earth_astronomical_units
+    );
+    offset += sprintf(
+        buf + offset,
+        "Sun subtends:\t\t%.4f degrees.",
+        mphase->sun_subtends
+    );
+}
+
+static void mooncal_to_strbuf_sprintf(const MoonCalendar *mcal, char *buf)
+{
+    MoonCalendar c;
+    if (mcal == NULL) {
+        if (!init_mooncal((MoonCalendar*) (mcal = &c))) {
+            fprintf(stderr, "Error computing the Moon calendar.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char tbuf[80];
+    unsigned int offset = 0;
+
+    offset += sprintf(buf + offset, "Moon Calendar\n=============\n\n");
+    fmt_phase_time_sprintf(&mcal->last_new_moon_utc, tbuf);
+    offset += sprintf(
+        buf + offset,
+        "Last new moon:\t\t%s\tLunation: %ld\n",
+        tbuf,
+        mcal->lunation
+    );
+    fmt_phase_time_sprintf(&mcal->first_quarter_utc, tbuf);
+    offset += sprintf(buf + offset, "First quarter:\t\t%s\n", tbuf);
+    fmt_phase_time_sprintf(&mcal->full_moon_utc, tbuf);
+    offset += sprintf(buf + offset, "Full moon:\t\t%s\n", tbuf);
+    fmt_phase_time_sprintf(&mcal->last_quarter_utc, tbuf);
+    offset += sprintf(buf + offset, "Last quarter:\t\t%s\n", tbuf);
+    fmt_phase_time_sprintf(&mcal->next_new_moon_utc, tbuf);
+    offset += sprintf(
+        buf + offset,
+        "Next new moon:\t\t%s\tLunation: %ld",
+        tbuf,
+        mcal->lunation + 1
+    );
+}
+
+static size_t moonphase_to_csv_snprintf(char *buf, size_t len,
+                                        const MoonPhase *mphase)
+{
+    return (size_t) snprintf(
+        buf,
+        len,
+        "%ld,%.17g,%.17g,%.17g,%d,%.17g,%.17g,%.17g,%.17g,%.17g",
+        (long) mphase->timestamp,
+        mphase->julian_date,
+        mphase->age,
+        mphase->fraction_of_lunation,
+        mphase->phase,
+        mphase->fraction_illuminated,
+        mphase->distance_to_earth_km,
+        mphase->subtends,
+        mphase->sun_distance_to_earth_km,
+        mphase->sun_subtends
+    );
+}
+
+// clang-format on
+
+#endif  // TESTS_REPORT_SPRINTF_H_
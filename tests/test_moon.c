@@ -1,6 +1,13 @@
 #include "../moon/moon.c"
+#include "jtouct_float.h"
+#include "kepler_loop.h"
+#include "phasehunt_scan.h"
+#include "record_reader.h"
+#include "report_sprintf.h"
+#include "truephase_series.h"
 
 #include <assert.h>
+#include <float.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -12,6 +19,13 @@ void assert_almost_equal(double a, double b) {
     }
 }
 
+void assert_within(double a, double b, double tolerance) {
+    if (abs(a - b) > tolerance) {
+        fprintf(stderr, "%.17g != %.17g (+/- %g)\n", a, b, tolerance);
+        assert(FALSE);
+    }
+}
+
 void redact_local_time(char* phase) {
     char* prefix = "Local time:\t\t";
     int prefix_len = strlen(prefix);
@@ -153,6 +167,22 @@ void test_moonphase_multiple_creations(void) {
     assert(&mphase.utc_datetime != &other.utc_datetime);
 }
 
+void test_moonphase_does_not_use_static_time_storage(void) {
+    time_t earlier = 0;
+    const struct tm* gm = gmtime(&earlier);
+
+    MoonPhase mphase;
+    time_t timestamp = 794886000;
+    assert(moonphase(&mphase, &timestamp));
+
+    // Also covers localtime(), which shares gmtime()'s buffer (glibc).
+    char buf[1000];
+    moonphase_to_strbuf(&mphase, buf);
+
+    assert(gm->tm_year == 70);
+    assert(gm->tm_yday == 0);
+}
+
 void test_moonphase_display(void) {
     MoonPhase mphase;
     time_t timestamp = 794886000;
@@ -188,6 +218,494 @@ void test_moonphase_display(void) {
     );
 }
 
+void test_moonphase_batch_matches_moonphase(void) {
+    time_t timestamps[4] = {794886000, 1714809600, 0, -1000000000};
+    double julian_date[4], age[4], fraction_of_lunation[4], fraction_illuminated[4];
+    double distance_to_earth_km[4], subtends[4];
+    double sun_distance_to_earth_km[4], sun_subtends[4];
+    int phase[4];
+
+    MoonPhaseColumns columns = {
+        .julian_date = julian_date,
+        .age = age,
+        .fraction_of_lunation = fraction_of_lunation,
+        .phase = phase,
+        .fraction_illuminated = fraction_illuminated,
+        .distance_to_earth_km = distance_to_earth_km,
+        .subtends = subtends,
+        .sun_distance_to_earth_km = sun_distance_to_earth_km,
+        .sun_subtends = sun_subtends,
+    };
+
+    assert(moonphase_batch(&columns, timestamps, 4));
+
+    for (int i = 0; i < 4; ++i) {
+        MoonPhase mphase;
+        assert(moonphase(&mphase, &timestamps[i]));
+
+        assert_almost_equal(julian_date[i], mphase.julian_date);
+        assert_almost_equal(age[i], mphase.age);
+        assert_almost_equal(fraction_of_lunation[i], mphase.fraction_of_lunation);
+        assert(phase[i] == mphase.phase);
+        assert_almost_equal(fraction_illuminated[i], mphase.fraction_illuminated);
+        assert_within(distance_to_earth_km[i], mphase.distance_to_earth_km, 1e-9);
+        assert_almost_equal(subtends[i], mphase.subtends);
+        assert_within(
+            sun_distance_to_earth_km[i], mphase.sun_distance_to_earth_km, 1e-6
+        );
+        assert_almost_equal(sun_subtends[i], mphase.sun_subtends);
+    }
+}
+
+void test_moonphase_batch_skips_null_columns(void) {
+    time_t timestamps[2] = {794886000, 794972400};
+    double age[2] = {-1.0, -1.0};
+
+    MoonPhaseColumns columns = {0};
+    columns.age = age;
+
+    assert(moonphase_batch(&columns, timestamps, 2));
+
+    assert_almost_equal(age[0], 8.861826144635483);
+    assert(age[1] > age[0]);
+}
+
+void test_moonphase_batch_empty(void) {
+    MoonPhaseColumns columns = {0};
+
+    assert(moonphase_batch(&columns, NULL, 0));
+}
+
+#define TEST_EPHEMERIS "target/test_moon.eph"
+
+static void assert_moonphase_equal(const MoonPhase* a, const MoonPhase* b) {
+    assert(a->timestamp == b->timestamp);
+    assert(a->julian_date == b->julian_date);
+    assert(a->utc_datetime.tm_year == b->utc_datetime.tm_year);
+    assert(a->utc_datetime.tm_yday == b->utc_datetime.tm_yday);
+    assert(a->utc_datetime.tm_sec == b->utc_datetime.tm_sec);
+    assert(a->age == b->age);
+    assert(a->fraction_of_lunation == b->fraction_of_lunation);
+    assert(a->phase == b->phase);
+    assert(a->phase_name == b->phase_name);
+    assert(a->fraction_illuminated == b->fraction_illuminated);
+    assert(a->distance_to_earth_km == b->distance_to_earth_km);
+    assert(a->subtends == b->subtends);
+    assert(a->sun_distance_to_earth_km == b->sun_distance_to_earth_km);
+    assert(a->sun_subtends == b->sun_subtends);
+}
+
+void test_moonphase_range_matches_moonphase(void) {
+    enum { N = 1000 };
+    static MoonPhase range[N];
+    time_t start = -2208988800;  // 1900, every ~3 days.
+    long step = 262147;
+    int threads[] = {1, 2, 3, 7, 0};
+
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+        memset(range, 0, sizeof(range));
+        assert(moonphase_range(range, &start, step, N, threads[t]));
+        for (int i = 0; i < N; ++i) {
+            MoonPhase expected;
+            time_t timestamp = start + (time_t)i * step;
+            moonphase(&expected, &timestamp);
+            assert_moonphase_equal(&range[i], &expected);
+        }
+    }
+}
+
+void test_moonphase_range_backwards_and_small(void) {
+    MoonPhase range[5];
+    time_t start = 788104414;
+
+    // Fewer entries than threads, and a negative step.
+    assert(moonphase_range(range, &start, -3600, 5, 16));
+    for (int i = 0; i < 5; ++i) {
+        MoonPhase expected;
+        time_t timestamp = start - (time_t)i * 3600;
+        moonphase(&expected, &timestamp);
+        assert_moonphase_equal(&range[i], &expected);
+    }
+
+    assert(moonphase_range(range, &start, 60, 0, 4));
+}
+
+void test_mooncal_range_matches_mooncal(void) {
+    enum { N = 600 };
+    static MoonCalendar range[N];
+    time_t start = 946684800;  // 2000, every 9 hours.
+    long step = 32400;
+
+    assert(mooncal_range(range, &start, step, N, 4));
+    for (int i = 0; i < N; ++i) {
+        MoonCalendar expected;
+        time_t timestamp = start + (time_t)i * step;
+        mooncal(&expected, &timestamp);
+        assert(range[i].timestamp == expected.timestamp);
+        assert(range[i].lunation == expected.lunation);
+        assert(range[i].last_new_moon == expected.last_new_moon);
+        assert(range[i].full_moon == expected.full_moon);
+        assert(range[i].next_new_moon == expected.next_new_moon);
+        assert(range[i].next_new_moon_utc.tm_min == expected.next_new_moon_utc.tm_min);
+    }
+}
+
+void test_moonephem_roundtrip_lunations(void) {
+    MoonEphemeris eph;
+    MoonLunation lunations[8];
+    size_t count;
+
+    // 2024, every 6 hours.
+    assert(moonephem_write(TEST_EPHEMERIS, 2460310.5, 2460676.5, 0.25));
+    assert(moonephem_open(&eph, TEST_EPHEMERIS));
+
+    assert(eph.version == 1);
+    assert(eph.first_julian_date == 2460310.5);
+    assert(eph.step == 0.25);
+    assert(eph.sample_count == 1465);
+
+    // March 2024.
+    assert(moonephem_lunations(&eph, 2460370.5, 2460401.5, lunations, 8, &count));
+
+    assert(count == 2);
+    assert(lunations[0].lunation == 1251);
+    assert(lunations[0].new_moon == truephase(1535.0, 0.0));
+    assert(lunations[0].first_quarter == truephase(1535.0, 0.25));
+    assert(lunations[0].full_moon == truephase(1535.0, 0.5));
+    assert(lunations[0].last_quarter == truephase(1535.0, 0.75));
+    assert(lunations[0].next_new_moon == truephase(1536.0, 0.0));
+    assert(lunations[1].lunation == 1252);
+    assert(lunations[1].new_moon == lunations[0].next_new_moon);
+
+    moonephem_close(&eph);
+    remove(TEST_EPHEMERIS);
+}
+
+void test_moonephem_roundtrip_phases(void) {
+    MoonEphemeris eph;
+    double julian_date[5], age[5], fraction_of_lunation[5], distance[5];
+    int phase_[5];
+    size_t count;
+
+    assert(moonephem_write(TEST_EPHEMERIS, 2460310.5, 2460676.5, 0.25));
+    assert(moonephem_open(&eph, TEST_EPHEMERIS));
+
+    MoonPhaseColumns columns = {0};
+    columns.julian_date = julian_date;
+    columns.age = age;
+    columns.fraction_of_lunation = fraction_of_lunation;
+    columns.phase = phase_;
+    columns.distance_to_earth_km = distance;
+
+    // Start between samples, end on one (exclusive).
+    assert(moonephem_phases(&eph, 2460400.1, 2460401.25, &columns, 5, &count));
+
+    assert(count == 4);
+    for (size_t i = 0; i < count; ++i) {
+        double cphase, aom, cdist, cangdia, csund, csuang;
+        double jd = 2460310.5 + (359 + i) * 0.25;
+        double p = phase(jd, &cphase, &aom, &cdist, &cangdia, &csund, &csuang);
+
+        assert(julian_date[i] == jd);
+        assert(fraction_of_lunation[i] == p);
+        assert(phase_[i] == fraction_of_lunation_to_phase(p));
+        assert(age[i] == aom);
+        assert(distance[i] == cdist);
+    }
+
+    moonephem_close(&eph);
+    remove(TEST_EPHEMERIS);
+}
+
+void test_moonephem_ranges(void) {
+    MoonEphemeris eph;
+    MoonLunation lunations[1];
+    size_t count;
+
+    assert(moonephem_write(TEST_EPHEMERIS, 2460310.5, 2460676.5, 0.25));
+    assert(moonephem_open(&eph, TEST_EPHEMERIS));
+
+    MoonPhaseColumns columns = {0};
+
+    // Not enough room: nothing written, but count tells how much is needed.
+    assert(!moonephem_lunations(&eph, 2460370.5, 2460401.5, lunations, 1, &count));
+    assert(count == 2);
+    assert(!moonephem_phases(&eph, 2460310.5, 2460311.5, &columns, 0, &count));
+    assert(count == 4);
+
+    // Whole file.
+    assert(!moonephem_phases(&eph, -INFINITY, INFINITY, &columns, 0, &count));
+    assert(count == eph.sample_count);
+    assert(!moonephem_lunations(&eph, -INFINITY, INFINITY, lunations, 0, &count));
+    assert(count == eph.lunation_count);
+
+    // Empty and out of range.
+    assert(moonephem_phases(&eph, 2460311.5, 2460310.5, &columns, 0, &count));
+    assert(count == 0);
+    assert(moonephem_phases(&eph, 2470000.5, 2470001.5, &columns, 0, &count));
+    assert(count == 0);
+    assert(moonephem_lunations(&eph, 2400000.5, 2400001.5, lunations, 0, &count));
+    assert(count == 0);
+
+    moonephem_close(&eph);
+    remove(TEST_EPHEMERIS);
+}
+
+void corrupt_byte(const char* path, long offset) {
+    FILE* f = fopen(path, "r+b");
+    assert(f != NULL);
+    assert(fseek(f, offset, SEEK_SET) == 0);
+    int c = fgetc(f);
+    assert(fseek(f, offset, SEEK_SET) == 0);
+    fputc(c ^ 0x01, f);
+    fclose(f);
+}
+
+void test_moonephem_rejects_invalid_files(void) {
+    MoonEphemeris eph;
+
+    assert(!moonephem_open(&eph, "target/does_not_exist.eph"));
+    assert(eph.data == NULL);
+
+    long offsets[] = {
+        0,     // Magic.
+        8,     // Version.
+        12,    // Header size.
+        32,    // Sample count.
+        56,    // Checksum.
+        100,   // Lunation.
+        2000,  // Phase sample.
+    };
+
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+        assert(moonephem_write(TEST_EPHEMERIS, 2460310.5, 2460676.5, 0.25));
+        corrupt_byte(TEST_EPHEMERIS, offsets[i]);
+        assert(!moonephem_open(&eph, TEST_EPHEMERIS));
+    }
+
+    // Truncated.
+    assert(moonephem_write(TEST_EPHEMERIS, 2460310.5, 2460676.5, 0.25));
+    assert(truncate(TEST_EPHEMERIS, 1000) == 0);
+    assert(!moonephem_open(&eph, TEST_EPHEMERIS));
+
+    remove(TEST_EPHEMERIS);
+}
+
+void test_moonephem_write_invalid_ranges(void) {
+    assert(!moonephem_write(TEST_EPHEMERIS, 2460310.5, 2460300.5, 0.25));
+    assert(!moonephem_write(TEST_EPHEMERIS, 2460310.5, 2460676.5, 0.0));
+    assert(!moonephem_write(TEST_EPHEMERIS, 2460310.5, 2460676.5, -1.0));
+    assert(!moonephem_write(TEST_EPHEMERIS, NAN, 2460676.5, 0.25));
+    assert(!moonephem_write("target/no/such/dir.eph", 2460310.5, 2460676.5, 0.25));
+}
+
+void assert_chebyshev_matches_phase(
+    const MoonChebyshev* cheb, time_t from, time_t to, time_t step, double slack
+) {
+    double julian_date[1], age[1], fraction_of_lunation[1], fraction_illuminated[1],
+        distance_to_earth_km[1], subtends[1], sun_distance_to_earth_km[1],
+        sun_subtends[1];
+    MoonPhaseColumns columns = {
+        julian_date,
+        age,
+        fraction_of_lunation,
+        NULL,
+        fraction_illuminated,
+        distance_to_earth_km,
+        subtends,
+        sun_distance_to_earth_km,
+        sun_subtends,
+    };
+
+    for (time_t t = from; t < to; t += step) {
+        double cphase, aom, cdist, cangdia, csund, csuang;
+
+        assert(moonchebyshev_batch(cheb, &columns, &t, 1));
+        double p = phase(julian_date[0], &cphase, &aom, &cdist, &cangdia, &csund, &csuang);
+
+        // Fraction of lunation (and age) wrap around at new moon.
+        double dp = abs(fraction_of_lunation[0] - p);
+        assert_within(dp < 0.5 ? dp : 1 - dp, 0, cheb->max_error[0] * slack);
+        double da = abs(age[0] - aom);
+        assert_within(da < synmonth / 2 ? da : synmonth - da, 0, cheb->max_error[0] * slack * synmonth + 1e-12);
+        assert_within(fraction_illuminated[0], cphase, cheb->max_error[1] * slack);
+        assert_within(distance_to_earth_km[0], cdist, cheb->max_error[2] * slack);
+        assert_within(subtends[0], cangdia, cheb->max_error[3] * slack);
+        assert_within(sun_distance_to_earth_km[0], csund, cheb->max_error[4] * slack);
+        assert_within(sun_subtends[0], csuang, cheb->max_error[5] * slack);
+    }
+}
+
+void test_moonchebyshev_daily_fit_error_bounds(void) {
+    MoonChebyshev cheb;
+
+    // 2024, degree 8, one polynomial per day.
+    assert(moonchebyshev_fit(&cheb, 2460310.5, 2460676.5, 1.0, 8));
+
+    assert(cheb.interval_count == 366);
+    assert(cheb.max_error[0] < 1e-10);  // Fraction of lunation.
+    assert(cheb.max_error[1] < 1e-10);  // Fraction illuminated.
+    assert(cheb.max_error[2] < 1e-5);   // Moon's distance (km).
+    assert(cheb.max_error[3] < 1e-11);  // Moon's angular diameter (deg).
+    assert(cheb.max_error[4] < 1e-4);   // Sun's distance (km).
+    assert(cheb.max_error[5] < 1e-12);  // Sun's angular diameter (deg).
+
+    // Every 7 minutes and 13 seconds, so times vary across intervals.
+    assert_chebyshev_matches_phase(&cheb, 1704067200, 1735689600, 433, 1.5);
+
+    moonchebyshev_free(&cheb);
+    assert(cheb.coefficients == NULL);
+}
+
+void test_moonchebyshev_coarse_fit_error_bounds(void) {
+    MoonChebyshev cheb;
+
+    // Poor fit on purpose: the measured error must still be honest.
+    assert(moonchebyshev_fit(&cheb, 2460310.5, 2460676.5, synmonth, 6));
+
+    assert(cheb.interval_count == 13);
+    assert(cheb.max_error[2] > 1.0);
+
+    assert_chebyshev_matches_phase(&cheb, 1704067200, 1735689600, 433, 1.5);
+
+    moonchebyshev_free(&cheb);
+}
+
+void test_moonchebyshev_out_of_range(void) {
+    MoonChebyshev cheb;
+    double age[1];
+    MoonPhaseColumns columns = {0};
+    columns.age = age;
+
+    assert(moonchebyshev_fit(&cheb, 2460310.5, 2460676.5, 1.0, 8));
+
+    time_t timestamps[] = {1704067199, 1735689600};  // Just before, and at end.
+    assert(!moonchebyshev_batch(&cheb, &columns, &timestamps[0], 1));
+    assert(!moonchebyshev_batch(&cheb, &columns, &timestamps[1], 1));
+
+    moonchebyshev_free(&cheb);
+}
+
+void test_moonchebyshev_invalid_fits(void) {
+    MoonChebyshev cheb;
+
+    assert(!moonchebyshev_fit(&cheb, 2460310.5, 2460310.5, 1.0, 8));
+    assert(!moonchebyshev_fit(&cheb, 2460310.5, 2460676.5, 0.0, 8));
+    assert(!moonchebyshev_fit(&cheb, 2460310.5, 2460676.5, 1.0, -1));
+    assert(!moonchebyshev_fit(&cheb, 2460310.5, 2460676.5, 1.0, 31));
+    assert(!moonchebyshev_fit(&cheb, NAN, 2460676.5, 1.0, 8));
+    assert(cheb.coefficients == NULL);
+}
+
+void assert_iterator_matches_phase(time_t start, long step, size_t count) {
+    static double julian_date[20000], age[20000], fraction_of_lunation[20000],
+        fraction_illuminated[20000], distance_to_earth_km[20000], subtends[20000],
+        sun_distance_to_earth_km[20000], sun_subtends[20000];
+    static int phase_[20000];
+    MoonPhaseColumns columns = {
+        julian_date,
+        age,
+        fraction_of_lunation,
+        phase_,
+        fraction_illuminated,
+        distance_to_earth_km,
+        subtends,
+        sun_distance_to_earth_km,
+        sun_subtends,
+    };
+    MoonPhaseIterator it;
+
+    assert(count <= 20000);
+    assert(moonphase_iter_init(&it, &start, step));
+    assert(moonphase_iter_next(&it, &columns, count));
+    assert(it.timestamp == start + (time_t)count * step);
+
+    for (size_t i = 0; i < count; ++i) {
+        double cphase, aom, cdist, cangdia, csund, csuang, jd;
+        assert(unixtoj(start + (time_t)i * step, &jd));
+        double p = phase(jd, &cphase, &aom, &cdist, &cangdia, &csund, &csuang);
+
+        assert(julian_date[i] == jd);
+        // Fraction of lunation (and age) wrap around at new moon.
+        double dp = abs(fraction_of_lunation[i] - p);
+        assert_within(dp < 0.5 ? dp : 1 - dp, 0, 1e-11);
+        double da = abs(age[i] - aom);
+        assert_within(da < synmonth / 2 ? da : synmonth - da, 0, 1e-10);
+        assert(dp > 1e-9 || phase_[i] == fraction_of_lunation_to_phase(p));
+        assert_within(fraction_illuminated[i], cphase, 1e-11);
+        assert_within(distance_to_earth_km[i], cdist, 1e-6);
+        assert_within(subtends[i], cangdia, 1e-12);
+        assert_within(sun_distance_to_earth_km[i], csund, 5e-5);
+        assert_within(sun_subtends[i], csuang, 1e-12);
+    }
+}
+
+void test_moonphase_iter_every_minute(void) {
+    // 2024-01-01, for about two weeks (several resynchronizations).
+    assert_iterator_matches_phase(1704067200, 60, 20000);
+}
+
+void test_moonphase_iter_every_hour(void) {
+    // 1800-01-01, for about two years.
+    assert_iterator_matches_phase(-5364662400, 3600, 20000);
+}
+
+void test_moonphase_iter_odd_step(void) {
+    // A week and 13 seconds, from 2200 backwards.
+    assert_iterator_matches_phase(7258118400, -(7 * 86400 + 13), 20000);
+}
+
+void test_moonphase_iter_one_by_one(void) {
+    double batch[10], single[1];
+    MoonPhaseColumns columns = {0};
+    MoonPhaseIterator it;
+    time_t start = 1714809600;
+
+    columns.distance_to_earth_km = batch;
+    assert(moonphase_iter_init(&it, &start, 3600));
+    assert(moonphase_iter_next(&it, &columns, 10));
+
+    columns.distance_to_earth_km = single;
+    assert(moonphase_iter_init(&it, &start, 3600));
+    for (int i = 0; i < 10; ++i) {
+        assert(moonphase_iter_next(&it, &columns, 1));
+        assert(single[0] == batch[i]);
+    }
+}
+
+void test_moonphase_iter_chunks(void) {
+    static double whole[2][5000], chunked[2][5000];
+    MoonPhaseColumns columns = {0};
+    MoonPhaseIterator it;
+    time_t start = 1714809600;
+    size_t i, n;
+
+    columns.fraction_of_lunation = whole[0];
+    columns.distance_to_earth_km = whole[1];
+    assert(moonphase_iter_init(&it, &start, 600));
+    assert(moonphase_iter_next(&it, &columns, 5000));
+
+    // Chunks of 0 to 12 steps, across groups and resynchronizations.
+    assert(moonphase_iter_init(&it, &start, 600));
+    for (i = 0, n = 0; i < 5000; i += n, n = (n + 5) % 13) {
+        if (n > 5000 - i) {
+            n = 5000 - i;
+        }
+        columns.fraction_of_lunation = &chunked[0][i];
+        columns.distance_to_earth_km = &chunked[1][i];
+        assert(moonphase_iter_next(&it, &columns, n));
+        assert(it.timestamp == start + (time_t)(i + n) * 600);
+    }
+    assert(memcmp(whole, chunked, sizeof whole) == 0);
+}
+
+void test_moonphase_iter_invalid_step(void) {
+    MoonPhaseIterator it;
+    time_t start = 1714809600;
+
+    assert(!moonphase_iter_init(&it, &start, 0));
+}
+
 void test_mooncalendar_regular(void) {
     MoonCalendar mcal;
     time_t timestamp = 794886000;
@@ -268,6 +786,18 @@ void test_mooncalendar_multiple_creations(void) {
     assert(&mcal.next_new_moon_utc != &other.next_new_moon_utc);
 }
 
+void test_mooncalendar_does_not_use_static_time_storage(void) {
+    time_t earlier = 0;
+    const struct tm* gm = gmtime(&earlier);
+
+    MoonCalendar mcal;
+    time_t timestamp = 794886000;
+    assert(mooncal(&mcal, &timestamp));
+
+    assert(gm->tm_year == 70);
+    assert(gm->tm_yday == 0);
+}
+
 void test_mooncalendar_display(void) {
     MoonCalendar mcal;
     time_t timestamp = 794886000;
@@ -294,6 +824,728 @@ void test_mooncalendar_display(void) {
 }
 
 
+void test_moonphase_format_matches_sprintf(void) {
+    MoonPhase mphase;
+    char buf[1000], expected[1000];
+
+    // 1800 to 2200, plus negative timestamps in between.
+    for (time_t t = -5364662400; t < 7258118400; t += 3600 * 24 * 37 + 4321) {
+        assert(moonphase(&mphase, &t));
+        size_t len = moonphase_format(buf, sizeof(buf), &mphase);
+        moonphase_to_strbuf_sprintf(&mphase, expected);
+        assert(strcmp(buf, expected) == 0);
+        assert(len == strlen(expected));
+    }
+}
+
+void test_moonphase_to_csv_matches_snprintf(void) {
+    MoonPhase mphase;
+    char buf[500], expected[500];
+
+    // 1800 to 2200, plus negative timestamps in between.
+    for (time_t t = -5364662400; t < 7258118400; t += 3600 * 24 * 37 + 4321) {
+        assert(moonphase(&mphase, &t));
+        size_t len = moonphase_to_csv(buf, sizeof(buf), &mphase);
+        moonphase_to_csv_snprintf(expected, sizeof(expected), &mphase);
+        assert(strcmp(buf, expected) == 0);
+        assert(len == strlen(expected));
+    }
+
+    char small[10];
+    size_t len = moonphase_to_csv(small, sizeof(small), &mphase);
+    assert(len == strlen(expected));
+    assert(strncmp(small, expected, sizeof(small) - 1) == 0);
+    assert(small[sizeof(small) - 1] == '\0');
+    assert(moonphase_to_csv(NULL, 0, &mphase) == len);
+}
+
+void test_mooncal_format_matches_sprintf(void) {
+    MoonCalendar mcal;
+    char buf[500], expected[500];
+
+    for (time_t t = -5364662400; t < 7258118400; t += 3600 * 24 * 37 + 4321) {
+        assert(mooncal(&mcal, &t));
+        size_t len = mooncal_format(buf, sizeof(buf), &mcal);
+        mooncal_to_strbuf_sprintf(&mcal, expected);
+        assert(strcmp(buf, expected) == 0);
+        assert(len == strlen(expected));
+    }
+}
+
+void test_moonphase_format_truncation(void) {
+    MoonPhase mphase;
+    time_t timestamp = 794886000;
+    char full[1000], buf[64];
+
+    moonphase(&mphase, &timestamp);
+    size_t len = moonphase_format(full, sizeof(full), &mphase);
+
+    assert(moonphase_format(NULL, 0, &mphase) == len);
+
+    for (size_t n = 1; n < sizeof(buf); ++n) {
+        memset(buf, '#', sizeof(buf));
+        assert(moonphase_format(buf, n, &mphase) == len);
+        assert(strlen(buf) == n - 1);
+        assert(strncmp(buf, full, n - 1) == 0);
+        for (size_t i = n; i < sizeof(buf); ++i) {
+            assert(buf[i] == '#');
+        }
+    }
+}
+
+void test_moonphase_format_local_time_out_of_range(void) {
+    MoonPhase mphase;
+    time_t timestamp = 794886000;
+    char buf[1000];
+
+    moonphase(&mphase, &timestamp);
+    mphase.timestamp = (time_t) 1e18;  // Beyond struct tm.
+
+    size_t len = moonphase_format(buf, sizeof(buf), &mphase);
+    assert(len == strlen(buf));
+    assert(strstr(buf, "Local time:\t\tunknown\n") != NULL);
+}
+
+void test_mooncal_format_truncation(void) {
+    MoonCalendar mcal;
+    time_t timestamp = 794886000;
+    char full[500], buf[500];
+
+    mooncal(&mcal, &timestamp);
+    size_t len = mooncal_format(full, sizeof(full), &mcal);
+
+    memset(buf, '#', sizeof(buf));
+    assert(mooncal_format(buf, len, &mcal) == len);
+    assert(strlen(buf) == len - 1);
+    assert(buf[len] == '#');
+
+    assert(mooncal_format(buf, len + 1, &mcal) == len);
+    assert(strcmp(buf, full) == 0);
+}
+
+static void assert_fmt_fixed(double x, int prec) {
+    char buf[400], expected[400];
+    FmtBuf f = {buf, sizeof(buf), 0};
+
+    fmt_fixed(&f, x, prec);
+    fmt_end(&f);
+    snprintf(expected, sizeof(expected), "%.*f", prec, x);
+    if (strcmp(buf, expected) != 0) {
+        fprintf(stderr, "fmt_fixed(%.17g, %d): %s != %s\n", x, prec, buf, expected);
+    }
+    assert(strcmp(buf, expected) == 0);
+}
+
+void test_fmt_fixed_matches_printf(void) {
+    // Exact ties, which round to even.
+    assert_fmt_fixed(0.125, 2);
+    assert_fmt_fixed(0.375, 2);
+    assert_fmt_fixed(2.5, 0);
+    assert_fmt_fixed(3.5, 0);
+    assert_fmt_fixed(0.5, 0);
+    // Not quite ties, in binary.
+    assert_fmt_fixed(1.005, 2);
+    assert_fmt_fixed(1.015, 2);
+    assert_fmt_fixed(0.15, 1);
+    assert_fmt_fixed(2.675, 2);
+    assert_fmt_fixed(9.9999, 3);
+    assert_fmt_fixed(0.99995, 4);
+    // Signs.
+    assert_fmt_fixed(-1.005, 2);
+    assert_fmt_fixed(-0.0001, 2);
+    assert_fmt_fixed(-0.0, 2);
+    assert_fmt_fixed(0.0, 5);
+    // Too large (snprintf() fallback), and non-finite.
+    assert_fmt_fixed(4503599627.370496, 5);
+    assert_fmt_fixed(1e300, 4);
+    assert_fmt_fixed(-1e300, 1);
+    assert_fmt_fixed(INFINITY, 2);
+    assert_fmt_fixed(-INFINITY, 2);
+    assert_fmt_fixed(NAN, 2);
+
+    // Ties and near-ties, at every precision.
+    for (int prec = 0; prec <= 9; ++prec) {
+        for (long i = -20000; i <= 20000; ++i) {
+            double x = i / 1024.0;
+            assert_fmt_fixed(x, prec);
+            assert_fmt_fixed(nextafter(x, 1e9), prec);
+            assert_fmt_fixed(nextafter(x, -1e9), prec);
+        }
+    }
+
+    // Values as found in reports.
+    unsigned long long state = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 200000; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        double x = (double)(state >> 11) / 9007199254740992.0;
+        assert_fmt_fixed(x * 100, 2);
+        assert_fmt_fixed(x * 3e6 + 2.4e6, 5);
+        assert_fmt_fixed(x * 70, 1);
+        assert_fmt_fixed(x, 3);
+        assert_fmt_fixed(x * 0.6, 4);
+    }
+}
+
+void test_moonphase_to_json(void) {
+    MoonPhase mphase;
+    time_t timestamp = 788104414;
+    char buf[1000];
+
+    moonphase(&mphase, &timestamp);
+    size_t len = moonphase_to_json(buf, sizeof(buf), &mphase);
+
+    assert(
+        strcmp(
+            buf,
+            "{\"julian_date\":2449709.0788657409,\"timestamp\":788104414,"
+            "\"utc_datetime\":\"1994-12-22T13:53:34Z\",\"age\":18.937448369667617,"
+            "\"fraction_of_lunation\":0.64128245375932058,"
+            "\"phase\":{\"index\":5,\"name\":\"Waning Gibbous\",\"icon\":\"\U0001f316\"},"
+            "\"fraction_illuminated\":0.81559732433681631,"
+            "\"distance_to_earth_km\":386212.92107462313,"
+            "\"distance_to_earth_earth_radii\":60.552403996548087,"
+            "\"subtends\":0.51566932961706669,"
+            "\"sun_distance_to_earth_km\":147151251.1218971,"
+            "\"sun_distance_to_earth_astronomical_units\":0.98364122047946401,"
+            "\"sun_subtends\":0.54199436634033415}"
+        )
+        == 0
+    );
+    assert(len == strlen(buf));
+    assert(moonphase_to_json(NULL, 0, &mphase) == len);
+}
+
+void test_mooncal_to_json(void) {
+    MoonCalendar mcal;
+    time_t timestamp = 788104414;
+    char buf[1000];
+
+    mooncal(&mcal, &timestamp);
+    size_t len = mooncal_to_json(buf, sizeof(buf), &mcal);
+
+    assert(
+        strcmp(
+            buf,
+            "{\"julian_date\":2449709.0788657409,\"timestamp\":788104414,"
+            "\"utc_datetime\":\"1994-12-22T13:53:34Z\",\"lunation\":890,"
+            "\"last_new_moon\":2449689.4962275415,"
+            "\"last_new_moon_utc\":\"1994-12-02T23:54:34Z\","
+            "\"first_quarter\":2449696.3796747192,"
+            "\"first_quarter_utc\":\"1994-12-09T21:06:44Z\","
+            "\"full_moon\":2449704.5961089605,"
+            "\"full_moon_utc\":\"1994-12-18T02:18:24Z\","
+            "\"last_quarter\":2449712.2967386991,"
+            "\"last_quarter_utc\":\"1994-12-25T19:07:18Z\","
+            "\"next_new_moon\":2449718.9561368735,"
+            "\"next_new_moon_utc\":\"1995-01-01T10:56:50Z\"}"
+        )
+        == 0
+    );
+    assert(len == strlen(buf));
+
+    char small[16];
+    memset(small, '#', sizeof(small));
+    assert(mooncal_to_json(small, 10, &mcal) == len);
+    assert(strcmp(small, "{\"julian_") == 0);
+    assert(small[10] == '#');
+}
+
+#define N_RECORDS 500
+
+void test_moonphase_records_roundtrip(void) {
+    static unsigned char data[MOON_RECORD_HEADER_SIZE + N_RECORDS * MOON_RECORD_SIZE];
+    MoonPhase mphases[N_RECORDS];
+
+    size_t size = moonphase_record_header(data);
+    assert(size == MOON_RECORD_HEADER_SIZE);
+    for (int i = 0; i < N_RECORDS; ++i) {
+        time_t t = -5364662400 + (time_t)i * 25416131;  // 1800 to 2200.
+        assert(moonphase(&mphases[i], &t));
+        moonphase_to_record(data + size, &mphases[i]);
+        size += MOON_RECORD_SIZE;
+    }
+
+    RecordReader reader;
+    assert(record_reader_open(&reader, data, size));
+    assert(reader.header_size % 8 == 0);
+    assert(reader.record_size % 8 == 0);
+    assert(reader.record_count == N_RECORDS);
+
+    RecordField timestamp, julian_date, age, fraction_of_lunation, phase,
+        fraction_illuminated, distance_to_earth_km, subtends,
+        sun_distance_to_earth_km, sun_subtends;
+    assert(record_reader_field(&reader, "timestamp", &timestamp));
+    assert(record_reader_field(&reader, "julian_date", &julian_date));
+    assert(record_reader_field(&reader, "age", &age));
+    assert(record_reader_field(&reader, "fraction_of_lunation", &fraction_of_lunation));
+    assert(record_reader_field(&reader, "phase", &phase));
+    assert(record_reader_field(&reader, "fraction_illuminated", &fraction_illuminated));
+    assert(record_reader_field(&reader, "distance_to_earth_km", &distance_to_earth_km));
+    assert(record_reader_field(&reader, "subtends", &subtends));
+    assert(record_reader_field(&reader, "sun_distance_to_earth_km", &sun_distance_to_earth_km));
+    assert(record_reader_field(&reader, "sun_subtends", &sun_subtends));
+    assert(timestamp.type == 1 && timestamp.size == 8);
+    assert(julian_date.type == 2 && julian_date.size == 8);
+    assert(julian_date.offset % 8 == 0);
+    assert(phase.type == 3 && phase.size == 1);
+
+    RecordField missing;
+    assert(!record_reader_field(&reader, "lunation", &missing));
+
+    for (int i = 0; i < N_RECORDS; ++i) {
+        const MoonPhase* m = &mphases[i];
+        assert(record_reader_i64(&reader, i, &timestamp) == m->timestamp);
+        assert(record_reader_f64(&reader, i, &julian_date) == m->julian_date);
+        assert(record_reader_f64(&reader, i, &age) == m->age);
+        assert(record_reader_f64(&reader, i, &fraction_of_lunation) == m->fraction_of_lunation);
+        assert(record_reader_u8(&reader, i, &phase) == m->phase);
+        assert(record_reader_f64(&reader, i, &fraction_illuminated) == m->fraction_illuminated);
+        assert(record_reader_f64(&reader, i, &distance_to_earth_km) == m->distance_to_earth_km);
+        assert(record_reader_f64(&reader, i, &subtends) == m->subtends);
+        assert(record_reader_f64(&reader, i, &sun_distance_to_earth_km) == m->sun_distance_to_earth_km);
+        assert(record_reader_f64(&reader, i, &sun_subtends) == m->sun_subtends);
+        // Padding is zeroed, so output is deterministic.
+        for (size_t j = 73; j < MOON_RECORD_SIZE; ++j) {
+            assert(record_reader_record(&reader, i)[j] == 0);
+        }
+    }
+}
+
+void test_moonphase_records_rejects_invalid_files(void) {
+    unsigned char data[MOON_RECORD_HEADER_SIZE + MOON_RECORD_SIZE];
+    RecordReader reader;
+    MoonPhase mphase;
+    time_t timestamp = 788104414;
+
+    moonphase(&mphase, &timestamp);
+    moonphase_record_header(data);
+    moonphase_to_record(data + MOON_RECORD_HEADER_SIZE, &mphase);
+
+    assert(record_reader_open(&reader, data, sizeof(data)));
+    assert(record_reader_open(&reader, data, MOON_RECORD_HEADER_SIZE));
+    assert(reader.record_count == 0);
+
+    // Truncated record, truncated header.
+    assert(!record_reader_open(&reader, data, sizeof(data) - 1));
+    assert(!record_reader_open(&reader, data, 16));
+
+    // Unknown version.
+    data[8] = 2;
+    assert(!record_reader_open(&reader, data, sizeof(data)));
+    data[8] = 1;
+
+    // Bad magic.
+    data[0] = 'X';
+    assert(!record_reader_open(&reader, data, sizeof(data)));
+}
+
+void test_mooncal_year_1994(void) {
+    MoonPhaseEvent events[MOON_YEAR_MAX_EVENTS];
+    size_t count;
+    int new_moons = 0, full_moons = 0;
+
+    assert(mooncal_year(events, MOON_YEAR_MAX_EVENTS, 1994, &count));
+    assert(count == 49);
+
+    // 1994-01-03: Last quarter of lunation 878.
+    assert(events[0].phase == 3);
+    assert(events[0].lunation == 878);
+    assert(events[0].date_utc.tm_year == 94);
+    assert(events[0].date_utc.tm_mon == 0);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            assert(events[i].date > events[i - 1].date);
+            assert(events[i].phase == (events[i - 1].phase + 1) % 4);
+        }
+        assert(events[i].date_utc.tm_year == 94);
+        if (events[i].phase == 0) {
+            if (new_moons++ == 0) {
+                assert_almost_equal(events[i].date, 2449364.466461601);
+                assert(events[i].lunation == 879);
+            }
+        } else if (events[i].phase == 2) {
+            if (full_moons++ == 11) {
+                assert_almost_equal(events[i].date, 2449704.5961089605);
+                assert(events[i].lunation == 890);
+            }
+        }
+    }
+    assert(new_moons == 12);
+    assert(full_moons == 12);
+}
+
+void test_mooncal_year_matches_phasehunt(void) {
+    long years[] = {1582, 1583, 1900, 1970, 2000, 2024, 2100, 2500};
+
+    for (size_t y = 0; y < sizeof(years) / sizeof(years[0]); ++y) {
+        MoonPhaseEvent events[MOON_YEAR_MAX_EVENTS];
+        size_t count;
+        assert(mooncal_year(events, MOON_YEAR_MAX_EVENTS, years[y], &count));
+
+        // The lunation of every day of the year (and either side), with
+        // overlaps removed.
+        double start = ucttoj(years[y], 0, 1, 0, 0, 0);
+        double end = ucttoj(years[y] + 1, 0, 1, 0, 0, 0);
+        size_t found = 0;
+        double last = 0;
+        for (double jd = start - 1; jd < end + 1; jd += 1) {
+            double phasar[5];
+            phasehunt(jd, phasar);
+            for (int i = 0; i < 4; ++i) {
+                if (phasar[i] < start || phasar[i] >= end || phasar[i] <= last)
+                    continue;
+                assert(found < count);
+                assert(events[found].date == phasar[i]);
+                assert(events[found].phase == i);
+                assert(events[found].lunation == brown_lunation(phasar[0]));
+                last = phasar[i];
+                ++found;
+            }
+        }
+        assert(found == count);
+    }
+}
+
+void test_mooncal_year_capacity(void) {
+    MoonPhaseEvent events[MOON_YEAR_MAX_EVENTS];
+    size_t count;
+
+    events[0].phase = -1;
+    assert(!mooncal_year(events, 10, 2024, &count));
+    assert(count > 10);
+    assert(events[0].phase == -1);
+
+    assert(!mooncal_year(NULL, 0, 2024, &count));
+    assert(mooncal_year(events, count, 2024, &count));
+}
+
+static double crossing_quantity(int quantity, double jd) {
+    double pphase, mage, dist, angdia, sudist, suangdia;
+    phase(jd, &pphase, &mage, &dist, &angdia, &sudist, &suangdia);
+    return quantity == MOON_CROSSING_AGE ? mage : pphase;
+}
+
+void test_moonphase_crossings_matches_sampling(void) {
+    struct {
+        int quantity;
+        double threshold;
+    } cases[] = {
+        {MOON_CROSSING_FRACTION_ILLUMINATED, 0.01},
+        {MOON_CROSSING_FRACTION_ILLUMINATED, 0.5},
+        {MOON_CROSSING_FRACTION_ILLUMINATED, 0.99},
+        {MOON_CROSSING_AGE, 0.0},
+        {MOON_CROSSING_AGE, 14.0},
+        {MOON_CROSSING_AGE, 29.0},
+    };
+    double from = 2460310.5;  // 2024-01-01
+    double to = 2460676.5;
+    double hour = 1.0 / 24;
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        int quantity = cases[c].quantity;
+        double threshold = cases[c].threshold;
+        MoonCrossing crossings[64];
+        size_t count;
+        assert(moonphase_crossings(
+            crossings, 64, quantity, threshold, from, to, 1e-7, &count
+        ));
+        assert(count > 0);
+
+        // Every sign change between hourly samples holds one crossing.
+        // The age wraps at new moon, which is not a crossing.
+        size_t found = 0;
+        double before = crossing_quantity(quantity, from) - threshold;
+        for (double jd = from + hour; jd < to + hour; jd += hour) {
+            double after = crossing_quantity(quantity, jd) - threshold;
+            int wrapped = quantity == MOON_CROSSING_AGE && after < before;
+            if ((before < 0) != (after < 0) && !wrapped) {
+                assert(found < count);
+                assert(crossings[found].date >= jd - hour);
+                assert(crossings[found].date < jd);
+                assert(crossings[found].rising == (after > before));
+                ++found;
+            } else if (quantity == MOON_CROSSING_AGE && threshold == 0.0
+                       && wrapped) {
+                assert(found < count);
+                assert(crossings[found].date >= jd - hour);
+                assert(crossings[found].date < jd);
+                ++found;
+            }
+            before = after;
+        }
+        assert(found == count);
+
+        // The quantity is on either side of the threshold a second away.
+        for (size_t i = 0; i < count; ++i) {
+            double second = 1.0 / 86400;
+            double lo = crossing_quantity(quantity, crossings[i].date - second);
+            double hi = crossing_quantity(quantity, crossings[i].date + second);
+            if (quantity == MOON_CROSSING_AGE && threshold == 0.0)
+                lo -= synmonth;
+            if (crossings[i].rising)
+                assert(lo < threshold && hi > threshold);
+            else
+                assert(lo > threshold && hi < threshold);
+        }
+    }
+}
+
+void test_moonphase_crossings_age_once_per_lunation(void) {
+    MoonCrossing crossings[64];
+    size_t count;
+
+    assert(moonphase_crossings(
+        crossings, 64, MOON_CROSSING_AGE, 7.0, 2451544.5, 2451544.5 + 365 * 5,
+        0, &count
+    ));
+    assert(count == 61 || count == 62);
+    for (size_t i = 0; i < count; ++i) {
+        assert(crossings[i].rising);
+        if (i > 0) {
+            assert_within(
+                crossings[i].date - crossings[i - 1].date, synmonth, 0.6
+            );
+        }
+    }
+}
+
+void test_moonphase_next_crossing(void) {
+    MoonCrossing crossings[64];
+    MoonCrossing crossing;
+    size_t count;
+    double from = 2460310.5;
+
+    assert(moonphase_crossings(
+        crossings, 64, MOON_CROSSING_FRACTION_ILLUMINATED, 0.99, from,
+        from + 365, 0, &count
+    ));
+
+    for (size_t i = 0; i < count; ++i) {
+        int direction = crossings[i].rising ? 1 : -1;
+        double after = (i > 0) ? crossings[i - 1].date + 1e-3 : from;
+
+        assert(moonphase_next_crossing(
+            &crossing, MOON_CROSSING_FRACTION_ILLUMINATED, 0.99, 0, after, 0
+        ));
+        assert(crossing.date == crossings[i].date);
+        assert(crossing.rising == crossings[i].rising);
+
+        assert(moonphase_next_crossing(
+            &crossing, MOON_CROSSING_FRACTION_ILLUMINATED, 0.99, direction,
+            after, 0
+        ));
+        assert(crossing.date == crossings[i].date);
+    }
+
+    // Inclusive of the start.
+    assert(moonphase_next_crossing(
+        &crossing, MOON_CROSSING_FRACTION_ILLUMINATED, 0.99, 0,
+        crossings[3].date, 0
+    ));
+    assert(crossing.date == crossings[3].date);
+
+    // The age never falls.
+    assert(!moonphase_next_crossing(
+        &crossing, MOON_CROSSING_AGE, 10.0, -1, from, 0
+    ));
+}
+
+void test_moonphase_crossings_invalid(void) {
+    MoonCrossing crossings[64];
+    size_t count;
+    double from = 2460310.5;
+    double to = from + 365;
+    int il = MOON_CROSSING_FRACTION_ILLUMINATED;
+
+    assert(!moonphase_crossings(crossings, 64, il, 0.0, from, to, 0, &count));
+    assert(!moonphase_crossings(crossings, 64, il, 1.0, from, to, 0, &count));
+    assert(!moonphase_crossings(crossings, 64, il, -0.5, from, to, 0, &count));
+    assert(!moonphase_crossings(
+        crossings, 64, MOON_CROSSING_AGE, 29.6, from, to, 0, &count
+    ));
+    assert(!moonphase_crossings(crossings, 64, 42, 0.5, from, to, 0, &count));
+    assert(count == 0);
+
+    assert(moonphase_crossings(crossings, 64, il, 0.5, to, from, 0, &count));
+    assert(count == 0);
+}
+
+void test_moonphase_crossings_capacity(void) {
+    MoonCrossing all[64];
+    MoonCrossing crossings[64];
+    size_t count, total;
+    int il = MOON_CROSSING_FRACTION_ILLUMINATED;
+
+    assert(moonphase_crossings(all, 64, il, 0.5, 2460310.5, 2460675.5, 0, &total));
+
+    crossings[0].date = 0;
+    assert(!moonphase_crossings(crossings, 5, il, 0.5, 2460310.5, 2460675.5, 0, &count));
+    assert(count == total);
+    assert(crossings[0].date == 0);
+
+    // One short, so that only the crossings near the ends are refined.
+    assert(!moonphase_crossings(
+        crossings, total - 1, il, 0.5, 2460310.5, 2460675.5, 0, &count
+    ));
+    assert(count == total);
+    assert(crossings[0].date == 0);
+
+    assert(!moonphase_crossings(NULL, 0, il, 0.5, 2460310.5, 2460675.5, 0, &count));
+    assert(count == total);
+    assert(moonphase_crossings(
+        crossings, total, il, 0.5, 2460310.5, 2460675.5, 0, &count
+    ));
+    assert(count == total);
+    for (size_t i = 0; i < total; ++i) {
+        assert(crossings[i].date == all[i].date);
+    }
+}
+
+void test_moonphase_apsides_matches_sampling(void) {
+    MoonApsis apsides[64];
+    size_t count;
+    double from = 2460310.5;  // 2024-01-01
+    double to = 2460676.5;
+    double hour = 1.0 / 24;
+
+    assert(moonphase_apsides(apsides, 64, from, to, 1e-7, &count));
+    assert(count == 27);
+
+    // Every extremum of hourly samples is within the hour of one.
+    size_t found = 0;
+    double before = apsis_distance(from);
+    double current = apsis_distance(from + hour);
+    for (double jd = from + hour; jd < to - hour; jd += hour) {
+        double after = apsis_distance(jd + hour);
+        int minimum = current < before && current <= after;
+        int maximum = current > before && current >= after;
+        if (minimum || maximum) {
+            assert(found < count);
+            assert(apsides[found].apogee == maximum);
+            assert_within(apsides[found].date, jd, hour);
+            ++found;
+        }
+        before = current;
+        current = after;
+    }
+    assert(found == count);
+
+    for (size_t i = 0; i < count; ++i) {
+        double d = apsides[i].distance_to_earth_km;
+        double minute = 1.0 / 1440;
+        if (i > 0) {
+            assert(apsides[i].apogee != apsides[i - 1].apogee);
+            assert_within(apsides[i].date - apsides[i - 1].date, 13.78, 1.5);
+        }
+        if (apsides[i].apogee) {
+            assert_within(d, msmax * (1 + mecc), 1e-6);
+            assert(apsis_distance(apsides[i].date - minute) < d);
+            assert(apsis_distance(apsides[i].date + minute) < d);
+        } else {
+            assert_within(d, msmax * (1 - mecc), 1e-6);
+            assert(apsis_distance(apsides[i].date - minute) > d);
+            assert(apsis_distance(apsides[i].date + minute) > d);
+        }
+    }
+}
+
+void test_moonphase_apsides_capacity(void) {
+    MoonApsis all[64];
+    MoonApsis apsides[64];
+    size_t count, total;
+
+    assert(moonphase_apsides(all, 64, 2460310.5, 2460676.5, 0, &total));
+
+    apsides[0].date = 0;
+    assert(!moonphase_apsides(apsides, 5, 2460310.5, 2460676.5, 0, &count));
+    assert(count == total);
+    assert(apsides[0].date == 0);
+
+    assert(!moonphase_apsides(apsides, total - 1, 2460310.5, 2460676.5, 0, &count));
+    assert(count == total);
+    assert(apsides[0].date == 0);
+
+    assert(!moonphase_apsides(NULL, 0, 2460310.5, 2460676.5, 0, &count));
+    assert(count == total);
+    assert(moonphase_apsides(apsides, total, 2460310.5, 2460676.5, 0, &count));
+    assert(count == total);
+    for (size_t i = 0; i < total; ++i) {
+        assert(apsides[i].date == all[i].date);
+    }
+
+    assert(moonphase_apsides(apsides, 64, 2460676.5, 2460310.5, 0, &count));
+    assert(count == 0);
+}
+
+void test_mooncal_syzygies_2024(void) {
+    MoonSyzygy syzygies[64];
+    MoonPhaseEvent events[MOON_YEAR_MAX_EVENTS];
+    size_t count, n_events;
+
+    assert(mooncal_syzygies(
+        syzygies, 64, 2460310.5, 2460676.5, 0.9, &count
+    ));
+    assert(mooncal_year(events, MOON_YEAR_MAX_EVENTS, 2024, &n_events));
+
+    // The same new and full moons as mooncal_year().
+    size_t found = 0;
+    for (size_t i = 0; i < n_events; ++i) {
+        if (events[i].phase == 1 || events[i].phase == 3)
+            continue;
+        assert(found < count);
+        assert(syzygies[found].date == events[i].date);
+        assert(syzygies[found].phase == events[i].phase);
+        ++found;
+    }
+    assert(found == count);
+
+    // Full supermoons of 2024: August 19, September 18, October 17 and
+    // November 15. Full micromoons: February 24 and March 25.
+    int full_supermoons = 0;
+    int full_micromoons = 0;
+    for (size_t i = 0; i < count; ++i) {
+        assert(syzygies[i].closeness >= 0 && syzygies[i].closeness <= 1);
+        if (syzygies[i].phase != 2)
+            continue;
+        struct tm* utc = &syzygies[i].date_utc;
+        if (syzygies[i].supermoon == 1) {
+            int months[] = {7, 8, 9, 10};
+            int days[] = {19, 18, 17, 15};
+            assert(full_supermoons < 4);
+            assert(utc->tm_mon == months[full_supermoons]);
+            assert(utc->tm_mday == days[full_supermoons]);
+            ++full_supermoons;
+        } else if (syzygies[i].supermoon == -1) {
+            int months[] = {1, 2};
+            int days[] = {24, 25};
+            assert(full_micromoons < 2);
+            assert(utc->tm_mon == months[full_micromoons]);
+            assert(utc->tm_mday == days[full_micromoons]);
+            ++full_micromoons;
+        }
+    }
+    assert(full_supermoons == 4);
+    assert(full_micromoons == 2);
+
+    // Everything is a supermoon or a micromoon at 0.5.
+    assert(mooncal_syzygies(
+        syzygies, 64, 2460310.5, 2460676.5, 0.5, &count
+    ));
+    for (size_t i = 0; i < count; ++i) {
+        assert(syzygies[i].supermoon != 0);
+    }
+
+    assert(!mooncal_syzygies(syzygies, 64, 2460310.5, 2460676.5, 0.4, &count));
+    assert(!mooncal_syzygies(syzygies, 64, 2460310.5, 2460676.5, 1.1, &count));
+    syzygies[0].date = 0;
+    assert(!mooncal_syzygies(syzygies, 10, 2460310.5, 2460676.5, 0.9, &count));
+    assert(count == found);
+    assert(syzygies[0].date == 0);
+    assert(!mooncal_syzygies(NULL, 0, 2460310.5, 2460676.5, 0.9, &count));
+    assert(count == found);
+}
+
 void test_fraction_of_lunation_to_phase_number(void) {
     int new_moon_start = fraction_of_lunation_to_phase(0);
     assert(new_moon_start == 0);
@@ -467,6 +1719,66 @@ void test_fmt_phase_time_at_boundaries(void) {
     assert(strcmp(buf, "Saturday  11:16 UTC 12 December 1995") == 0);
 }
 
+static void assert_fmt_double(double x) {
+    char buf[64], expected[64];
+    FmtBuf f = {buf, sizeof(buf), 0};
+
+    fmt_double(&f, x);
+    fmt_end(&f);
+    snprintf(expected, sizeof(expected), "%.17g", x);
+    if (strcmp(buf, expected) != 0) {
+        fprintf(stderr, "fmt_double(%a): %s != %s\n", x, buf, expected);
+    }
+    assert(strcmp(buf, expected) == 0);
+}
+
+void test_fmt_double_matches_printf(void) {
+    assert_fmt_double(0.0);
+    assert_fmt_double(-0.0);
+    assert_fmt_double(1.0);
+    assert_fmt_double(0.5);
+    assert_fmt_double(0.1);
+    assert_fmt_double(-2449709.0788657409);
+    assert_fmt_double(1e-4);
+    assert_fmt_double(nextafter(1e-4, 0));
+    assert_fmt_double(9.9999999999999995e-5);
+    assert_fmt_double(1e15);
+    assert_fmt_double(nextafter(1e16, 0));
+    assert_fmt_double(1e16);
+    assert_fmt_double(123456789012345678.0);
+    assert_fmt_double(1e-300);
+    assert_fmt_double(DBL_MAX);
+    assert_fmt_double(INFINITY);
+    assert_fmt_double(-INFINITY);
+    assert_fmt_double(NAN);
+
+    // Powers of ten, and their neighbours (rounding up to 10^n).
+    for (int n = -6; n <= 17; ++n) {
+        double x = pow(10, n);
+        assert_fmt_double(x);
+        assert_fmt_double(nextafter(x, 0));
+        assert_fmt_double(nextafter(x, INFINITY));
+        assert_fmt_double(nextafter(nextafter(x, 0), 0));
+    }
+
+    // Random bit patterns, over all magnitudes in the fast path.
+    unsigned long long state = 0x243f6a8885a308d3ULL;
+    for (int i = 0; i < 1000000; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        double m = (double)(state >> 11) / 9007199254740992.0;
+        int e = (int)(state % 70) - 16;
+        assert_fmt_double(ldexp(1.0 + m, e));
+        assert_fmt_double(-ldexp(1.0 + m, e) * 1e-3);
+    }
+
+    // Decimal values, as they come out of computations.
+    for (long i = 1; i < 200000; ++i) {
+        assert_fmt_double(i / 1000.0);
+        assert_fmt_double(i * 0.1);
+        assert_fmt_double(2440587.5 + i / 86400.0);
+    }
+}
+
 void test_jtime_regular(void) {
     struct tm gm = {
         .tm_year = 95,
@@ -527,6 +1839,61 @@ void test_jtime_negative(void) {
     assert_almost_equal(jd, -1200941.5);
 }
 
+double jtime_from_unix(long t) {
+    struct tm gm;
+    assert(gmtime_r(&t, &gm) != NULL);
+    return jtime(&gm);
+}
+
+void test_unixtoj_regular(void) {
+    double jd;
+
+    assert(unixtoj(794886000, &jd));
+
+    assert(jd == 2449787.5694444445);
+}
+
+void test_unixtoj_negative(void) {
+    double jd;
+
+    assert(unixtoj(-1, &jd));
+    assert(jd == jtime_from_unix(-1));
+
+    assert(unixtoj(-86401, &jd));
+    assert(jd == jtime_from_unix(-86401));
+}
+
+void test_unixtoj_matches_jtime_full_range(void) {
+    // Bit-for-bit, not almost equal: both paths must be interchangeable.
+    long boundaries[] = {
+        UNIX_GREGORIAN_MIN, UNIX_GREGORIAN_MAX - 1,
+        -86400, -1, 0, 1, 86399, 86400, 951782400 /* 2000-02-29 */
+    };
+    double jd;
+
+    for (size_t i = 0; i < sizeof(boundaries) / sizeof(boundaries[0]); ++i) {
+        for (long t = boundaries[i] - 3; t <= boundaries[i] + 3; ++t) {
+            assert(unixtoj(t, &jd));
+            assert(jd == jtime_from_unix(t));
+        }
+    }
+
+    // Step is coprime with 86400, so the time of day keeps changing.
+    for (long t = UNIX_GREGORIAN_MIN; t < UNIX_GREGORIAN_MAX; t += 8380417) {
+        assert(unixtoj(t, &jd));
+        assert(jd == jtime_from_unix(t));
+    }
+}
+
+void test_unixtoj_before_gregorian_reform(void) {
+    double jd;
+    long t = UNIX_GREGORIAN_MIN - 1;  // 1582-10-14 23:59:59 (proleptic).
+
+    assert(unixtoj(t, &jd));
+
+    assert(jd == jtime_from_unix(t));
+}
+
 void test_ucttoj_regular(void) {
     double julian_date = ucttoj(1995, 2, 11, 0, 0, 0);
 
@@ -559,6 +1926,100 @@ void test_jtouct_regular(void) {
     assert(gm.tm_sec == 0);
 }
 
+static int tm_equal(const struct tm *a, const struct tm *b) {
+    return a->tm_year == b->tm_year && a->tm_mon == b->tm_mon
+        && a->tm_mday == b->tm_mday && a->tm_wday == b->tm_wday
+        && a->tm_hour == b->tm_hour && a->tm_min == b->tm_min
+        && a->tm_sec == b->tm_sec;
+}
+
+void test_jtouct_matches_float_every_day(void) {
+    struct tm gm, expected;
+
+    // Every day from -4712 to 10000, at an odd time of day.
+    for (double day = 0.0; day < 5373484.0; day += 1.0) {
+        double jd = day + 0.3183098861837907;
+        jtouct(jd, &gm);
+        jtouct_float(jd, &expected);
+        assert(tm_equal(&gm, &expected));
+    }
+}
+
+void test_jtouct_matches_float_around_gregorian_reform(void) {
+    struct tm gm, expected;
+
+    for (double jd = 2299150.0; jd < 2299170.0; jd += 1.0 / 1440.0) {
+        jtouct(jd, &gm);
+        jtouct_float(jd, &expected);
+        assert(tm_equal(&gm, &expected));
+    }
+}
+
+void test_jtouct_matches_float_on_second_boundaries(void) {
+    struct tm gm, expected;
+
+    // Half-seconds round up, possibly to 24:00:00 like the original.
+    for (int i = 0; i < 86400 * 2; ++i) {
+        double jd = 2460000.5 + (i * 0.5 + 0.25) / 86400.0;
+        jtouct(jd, &gm);
+        jtouct_float(jd, &expected);
+        assert(tm_equal(&gm, &expected));
+    }
+    jtouct(2460001.4999999, &gm);
+    jtouct_float(2460001.4999999, &expected);
+    assert(tm_equal(&gm, &expected));
+    assert(gm.tm_hour == 24);
+}
+
+void test_jtouct_weekday_before_julian_epoch(void) {
+    struct tm gm;
+    int previous;
+
+    // Keeps cycling through 0..6 across JD 0, and before -4712.
+    jtouct(-1200942.0, &gm);
+    previous = gm.tm_wday;
+    for (double jd = -1200941.0; jd < 10.0; jd += 1.0) {
+        jtouct(jd, &gm);
+        assert(gm.tm_wday == (previous + 1) % 7);
+        previous = gm.tm_wday;
+    }
+    jtouct(2439912.0, &gm);
+    assert(gm.tm_wday == 0);  // Sunday
+}
+
+void test_jcivil_regular(void) {
+    long yy;
+    int mm, dd;
+
+    jcivil(2460426, &yy, &mm, &dd);  // 2460426.09191 + .5
+
+    assert(yy == 2024);
+    assert(mm == 4);
+    assert(dd == 25);
+}
+
+void test_jcivil_before_october_15_1582(void) {
+    long yy;
+    int mm, dd;
+
+    jcivil(2299160, &yy, &mm, &dd);
+
+    assert(yy == 1582);
+    assert(mm == 10);
+    assert(dd == 4);
+}
+
+void test_jcivil_on_october_15_1582(void) {
+    long yy;
+    int mm, dd;
+
+    jcivil(2299161, &yy, &mm, &dd);
+
+    assert(yy == 1582);
+    assert(mm == 10);
+    assert(dd == 15);
+}
+
 void test_jyear_regular(void) {
     long yy;
     int mm, dd;
@@ -663,6 +2124,37 @@ void test_truephase_abs_min_0_75_lt_0_01_and_gte_0_5(void) {
     assert_almost_equal(trueph, 2460431.9776856042);
 }
 
+void test_truephase_matches_series(void) {
+    // -2000 to 6000: within a rounding of the date (40 us) of one sine
+    // per term.
+    double worst = 0;
+    for (double k = -48000.0; k < 51000.0; k += 1.0) {
+        for (int q = 0; q < 4; ++q) {
+            double d = truephase(k, q * 0.25) - truephase_series(k, q * 0.25);
+            if (abs(d) > worst)
+                worst = abs(d);
+        }
+    }
+    assert(worst <= 4.66e-10);
+}
+
+void test_truephase_rounds_selector(void) {
+    assert(truephase(1537.0, 0.26) == truephase(1537.0 + 0.01, 0.25));
+    assert(truephase(1537.0, 0.99) == truephase(1537.0 + 0.99, 0.0));
+}
+
+void test_truephases_matches_truephase(void) {
+    for (double k = -1200.0; k < 3800.0; k += 1.0) {
+        double phases[5];
+        truephases(k, phases);
+        assert(phases[0] == truephase(k, 0.0));
+        assert(phases[1] == truephase(k, 0.25));
+        assert(phases[2] == truephase(k, 0.5));
+        assert(phases[3] == truephase(k, 0.75));
+        assert(phases[4] == truephase(k + 1, 0.0));
+    }
+}
+
 void test_phasehunt_regular(void) {
     double phasar[5];
 
@@ -675,10 +2167,162 @@ void test_phasehunt_regular(void) {
     assert_almost_equal(phasar[4], 2449837.2348421547);
 }
 
+void assert_phasehunt_matches_scan(double sdate) {
+    double phasar[5], expected[5];
+
+    phasehunt(sdate, phasar);
+    phasehunt_scan(sdate, expected);
+
+    for (int i = 0; i < 5; ++i) {
+        if (phasar[i] != expected[i]) {
+            fprintf(stderr, "phasehunt(%.17g)[%d]: %.17g != %.17g\n",
+                    sdate, i, phasar[i], expected[i]);
+            assert(FALSE);
+        }
+    }
+}
+
+void test_phasehunt_matches_scan(void) {
+    // 1800 to 2200, with an odd step so lunations get sampled at all ages.
+    for (double sdate = 2378496.5; sdate < 2524593.5; sdate += 0.7123) {
+        assert_phasehunt_matches_scan(sdate);
+    }
+}
+
+void test_phasehunt_matches_scan_at_mean_new_moons(void) {
+    // Right around the switch from one lunation to the next.
+    for (double k = -1200.0; k < 3800.0; k += 7.0) {
+        double nt = meanphase(2415020.75933 + synmonth * k, k);
+
+        assert_phasehunt_matches_scan(nt);
+        assert_phasehunt_matches_scan(nextafter(nt, -INFINITY));
+        assert_phasehunt_matches_scan(nextafter(nt, INFINITY));
+    }
+}
+
+void test_phasehunt_far_from_epoch(void) {
+    double phasar[5];
+    double sdates[] = {-1200941.5, 0.0, 5373484.5};  // -8000, -4712, 10000
+
+    for (size_t i = 0; i < sizeof(sdates) / sizeof(sdates[0]); ++i) {
+        phasehunt(sdates[i], phasar);
+
+        assert(phasar[0] <= sdates[i] + 1.0);
+        assert(phasar[4] > sdates[i] - 1.0);
+        assert(phasar[4] - phasar[0] < synmonth + 1.0);
+    }
+}
+
+void assert_lunation_table_matches_phasehunt(double sdate) {
+    double phasar[5], expected[5];
+    long lunation;
+
+    assert(lunation_table_lookup(sdate, phasar, &lunation));
+    phasehunt(sdate, expected);
+
+    for (int i = 0; i < 5; ++i) {
+        if (phasar[i] != expected[i]) {
+            fprintf(stderr, "lunation_table_lookup(%.17g)[%d]: %.17g != %.17g\n",
+                    sdate, i, phasar[i], expected[i]);
+            assert(FALSE);
+        }
+    }
+    assert(lunation == brown_lunation(expected[0]));
+}
+
+void test_lunation_table_matches_phasehunt(void) {
+    // 1900 to 2100, same as mooncal() (i.e., offset by half a day).
+    for (double sdate = 2415021.0; sdate < 2488435.0; sdate += 0.3217) {
+        assert_lunation_table_matches_phasehunt(sdate);
+    }
+}
+
+void test_lunation_table_matches_phasehunt_at_lunation_starts(void) {
+    for (long i = 1; i < LUNATION_TABLE_SIZE - 1; ++i) {
+        double start = lunation_table[i].start;
+
+        assert_lunation_table_matches_phasehunt(start);
+        assert_lunation_table_matches_phasehunt(nextafter(start, -INFINITY));
+    }
+}
+
+void test_lunation_table_out_of_range(void) {
+    double phasar[5];
+    long lunation;
+    double first = lunation_table[0].start;
+    double last = lunation_table[LUNATION_TABLE_SIZE - 1].start;
+
+    assert(lunation_table_lookup(first, phasar, &lunation));
+    assert(!lunation_table_lookup(nextafter(first, -INFINITY), phasar, &lunation));
+    assert(lunation_table_lookup(nextafter(last, -INFINITY), phasar, &lunation));
+    assert(!lunation_table_lookup(last, phasar, &lunation));
+    assert(!lunation_table_lookup(NAN, phasar, &lunation));
+}
+
+void test_lunation_table_phases_matches_truephase(void) {
+    double phases[4];
+    long lunation;
+    double first = LUNATION_TABLE_FIRST_K;
+    double last = first + LUNATION_TABLE_SIZE - 1;
+
+    for (double k = first; k <= last; k += 1) {
+        assert(lunation_table_phases(k, phases, &lunation));
+        assert(phases[0] == truephase(k, 0.0));
+        assert(phases[1] == truephase(k, 0.25));
+        assert(phases[2] == truephase(k, 0.5));
+        assert(phases[3] == truephase(k, 0.75));
+        assert(lunation == brown_lunation(phases[0]));
+    }
+    assert(!lunation_table_phases(first - 1, phases, &lunation));
+    assert(!lunation_table_phases(last + 1, phases, &lunation));
+}
+
+void test_mooncalendar_outside_lunation_table(void) {
+    MoonCalendar mcal;
+    time_t timestamp = -2500000000;  // 1890-10-12.
+
+    assert(mooncal(&mcal, &timestamp));
+
+    double phasar[5];
+    phasehunt(mcal.julian_date + 0.5, phasar);
+
+    assert(mcal.last_new_moon == phasar[0]);
+    assert(mcal.next_new_moon == phasar[4]);
+    assert(mcal.lunation == brown_lunation(phasar[0]));
+}
+
 void test_kepler_regular(void) {
-    double ec = kepler(111.615376, 0.016718);
+    double ec = kepler_sun(111.615376);
 
     assert_almost_equal(ec, 1.9635011880995301);
+    assert_almost_equal(kepler_loop(111.615376, 0.016718), ec);
+}
+
+void test_kepler_sun_error_bound(void) {
+    // Against Newton's method run to convergence in long double.
+    double worst = 0, worst_sc = 0;
+    for (int i = 0; i < 1000000; ++i) {
+        double m = i * (2 * PI / 1000000);
+        double sine, cose;
+        double e = kepler_sun_sc(m, sin(m), cos(m), &sine, &cose);
+
+        long double root = m;
+        for (int j = 0; j < 8; ++j) {
+            root -= (root - eccent * sinl(root) - m)
+                    / (1 - eccent * cosl(root));
+        }
+
+        if (fabsl(e - root) > worst)
+            worst = fabsl(e - root);
+        if (abs(sine - sin(e)) > worst_sc)
+            worst_sc = abs(sine - sin(e));
+        if (abs(cose - cos(e)) > worst_sc)
+            worst_sc = abs(cose - cos(e));
+        assert(abs(kepler_loop(todeg(m), eccent) - e) < 1e-6);
+    }
+    // 5e-14 before rounding, which adds a few ulps of E (< 2 pi).
+    assert(worst < 5e-14 + 4 * DBL_EPSILON * 2 * PI);
+    assert(worst_sc < 1e-15);
 }
 
 void test_phase_regular(void) {
@@ -696,6 +2340,395 @@ void test_phase_regular(void) {
     assert_almost_equal(csuang, 0.5319984336029933);
 }
 
+void test_lane_trigonometry_matches_libm(void) {
+    for (double x = -720.0; x <= 720.0; x += 0.37) {
+        assert_within(lane_sin(torad(x)), sin(torad(x)), 1e-15);
+        assert_within(lane_cos(torad(x)), cos(torad(x)), 1e-15);
+        // dsin() and dcos() lose some bits in torad(), before reduction.
+        assert_within(lane_dsin(x), dsin(x), 1e-14);
+        assert_within(lane_dcos(x), dcos(x), 1e-14);
+    }
+    for (double x = -50.0; x <= 50.0; x += 0.013) {
+        assert_within(lane_atan(x), atan(x), 1e-15);
+    }
+    assert_within(lane_atan(1e300), PI / 2, 1e-15);
+    assert_within(lane_atan(-1e300), -PI / 2, 1e-15);
+}
+
+void test_lane_fixangle_all(void) {
+    assert_almost_equal(lane_fixangle(-400.0), 320.0);
+    assert_almost_equal(lane_fixangle(-360.0), 0.0);
+    assert_almost_equal(lane_fixangle(-0.0), 0.0);
+    assert_almost_equal(lane_fixangle(360.0), 0.0);
+    assert_almost_equal(lane_fixangle(400.0), 40.0);
+    assert_almost_equal(lane_fixangle(1e9 + 0.5), fixangle(1e9 + 0.5));
+}
+
+void test_phase_lanes_matches_phase(void) {
+    // 1800-01-01 to 2200-01-01, with odd steps to avoid aligning on days.
+    double start = 2378496.5;
+    double step = (2524593.5 - start) / 40000.0 + 0.0123;
+    double pdate[PHASE_LANES], pfrac[PHASE_LANES], pphase[PHASE_LANES];
+    double mage[PHASE_LANES], dist[PHASE_LANES], angdia[PHASE_LANES];
+    double sudist[PHASE_LANES], suangdia[PHASE_LANES];
+
+    for (double jd = start; jd < 2524593.5;) {
+        for (int i = 0; i < PHASE_LANES; ++i, jd += step) {
+            pdate[i] = jd;
+        }
+
+        phase_lanes(pdate, pfrac, pphase, mage, dist, angdia, sudist, suangdia);
+
+        for (int i = 0; i < PHASE_LANES; ++i) {
+            double cphase, aom, cdist, cangdia, csund, csuang;
+            double p = phase(pdate[i], &cphase, &aom, &cdist, &cangdia, &csund, &csuang);
+
+            // Near New Moon, one side may wrap around while the other doesn't.
+            if (abs(pfrac[i] - p) > 0.5) {
+                p += (p < pfrac[i]) ? 1.0 : -1.0;
+                aom += (aom < mage[i]) ? synmonth : -synmonth;
+            }
+
+            assert_within(pfrac[i], p, 1e-14);
+            assert_within(pphase[i], cphase, 1e-14);
+            assert_within(mage[i], aom, 1e-13);
+            assert_within(dist[i], cdist, 1e-9);
+            assert_within(angdia[i], cangdia, 1e-15);
+            assert_within(sudist[i], csund, 1e-6);
+            assert_within(suangdia[i], csuang, 1e-15);
+        }
+    }
+}
+
+void test_cpu_variants_match_generic(void) {
+    const CpuVariant *generic = &cpu_variants[CPU_VARIANTS - 1];
+    double pdate[PHASE_LANES_FLOAT], out[2][7][PHASE_LANES];
+    double sincos[4][PHASE_LANES];
+    float outf[2][7][PHASE_LANES_FLOAT];
+    double phases[2][5];
+    struct tm gm[2];
+
+    assert(strcmp(generic->name, "generic") == 0);
+
+    for (size_t v = 0; v < CPU_VARIANTS; ++v) {
+        const CpuVariant *variant = &cpu_variants[v];
+        if (!variant->supports()) {
+            continue;
+        }
+
+        // Bit for bit, 1800 to 2200.
+        for (double jd = 2378496.5; jd < 2524593.5;) {
+            for (int i = 0; i < PHASE_LANES; ++i, jd += 3.7218) {
+                pdate[i] = jd;
+            }
+            generic->phase_lanes(pdate, out[0][0], out[0][1], out[0][2], out[0][3],
+                                 out[0][4], out[0][5], out[0][6]);
+            variant->phase_lanes(pdate, out[1][0], out[1][1], out[1][2], out[1][3],
+                                 out[1][4], out[1][5], out[1][6]);
+            assert(memcmp(out[0], out[1], sizeof out[0]) == 0);
+
+            for (int i = 0; i < PHASE_LANES; ++i) {
+                double m, d;
+                iter_angles(pdate[i], &m, &d);
+                sincos[0][i] = dsin(m);
+                sincos[1][i] = dcos(m);
+                sincos[2][i] = dsin(d);
+                sincos[3][i] = dcos(d);
+            }
+            generic->phase_lanes_iter(pdate, sincos[0], sincos[1], sincos[2],
+                                      sincos[3], out[0][0], out[0][1], out[0][2],
+                                      out[0][3], out[0][4], out[0][5], out[0][6]);
+            variant->phase_lanes_iter(pdate, sincos[0], sincos[1], sincos[2],
+                                      sincos[3], out[1][0], out[1][1], out[1][2],
+                                      out[1][3], out[1][4], out[1][5], out[1][6]);
+            assert(memcmp(out[0], out[1], sizeof out[0]) == 0);
+        }
+
+        for (double jd = 2378496.5; jd < 2524593.5;) {
+            for (int i = 0; i < PHASE_LANES_FLOAT; ++i, jd += 3.7218) {
+                pdate[i] = jd;
+            }
+            generic->phase_lanes_float(pdate, outf[0][0], outf[0][1], outf[0][2],
+                                       outf[0][3], outf[0][4], outf[0][5], outf[0][6]);
+            variant->phase_lanes_float(pdate, outf[1][0], outf[1][1], outf[1][2],
+                                       outf[1][3], outf[1][4], outf[1][5], outf[1][6]);
+            assert(memcmp(outf[0], outf[1], sizeof outf[0]) == 0);
+        }
+
+        for (double k = -1300.0; k < 3700.0; k += 1.0) {
+            generic->truephases(k, phases[0]);
+            variant->truephases(k, phases[1]);
+            assert(memcmp(phases[0], phases[1], sizeof phases[0]) == 0);
+        }
+
+        for (double jd = 0.0; jd < 5373484.0; jd += 12.3456789) {
+            generic->jtouct(jd, &gm[0]);
+            variant->jtouct(jd, &gm[1]);
+            assert(tm_equal(&gm[0], &gm[1]));
+        }
+    }
+}
+
+void test_cpu_find(void) {
+    for (size_t v = 0; v < CPU_VARIANTS; ++v) {
+        const CpuVariant *variant = &cpu_variants[v];
+        const CpuVariant *expected = variant->supports() ? variant : NULL;
+        assert(cpu_find(variant->name) == expected);
+    }
+
+    assert(cpu_find("generic") != NULL);
+    assert(cpu_find("pentium") == NULL);
+}
+
+void test_lane_fixanglef_below_360(void) {
+    assert(lane_fixanglef(-1e-6f) == 0.0f);  // Not 360.
+    assert(lane_fixanglef(-1e-3f) > 359.99f);
+    assert(lane_fixanglef(-1e-3f) < 360.0f);
+    assert(lane_fixanglef(360.0f) == 0.0f);
+    assert(lane_fixanglef(-400.0f) == 320.0f);
+}
+
+void test_phase_lanes_float_matches_phase_lanes(void) {
+    // 1800-01-01 to 2200-01-01, with odd steps to avoid aligning on days.
+    double start = 2378496.5;
+    double step = (2524593.5 - start) / 200000.0 + 0.0123;
+    double pdate[PHASE_LANES_FLOAT], out[7][PHASE_LANES];
+    float outf[7][PHASE_LANES_FLOAT];
+
+    for (double jd = start; jd < 2524593.5;) {
+        for (int i = 0; i < PHASE_LANES_FLOAT; ++i, jd += step) {
+            pdate[i] = jd;
+        }
+
+        phase_lanes_float(pdate, outf[0], outf[1], outf[2], outf[3], outf[4],
+                          outf[5], outf[6]);
+
+        for (int h = 0; h < PHASE_LANES_FLOAT; h += PHASE_LANES) {
+            phase_lanes(pdate + h, out[0], out[1], out[2], out[3], out[4],
+                        out[5], out[6]);
+
+            for (int i = 0; i < PHASE_LANES; ++i) {
+                double p = out[0][i], aom = out[2][i];
+
+                assert(outf[0][h + i] >= 0.0f && outf[0][h + i] < 1.0f);
+
+                // Near New Moon, one side may wrap around while the other doesn't.
+                if (abs(outf[0][h + i] - p) > 0.5) {
+                    p += (p < outf[0][h + i]) ? 1.0 : -1.0;
+                    aom += (aom < outf[2][h + i]) ? synmonth : -synmonth;
+                }
+
+                assert_within(outf[0][h + i], p, 5e-7);
+                assert_within(outf[1][h + i], out[1][i], 5e-7);
+                assert_within(outf[2][h + i], aom, 1e-5);
+                assert_within(outf[3][h + i], out[3][i], 0.1);
+                assert_within(outf[4][h + i], out[4][i], 5e-7);
+                assert_within(outf[5][h + i], out[5][i], 25.0);
+                assert_within(outf[6][h + i], out[6][i], 5e-7);
+            }
+        }
+    }
+}
+
+void test_moonphase_batch_float_matches_moonphase_batch(void) {
+    enum { N = PHASE_LANES_FLOAT * 2 + 3 };
+    time_t timestamps[N];
+    double age[N], illuminated[N], julian_date[N], julian_date_float[N];
+    float agef[N], illuminatedf[N];
+
+    for (int i = 0; i < N; ++i) {
+        timestamps[i] = 794886000 + i * 7200;
+    }
+
+    MoonPhaseColumns columns = {0};
+    columns.julian_date = julian_date;
+    columns.age = age;
+    columns.fraction_illuminated = illuminated;
+    assert(moonphase_batch(&columns, timestamps, N));
+
+    MoonPhaseColumnsFloat columnsf = {0};
+    columnsf.julian_date = julian_date_float;
+    columnsf.age = agef;
+    columnsf.fraction_illuminated = illuminatedf;
+    assert(moonphase_batch_float(&columnsf, timestamps, N));
+
+    for (int i = 0; i < N; ++i) {
+        assert(julian_date_float[i] == julian_date[i]);
+        assert_within(agef[i], age[i], 1e-5);
+        assert_within(illuminatedf[i], illuminated[i], 5e-7);
+    }
+}
+
+void test_moonphase_batch_float_out_of_range(void) {
+    time_t timestamps[2] = {794886000, (time_t) 1e18};  // Beyond struct tm.
+    float age[2];
+
+    MoonPhaseColumnsFloat columns = {0};
+    columns.age = age;
+
+    assert(!moonphase_batch_float(&columns, timestamps, 2));
+}
+
+void test_moonphase_batch_incomplete_lane_group(void) {
+    time_t timestamps[PHASE_LANES + 3];
+    double age[PHASE_LANES + 3];
+
+    for (int i = 0; i < PHASE_LANES + 3; ++i) {
+        timestamps[i] = 794886000 + i * 3600;
+    }
+
+    MoonPhaseColumns columns = {0};
+    columns.age = age;
+
+    assert(moonphase_batch(&columns, timestamps, PHASE_LANES + 3));
+
+    for (int i = 0; i < PHASE_LANES + 3; ++i) {
+        MoonPhase mphase;
+        assert(moonphase(&mphase, &timestamps[i]));
+        assert_within(age[i], mphase.age, 1e-13);
+    }
+}
+
+void test_moon_position_high_meeus_example(void) {
+    // Meeus, Astronomical Algorithms, example 47.a (1992 April 12, 0h TD).
+    double lambda, beta, delta;
+    moon_position_high(2448724.5, &lambda, &beta, &delta);
+    assert_within(lambda, 133.162655, 1e-6);
+    assert_within(beta, -3.229126, 1e-6);
+    assert_within(delta, 368409.7, 0.1);
+}
+
+void test_sun_position_high_meeus_example(void) {
+    // Meeus, example 25.a (1992 October 13, 0h TD).
+    double lambda, r;
+    sun_position_high(2448908.5, &lambda, &r);
+    assert_within(lambda, 199.90988, 1e-4);
+    assert_within(r, 0.99766, 1e-5);
+}
+
+void test_delta_t_regular(void) {
+    assert_within(delta_t(2451544.5), 63.86, 0.01);  // 2000 January 1.
+    assert_within(delta_t(2448724.5), 58.55, 0.01);  // 1992 April 12.
+}
+
+void test_phase_high_meeus_example(void) {
+    // Meeus, example 48.a: k = 0.6786 on 1992 April 12, 0h TD.
+    double jd = 2448724.5 - delta_t(2448724.5) / 86400.0;
+    double cphase, aom, cdist, cangdia, csund, csuang;
+    phase_high(jd, &cphase, &aom, &cdist, &cangdia, &csund, &csuang);
+    assert_within(cphase, 0.6786, 1e-4);
+    assert_within(cdist, 368409.7, 0.1);
+}
+
+void test_phase_high_syzygies(void) {
+    // Published New and Full Moons (UTC); HIGH is within about a minute.
+    time_t syzygies[] = {
+        1712600460,  // New Moon, 2024-04-08 18:21.
+        1726626840,  // Full Moon, 2024-09-18 02:34.
+        947182440,   // New Moon, 2000-01-06 18:14.
+        948429600,   // Full Moon, 2000-01-21 04:40.
+    };
+
+    for (size_t i = 0; i < sizeof(syzygies) / sizeof(*syzygies); ++i) {
+        MoonPhase mphase;
+        assert(moonphase_precision(&mphase, &syzygies[i], MOON_PRECISION_HIGH));
+        double p = mphase.fraction_of_lunation;
+        p = p < 0.75 ? p : p - 1.0;
+        double target = (i % 2 == 0) ? 0.0 : 0.5;
+        assert_within(p * synmonth * 1440.0, target * synmonth * 1440.0, 1.5);
+    }
+}
+
+void assert_tier_within_bounds(PhaseTier phasef, double age_min, double illum,
+                               double dist, double angdia, double sudist,
+                               double suangdia) {
+    // 1800-01-01 to 2200-01-01, not in step with the lunation.
+    for (double jd = 2378496.5; jd < 2524593.5; jd += 3.731) {
+        double p, aom, cphase, cdist, cangdia, csund, csuang;
+        double hp, haom, hcphase, hcdist, hcangdia, hcsund, hcsuang;
+
+        p = phasef(jd, &cphase, &aom, &cdist, &cangdia, &csund, &csuang);
+        hp = phase_high(jd, &hcphase, &haom, &hcdist, &hcangdia, &hcsund,
+                        &hcsuang);
+
+        // Near New Moon, one side may wrap around while the other doesn't.
+        if (abs(p - hp) > 0.5) {
+            haom += (haom < aom) ? synmonth : -synmonth;
+        }
+
+        assert_within(aom * 1440.0, haom * 1440.0, age_min);
+        assert_within(cphase, hcphase, illum);
+        assert_within(cdist, hcdist, dist);
+        assert_within(cangdia, hcangdia, angdia);
+        assert_within(csund, hcsund, sudist);
+        assert_within(csuang, hcsuang, suangdia);
+    }
+}
+
+void test_phase_fast_within_documented_bounds(void) {
+    assert_tier_within_bounds(phase_fast, 75.0, 0.007, 7100.0, 0.011,
+                              166000.0, 0.0006);
+}
+
+void test_phase_standard_within_documented_bounds(void) {
+    assert_tier_within_bounds(phase, 53.0, 0.005, 7100.0, 0.011, 166000.0,
+                              0.0006);
+}
+
+void test_moonphase_precision_standard_is_moonphase(void) {
+    time_t timestamp = 794886000;
+    MoonPhase expected, mphase;
+
+    assert(moonphase(&expected, &timestamp));
+    assert(moonphase_precision(&mphase, &timestamp, MOON_PRECISION_STANDARD));
+    assert(mphase.julian_date == expected.julian_date);
+    assert(mphase.fraction_of_lunation == expected.fraction_of_lunation);
+    assert(mphase.age == expected.age);
+    assert(mphase.fraction_illuminated == expected.fraction_illuminated);
+    assert(mphase.distance_to_earth_km == expected.distance_to_earth_km);
+    assert(mphase.sun_distance_to_earth_km == expected.sun_distance_to_earth_km);
+}
+
+void test_moonphase_precision_unknown_tier(void) {
+    time_t timestamp = 794886000;
+    MoonPhase mphase;
+    time_t timestamps[1] = {794886000};
+    double age[1];
+
+    MoonPhaseColumns columns = {0};
+    columns.age = age;
+
+    assert(!moonphase_precision(&mphase, &timestamp, -1));
+    assert(!moonphase_precision(&mphase, &timestamp, 3));
+    assert(!moonphase_batch_precision(&columns, timestamps, 1, 3));
+}
+
+void test_moonphase_batch_precision_matches_moonphase_precision(void) {
+    enum { N = 5 };
+    time_t timestamps[N];
+    double age[N], distance[N];
+
+    for (int i = 0; i < N; ++i) {
+        timestamps[i] = 794886000 + i * 86400;
+    }
+
+    MoonPhaseColumns columns = {0};
+    columns.age = age;
+    columns.distance_to_earth_km = distance;
+
+    for (int precision = MOON_PRECISION_FAST; precision <= MOON_PRECISION_HIGH;
+         ++precision) {
+        assert(moonphase_batch_precision(&columns, timestamps, N, precision));
+
+        for (int i = 0; i < N; ++i) {
+            MoonPhase mphase;
+            assert(moonphase_precision(&mphase, &timestamps[i], precision));
+            assert_within(age[i], mphase.age, 1e-13);
+            assert_within(distance[i], mphase.distance_to_earth_km, 1e-9);
+        }
+    }
+}
+
 int main(void) {
     // Utils
     test_abs_all();
@@ -710,12 +2743,66 @@ int main(void) {
 
     test_moonphase_regular();
     test_moonphase_multiple_creations();
+    test_moonphase_does_not_use_static_time_storage();
     test_moonphase_display();
 
+    test_moonphase_batch_matches_moonphase();
+    test_moonphase_batch_skips_null_columns();
+    test_moonphase_batch_empty();
+    test_moonphase_batch_incomplete_lane_group();
+
+    test_moonphase_range_matches_moonphase();
+    test_moonphase_range_backwards_and_small();
+    test_mooncal_range_matches_mooncal();
+
+    test_moonephem_roundtrip_lunations();
+    test_moonephem_roundtrip_phases();
+    test_moonephem_ranges();
+    test_moonephem_rejects_invalid_files();
+    test_moonephem_write_invalid_ranges();
+
+    test_moonchebyshev_daily_fit_error_bounds();
+    test_moonchebyshev_coarse_fit_error_bounds();
+    test_moonchebyshev_out_of_range();
+    test_moonchebyshev_invalid_fits();
+
+    test_moonphase_iter_every_minute();
+    test_moonphase_iter_every_hour();
+    test_moonphase_iter_odd_step();
+    test_moonphase_iter_one_by_one();
+    test_moonphase_iter_chunks();
+    test_moonphase_iter_invalid_step();
+
     test_mooncalendar_regular();
     test_mooncalendar_multiple_creations();
+    test_mooncalendar_does_not_use_static_time_storage();
     test_mooncalendar_display();
 
+    test_mooncal_year_1994();
+    test_mooncal_year_matches_phasehunt();
+    test_mooncal_year_capacity();
+    test_moonphase_crossings_matches_sampling();
+    test_moonphase_crossings_age_once_per_lunation();
+    test_moonphase_next_crossing();
+    test_moonphase_crossings_invalid();
+    test_moonphase_crossings_capacity();
+    test_moonphase_apsides_matches_sampling();
+    test_moonphase_apsides_capacity();
+    test_mooncal_syzygies_2024();
+
+    test_moonphase_format_matches_sprintf();
+    test_moonphase_to_csv_matches_snprintf();
+    test_mooncal_format_matches_sprintf();
+    test_moonphase_format_truncation();
+    test_moonphase_format_local_time_out_of_range();
+    test_mooncal_format_truncation();
+
+    test_moonphase_to_json();
+    test_mooncal_to_json();
+
+    test_moonphase_records_roundtrip();
+    test_moonphase_records_rejects_invalid_files();
+
     // Moon
 
     test_fraction_of_lunation_to_phase_number();
@@ -725,17 +2812,32 @@ int main(void) {
     test_fmt_phase_time_regular();
     test_fmt_phase_time_month_padding();
     test_fmt_phase_time_at_boundaries();
+    test_fmt_fixed_matches_printf();
+    test_fmt_double_matches_printf();
 
     test_jtime_regular();
     test_jtime_january();
     test_jtime_zero();
     test_jtime_negative();
 
+    test_unixtoj_regular();
+    test_unixtoj_negative();
+    test_unixtoj_matches_jtime_full_range();
+    test_unixtoj_before_gregorian_reform();
+
     test_ucttoj_regular();
     test_ucttoj_month_lte_2();
     test_ucttoj_year_1582();
 
     test_jtouct_regular();
+    test_jtouct_matches_float_every_day();
+    test_jtouct_matches_float_around_gregorian_reform();
+    test_jtouct_matches_float_on_second_boundaries();
+    test_jtouct_weekday_before_julian_epoch();
+
+    test_jcivil_regular();
+    test_jcivil_before_october_15_1582();
+    test_jcivil_on_october_15_1582();
 
     test_jyear_regular();
     test_jyear_before_october_15_1582();
@@ -754,11 +2856,47 @@ int main(void) {
     test_truephase_abs_min_0_25_lt_0_01_and_lt_0_5();
     test_truephase_abs_min_0_75_lt_0_01_and_gte_0_5();
 
+    test_truephase_matches_series();
+    test_truephase_rounds_selector();
+    test_truephases_matches_truephase();
     test_phasehunt_regular();
+    test_phasehunt_matches_scan();
+    test_phasehunt_matches_scan_at_mean_new_moons();
+    test_phasehunt_far_from_epoch();
+
+    test_lunation_table_matches_phasehunt();
+    test_lunation_table_matches_phasehunt_at_lunation_starts();
+    test_lunation_table_out_of_range();
+    test_lunation_table_phases_matches_truephase();
+    test_mooncalendar_outside_lunation_table();
 
     test_kepler_regular();
+    test_kepler_sun_error_bound();
 
     test_phase_regular();
 
-    printf("\x1b[0;92mSuccess! All tests passed.\x1b[0m\n");
+    test_lane_trigonometry_matches_libm();
+    test_lane_fixangle_all();
+    test_phase_lanes_matches_phase();
+    test_lane_fixanglef_below_360();
+    test_phase_lanes_float_matches_phase_lanes();
+    test_moonphase_batch_float_matches_moonphase_batch();
+    test_moonphase_batch_float_out_of_range();
+
+    test_moon_position_high_meeus_example();
+    test_sun_position_high_meeus_example();
+    test_delta_t_regular();
+    test_phase_high_meeus_example();
+    test_phase_high_syzygies();
+    test_phase_fast_within_documented_bounds();
+    test_phase_standard_within_documented_bounds();
+    test_moonphase_precision_standard_is_moonphase();
+    test_moonphase_precision_unknown_tier();
+    test_moonphase_batch_precision_matches_moonphase_precision();
+
+    test_cpu_variants_match_generic();
+    test_cpu_find();
+
+    printf("\x1b[0;92mSuccess! All tests passed (%s).\x1b[0m\n",
+           moon_cpu_variant());
 }
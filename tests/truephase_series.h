@@ -0,0 +1,61 @@
+#ifndef TESTS_TRUEPHASE_SERIES_H_
+#define TESTS_TRUEPHASE_SERIES_H_
+
+// Original version of `truephase()`, with one sine per term, kept as a
+// reference for tests and benchmarks. Must be included after `moon.c`.
+
+static double truephase_series(double k, double phase) {
+    double t, t2, t3, pt, m, mprime, f;
+
+    k += phase;
+    t = k / 1236.85;
+    t2 = t * t;
+    t3 = t2 * t;
+    pt = 2415020.75933
+         + synmonth * k
+         + 0.0001178 * t2
+         - 0.000000155 * t3
+         + 0.00033 * dsin(166.56 + 132.87 * t - 0.009173 * t2);
+
+    m = 359.2242 + 29.10535608 * k - 0.0000333 * t2 - 0.00000347 * t3;
+    mprime = 306.0253 + 385.81691806 * k + 0.0107306 * t2 + 0.00001236 * t3;
+    f = 21.2964 + 390.67050646 * k - 0.0016528 * t2 - 0.00000239 * t3;
+    if ((phase < 0.01) || (abs(phase - 0.5) < 0.01)) {
+        pt +=     (0.1734 - 0.000393 * t) * dsin(m)
+                + 0.0021 * dsin(2 * m)
+                - 0.4068 * dsin(mprime)
+                + 0.0161 * dsin(2 * mprime)
+                - 0.0004 * dsin(3 * mprime)
+                + 0.0104 * dsin(2 * f)
+                - 0.0051 * dsin(m + mprime)
+                - 0.0074 * dsin(m - mprime)
+                + 0.0004 * dsin(2 * f + m)
+                - 0.0004 * dsin(2 * f - m)
+                - 0.0006 * dsin(2 * f + mprime)
+                + 0.0010 * dsin(2 * f - mprime)
+                + 0.0005 * dsin(m + 2 * mprime);
+    } else {
+        pt +=     (0.1721 - 0.0004 * t) * dsin(m)
+                + 0.0021 * dsin(2 * m)
+                - 0.6280 * dsin(mprime)
+                + 0.0089 * dsin(2 * mprime)
+                - 0.0004 * dsin(3 * mprime)
+                + 0.0079 * dsin(2 * f)
+                - 0.0119 * dsin(m + mprime)
+                - 0.0047 * dsin(m - mprime)
+                + 0.0003 * dsin(2 * f + m)
+                - 0.0004 * dsin(2 * f - m)
+                - 0.0006 * dsin(2 * f + mprime)
+                + 0.0021 * dsin(2 * f - mprime)
+                + 0.0003 * dsin(m + 2 * mprime)
+                + 0.0004 * dsin(m - 2 * mprime)
+                - 0.0003 * dsin(2 * m + mprime);
+        if (phase < 0.5)
+            pt += 0.0028 - 0.0004 * dcos(m) + 0.0003 * dcos(mprime);
+        else
+            pt += -0.0028 + 0.0004 * dcos(m) - 0.0003 * dcos(mprime);
+    }
+    return pt;
+}
+
+#endif  // TESTS_TRUEPHASE_SERIES_H_
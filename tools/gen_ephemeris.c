@@ -0,0 +1,37 @@
+/**
+ * Write an ephemeris file, for use with `moonephem_open()`.
+ *
+ * Usage: gen_ephemeris FILE FROM_JD TO_JD STEP_DAYS
+ *
+ * For instance, hourly samples for the 21st century:
+ *
+ *     gen_ephemeris moon.eph 2451544.5 2488069.5 0.041666666666666664
+ */
+
+#include "../moon/moon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int parse_double(const char* arg, double* value) {
+    char* end;
+    *value = strtod(arg, &end);
+    return end != arg && *end == '\0';
+}
+
+int main(int argc, char* argv[]) {
+    double from_jd, to_jd, step;
+
+    if (argc != 5 || !parse_double(argv[2], &from_jd)
+        || !parse_double(argv[3], &to_jd) || !parse_double(argv[4], &step)) {
+        fprintf(stderr, "usage: gen_ephemeris FILE FROM_JD TO_JD STEP_DAYS\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!moonephem_write(argv[1], from_jd, to_jd, step)) {
+        fprintf(stderr, "Error writing ephemeris file '%s'.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
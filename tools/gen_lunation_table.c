@@ -0,0 +1,63 @@
+/**
+ * Generate `moon/lunation_table.h`, the precomputed lunation table used
+ * by `mooncal()` when moon.c is built with `MOON_LUNATION_TABLE`.
+ *
+ * Usage: gen_lunation_table > moon/lunation_table.h
+ */
+
+#include "../moon/moon.c"
+
+#include <assert.h>
+#include <stdio.h>
+
+#define TABLE_FIRST_DATE 2415021.0  // 1900-01-01T00:00:00 + 0.5 (see mooncal()).
+#define TABLE_LAST_DATE 2488435.0   // 2101-01-01T00:00:00 + 0.5.
+
+/**
+ * Smallest date `s` for which `meanphase(s, k) <= s`, i.e., from which
+ * on `phasehunt()` selects lunation `k` (or a later one).
+ */
+static double lunation_start(double k) {
+    double lo = 2415020.75933 + synmonth * k - 1.0;
+    double hi = lo + 2.0;
+
+    assert(meanphase(lo, k) > lo);
+    assert(meanphase(hi, k) <= hi);
+
+    // Bisect down to adjacent doubles.
+    while (TRUE) {
+        double mid = lo + (hi - lo) / 2;
+        if (mid == lo || mid == hi)
+            break;
+        if (meanphase(mid, k) <= mid)
+            hi = mid;
+        else
+            lo = mid;
+    }
+    return hi;
+}
+
+int main(void) {
+    double first = lunation_k(TABLE_FIRST_DATE);
+    // One more entry past the last date, for its start and new moon.
+    double last = lunation_k(TABLE_LAST_DATE) + 1;
+
+    printf("/* Generated by tools/gen_lunation_table.c. Do not edit. */\n\n");
+    printf("#define LUNATION_TABLE_SIZE %ld\n", (long)(last - first) + 1);
+    printf("#define LUNATION_TABLE_FIRST_K %ld\n\n", (long)first);
+    printf("static const LunationEntry lunation_table[LUNATION_TABLE_SIZE] = {\n");
+    for (double k = first; k <= last; k += 1) {
+        printf(
+            "    {%.17g, {%.17g, %.17g, %.17g, %.17g}, %ld},\n",
+            lunation_start(k),
+            truephase(k, 0.0),
+            truephase(k, 0.25),
+            truephase(k, 0.5),
+            truephase(k, 0.75),
+            brown_lunation(truephase(k, 0.0))
+        );
+    }
+    printf("};\n");
+
+    return 0;
+}